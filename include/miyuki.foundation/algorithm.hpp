@@ -22,6 +22,7 @@
 #pragma once
 #include <miyuki.foundation/defs.h>
 #include <cstddef>
+#include <cstdint>
 
 namespace miyuki {
     // find i such that arr[i] <= val < arr[i+1]
@@ -42,4 +43,31 @@ namespace miyuki {
         }
         return -1;
     }
+
+    // spreads the lower 10 bits of x so that there are two zero bits between each
+    inline uint32_t ExpandBits10(uint32_t x) {
+        x &= 0x3ffu;
+        x = (x | (x << 16u)) & 0x030000ffu;
+        x = (x | (x << 8u)) & 0x0300f00fu;
+        x = (x | (x << 4u)) & 0x030c30c3u;
+        x = (x | (x << 2u)) & 0x09249249u;
+        return x;
+    }
+
+    // 30-bit Morton code of a point quantized to a 1024^3 grid
+    inline uint32_t EncodeMorton3(uint32_t x, uint32_t y, uint32_t z) {
+        return (ExpandBits10(x) << 2u) | (ExpandBits10(y) << 1u) | ExpandBits10(z);
+    }
+
+    inline int CountLeadingZeros(uint64_t x) {
+        if (x == 0)
+            return 64;
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanReverse64(&idx, x);
+        return 63 - (int) idx;
+#else
+        return __builtin_clzll(x);
+#endif
+    }
 } // namespace miyuki
\ No newline at end of file
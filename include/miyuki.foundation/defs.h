@@ -89,6 +89,34 @@ namespace miyuki {
         fs::path current;
     };
 
+    // Relative paths are resolved against this instead of the process-wide current path,
+    // so that renders with different working directories can share a process
+    inline fs::path &ThreadWorkingDirectory() {
+        static thread_local fs::path dir;
+        return dir;
+    }
+
+    inline fs::path ResolvePath(const fs::path &path) {
+        auto &dir = ThreadWorkingDirectory();
+        if (dir.empty() || path.is_absolute()) {
+            return path;
+        }
+        return dir / path;
+    }
+
+    struct WorkingDirectoryGuard {
+        explicit WorkingDirectoryGuard(const fs::path &dir) : previous(ThreadWorkingDirectory()) {
+            ThreadWorkingDirectory() = dir.empty() ? dir : fs::absolute(dir);
+        }
+
+        ~WorkingDirectoryGuard() {
+            ThreadWorkingDirectory() = previous;
+        }
+
+    private:
+        fs::path previous;
+    };
+
 #define MIYUKI_NOT_IMPLEMENTED() std::abort()
 #define MIYUKI_THROW(exception, ...) throw exception(__VA_ARGS__)
 
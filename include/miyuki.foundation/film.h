@@ -26,8 +26,43 @@
 #include <miyuki.foundation/math.hpp>
 #include <algorithm>
 #include <miyuki.foundation/image.hpp>
+#include <memory>
+#include <iosfwd>
 
 namespace miyuki::core {
+    // Header of a film dump (.film). The header is followed by the planes in `planes`, in bit order,
+    // each one width * height texels of float32 channels. Every plane is a sum over samples, so dumps
+    // of disjoint sample ranges of one frame merge by adding up their payloads.
+    struct FilmDumpHeader {
+        enum Plane : uint32_t {
+            Color = 1u,
+            Normal = 2u,
+            Albedo = 4u,
+            // also the sample count, samples are added with weight 1
+            Weight = 8u,
+            // optional, for variance estimates
+            SecondMoment = 16u
+        };
+        static constexpr char Magic[8] = {'M', 'Y', 'K', 'F', 'I', 'L', 'M', 0};
+        static constexpr uint32_t Version = 1;
+
+        char magic[8] = {};
+        uint32_t version = 0;
+        uint32_t width = 0, height = 0;
+        uint32_t planes = 0;
+
+        [[nodiscard]] bool valid() const;
+
+        // float channels per texel over all planes
+        [[nodiscard]] size_t channels() const;
+
+        [[nodiscard]] size_t payloadSize() const { return sizeof(float) * channels() * width * height; }
+
+        [[nodiscard]] bool compatible(const FilmDumpHeader &other) const {
+            return width == other.width && height == other.height && planes == other.planes;
+        }
+    };
+
 
     struct Film {
         struct Sample {
@@ -47,10 +82,12 @@ namespace miyuki::core {
         };
 
         RGBImage color, normal, weight, albedo;
+        // weighted sum of squared sample colors, for variance estimates
+        RGBImage secondMoment;
         const size_t width, height;
 
-        explicit Film(const Vec2i &dim) : color(dim), weight(dim), normal(dim), albedo(dim), width(dim[0]),
-                                          height(dim[1]) {}
+        explicit Film(const Vec2i &dim) : color(dim), normal(dim), weight(dim), albedo(dim), secondMoment(dim),
+                                          width(dim[0]), height(dim[1]) {}
 
         Film(size_t w, size_t h) : Film(Vec2i(w, h)) {}
 
@@ -72,6 +109,16 @@ namespace miyuki::core {
 
         void writeImage(const std::string &filename);
 
+        // see FilmDumpHeader, the second moment is left out unless variance is set
+        void writeDump(const std::string &filename, bool variance = true) const;
+
+        void writeDump(std::ostream &out, bool variance = true) const;
+
+        static std::shared_ptr<Film> readDump(const std::string &filename);
+
+        // builds a film from a dump payload, e.g. one summed in memory
+        static std::shared_ptr<Film> fromDump(const FilmDumpHeader &header, const float *payload);
+
         Pixel operator()(const Vec2f &p) { return (*this)(p.x(), p.y()); }
 
         Pixel operator()(float x, float y) {
@@ -86,6 +133,25 @@ namespace miyuki::core {
             auto pixel = (*this)(p.x(), p.y());
             pixel.color.get() += float3(color * weight);
             pixel.weight.get() += weight;
+            secondMoment(p.x(), p.y()) += color * color * weight;
+        }
+
+        // Variance of the mean color of pixel p, averaged over channels; -1 with fewer than two samples
+        [[nodiscard]] float varianceOfMean(const Vec2i &p) const {
+            auto n = weight(p.x(), p.y()).r();
+            if (n < 2) {
+                return -1;
+            }
+            auto mean = color(p.x(), p.y()) / n;
+            auto variance = (secondMoment(p.x(), p.y()) / n - mean * mean) * (n / (n - 1));
+            return std::max(0.0f, (variance[0] + variance[1] + variance[2]) / 3.0f) / n;
+        }
+
+        // Adds radiance to a sample whose weight was already counted, e.g. a deferred light sample.
+        // Not part of the second moment.
+        void addContribution(const Vec2i &p, const Vec3f &color) {
+            auto pixel = (*this)(p.x(), p.y());
+            pixel.color.get() += float3(color);
         }
 
         void addSample(const Vec2f &p, const Sample &sample, Float weight) {
@@ -94,6 +160,7 @@ namespace miyuki::core {
             pixel.normal.get() += float3(sample.normal * weight);
             pixel.albedo.get() += float3(sample.albedo * weight);
             pixel.weight.get() += weight;
+            secondMoment(p) += sample.color * sample.color * weight;
         }
     };
 } // namespace miyuki::core
@@ -0,0 +1,83 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_FILMSNAPSHOT_H
+#define MIYUKIRENDERER_FILMSNAPSHOT_H
+
+#include <miyuki.foundation/film.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace miyuki::core {
+    // The frame as it was at some point of a render. Tiles are shared between snapshots and only
+    // replaced when written to again, so taking or holding on to a snapshot copies no pixels.
+    struct FilmSnapshot {
+        static constexpr int TileSize = 64;
+
+        struct Tile {
+            Bounds2i bounds;
+            // sums over samples, as in Film
+            std::vector<float3> color;
+            std::vector<float> weight;
+        };
+
+        size_t width = 0, height = 0;
+        uint64_t version = 0;
+        // row-major grid of TileSize tiles, null where nothing has been published yet
+        std::vector<std::shared_ptr<const Tile>> tiles;
+
+        // average color of every pixel, row-major
+        [[nodiscard]] std::vector<float3> resolve() const;
+
+        // gamma corrected like Film::writeImage
+        [[nodiscard]] std::vector<unsigned char> toRGBA8() const;
+
+        [[nodiscard]] std::vector<unsigned char> encodePNG() const;
+
+        [[nodiscard]] std::vector<unsigned char> encodeJPEG(int quality = 90) const;
+    };
+
+    // Integrators copy finished tiles of their film in here as they go, readers take snapshots
+    class FilmPublisher {
+        mutable std::mutex mutex;
+        std::condition_variable cv;
+        size_t width = 0, height = 0, tilesX = 0;
+        uint64_t version = 0;
+        // written in place while no snapshot shares them
+        std::vector<std::shared_ptr<FilmSnapshot::Tile>> tiles;
+
+    public:
+        // copies the pixels in bounds, nobody may be writing to them meanwhile
+        void update(const Film &film, const Bounds2i &bounds);
+
+        void clear();
+
+        // null until something was published
+        [[nodiscard]] std::shared_ptr<const FilmSnapshot> snapshot() const;
+
+        // waits at most timeout seconds for a snapshot newer than version, returns the latest one either way
+        std::shared_ptr<const FilmSnapshot> waitNewer(uint64_t version, double timeout);
+    };
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_FILMSNAPSHOT_H
@@ -31,6 +31,8 @@ namespace miyuki {
       public:
         ImageLoader();
         std::shared_ptr<RGBAImage> loadRGBAImage(const fs::path &);
+        // later loads of path return image until the file changes, e.g. one decoded earlier and kept in a snapshot
+        void insert(const fs::path &, const std::shared_ptr<RGBAImage> &image);
         static ImageLoader* getInstance();
     };
 } // namespace miyuki
\ No newline at end of file
@@ -0,0 +1,65 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_MAPPEDFILE_H
+#define MIYUKIRENDERER_MAPPEDFILE_H
+
+#include <miyuki.foundation/noncopyable.hpp>
+#include <cstddef>
+#include <string>
+
+namespace miyuki {
+    // A whole file mapped into memory, read-only or read-write
+    class MappedFile : NonCopyable {
+        void *ptr = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        void *file = nullptr;
+        void *mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+
+        void close();
+
+    public:
+        enum Mode {
+            ReadOnly,
+            // creates or truncates the file to the given size
+            Create,
+            // writable, but writes stay in memory and never reach the file
+            CopyOnWrite
+        };
+
+        MappedFile(const std::string &filename, Mode mode = ReadOnly, size_t size = 0);
+
+        ~MappedFile() { close(); }
+
+        [[nodiscard]] void *data() { return ptr; }
+
+        [[nodiscard]] const void *data() const { return ptr; }
+
+        [[nodiscard]] size_t size() const { return length; }
+    };
+}
+
+#endif //MIYUKIRENDERER_MAPPEDFILE_H
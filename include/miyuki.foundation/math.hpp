@@ -192,6 +192,16 @@ namespace miyuki {
 
         BoundBox unionOf(const Array<T, N> &rhs) const { return BoundBox{min(pMin, rhs), max(pMax, rhs)}; }
 
+        BoundBox intersectionOf(const BoundBox &box) const { return BoundBox{max(pMin, box.pMin), min(pMax, box.pMax)}; }
+
+        bool isEmpty() const {
+            for (size_t i = 0; i < N; i++) {
+                if (pMin[i] > pMax[i])
+                    return true;
+            }
+            return false;
+        }
+
         Array<T, N> centroid() const { return (pMin + pMax) * 0.5f; }
 
         Array<T, N> size() const { return pMax - pMin; }
@@ -122,6 +122,11 @@ namespace miyuki::mpsc {
 
         void close()const { sender = nullptr; }
 
+        // false once the receiving end is gone, sending is a no-op then
+        [[nodiscard]] bool connected() const {
+            return sender && !sender->channel->receiver.expired();
+        }
+
     private:
         Sender() = default;
 
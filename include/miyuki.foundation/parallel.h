@@ -25,6 +25,7 @@
 
 #include <functional>
 #include <thread>
+#include <vector>
 
 namespace miyuki {
     using WorkFunc = std::function<void(int64_t index, size_t threadIdx)>;
@@ -35,6 +36,9 @@ namespace miyuki {
 
     void ParallelFor(int64_t begin, int64_t end, WorkFunc, size_t workSize = 1);
 
+    // Stable LSD radix sort of keys by bits [lowBit, highBit), the remaining bits are carried along
+    void ParallelRadixSort(std::vector<uint64_t> &keys, int lowBit, int highBit);
+
     template<class F1, class F2>
     void ParallelDo(F1 &&f1, F2 &&f2) {
         std::thread thread(f2);
@@ -26,7 +26,11 @@
 #include <type_traits>
 #include <atomic>
 #include <future>
+#include <functional>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include "defs.h"
 #include "noncopyable.hpp"
 
 namespace miyuki {
@@ -66,9 +70,14 @@ namespace miyuki {
             state = Running;
             auto func = std::move(f);
             f = TaskFunc();
-            future = std::async(std::launch::async, func, [=]() -> bool {
-                while (state == Suspended) {}
-                return state == Running;
+            // the task sees the same relative paths as the thread launching it
+            auto workdir = ThreadWorkingDirectory();
+            future = std::async(std::launch::async, [=]() -> Opt {
+                WorkingDirectoryGuard guard(workdir);
+                return func([=]() -> bool {
+                    while (state == Suspended) {}
+                    return state == Running;
+                });
             });
         }
 
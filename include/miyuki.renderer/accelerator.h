@@ -29,25 +29,62 @@
 namespace miyuki::core {
     class Scene;
 
+    class SnapshotWriter;
+
+    class SnapshotReader;
+
     class Accelerator : public serialize::Serializable {
     public:
         MYK_INTERFACE(Accelerator, "Accelerator")
 
         virtual void build(Scene &scene) = 0;
 
+        // Brings the structure up to date after meshes were appended or marked Mesh::_dirty.
+        // Backends that can refit override this; the fallback rebuilds everything.
+        virtual void update(Scene &scene) { build(scene); }
+
         virtual bool intersect(const Ray &ray, Intersection &isct) = 0;
 
         virtual bool occlude(const Ray &ray) = 0;
 
+        // Traces n rays, misses leave isct[i].shape empty. Backends with a stream API override this.
+        virtual void intersectStream(const Ray *rays, Intersection *isct, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                intersect(rays[i], isct[i]);
+            }
+        }
+
+        // Shadow ray counterpart of intersectStream(); occluded[i] is set to 0 or 1
+        virtual void occludeStream(const Ray *rays, uint8_t *occluded, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                occluded[i] = occlude(rays[i]);
+            }
+        }
+
         virtual bool4 intersect4(const Ray4 &ray, Intersection4 &isct) {
             MIYUKI_NOT_IMPLEMENTED();
         }
 
+        // Packet of 8 rays, inactive lanes have tMin > tMax. The fallback traces lane by lane.
         virtual bool8 intersect8(const Ray8 &ray, Intersection8 &isct) {
-            MIYUKI_NOT_IMPLEMENTED();
+            bool8 hit;
+            for (int i = 0; i < 8; i++) {
+                Intersection lane;
+                hit[i] = intersect(GetLane(ray, i), lane);
+                SetLane(isct, i, lane);
+            }
+            return hit;
         }
 
         virtual Bounds3f getBoundingBox() const = 0;
+
+        // Backends that can store their build in a scene snapshot override these three
+        [[nodiscard]] virtual bool supportsSnapshot() const { return false; }
+
+        virtual void saveSnapshot(SnapshotWriter &/*out*/) const { MIYUKI_NOT_IMPLEMENTED(); }
+
+        // restores what saveSnapshot() wrote in place of build(), scene has the meshes it was built from
+        virtual void loadSnapshot(SnapshotReader &/*in*/, Scene &/*scene*/) { MIYUKI_NOT_IMPLEMENTED(); }
     };
 
 }
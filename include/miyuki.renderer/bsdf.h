@@ -54,6 +54,9 @@ namespace miyuki::core {
 
         virtual void sample(Point2f u, const ShadingPoint &, BSDFSample &sample) const = 0;
 
+        // Samples 8 shading points at once, sample[i].wo must be set as for sample()
+        virtual void sample8(const Point2f *u, const ShadingPoint *sp, BSDFSample *sample) const;
+
         [[nodiscard]] virtual bool isSpecular() const {
             return getBSDFType() & ESpecular;
         }
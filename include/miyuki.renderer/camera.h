@@ -34,6 +34,11 @@ namespace miyuki::core {
         Ray ray;
     };
 
+    struct CameraSample8 {
+        Point2i pFilm[8];
+        Ray8 ray;
+    };
+
     class Camera : public serialize::Serializable {
     public:
         MYK_INTERFACE(Camera, "Camera")
@@ -47,6 +52,23 @@ namespace miyuki::core {
                                  Point2i filmDimension,
                                  CameraSample &sample) const = 0;
 
+        // Generates the rays of 8 rasters (or 8 samples of one raster) as a packet
+        virtual void generateRays8(const Point2f *u1,
+                                   const Point2f *u2,
+                                   const Point2i *raster,
+                                   Point2i filmDimension,
+                                   CameraSample8 &sample) const {
+            for (int i = 0; i < 8; i++) {
+                CameraSample s;
+                generateRay(u1[i], u2[i], raster[i], filmDimension, s);
+                sample.pFilm[i] = s.pFilm;
+                SetLane(sample.ray, i, s.ray);
+            }
+        }
+
+        // true if a ray depends only on u1 and the raster, i.e. there is no lens to sample
+        [[nodiscard]] virtual bool isPinhole() const { return false; }
+
         virtual void preprocess(){}
     };
 }
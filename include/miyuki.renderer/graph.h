@@ -41,19 +41,42 @@ namespace miyuki::core {
         std::vector<std::shared_ptr<MeshBase>> shapes;
         std::shared_ptr<Shader> background;
         std::vector<std::shared_ptr<Light>> lights;
+        // optional, the renderer picks a default when left empty
+        std::shared_ptr<Accelerator> accelerator;
         Point2i filmDimension = Vec2i(100, 100);
         Float rayBias = 1e-5f;
+        std::string checkpointFile;
+        Float checkpointInterval = 600;
+        // set by the front end, not part of the scene file
+        bool resume = false;
+        std::shared_ptr<RenderProgress> progress;
 
         SceneGraph() = default;
 
-        MYK_SER(camera, sampler, integrator, shapes, filmDimension, rayBias, lights, background)
+        MYK_SER(camera, sampler, integrator, shapes, filmDimension, rayBias, lights, background, accelerator,
+                checkpointFile, checkpointInterval)
 
         MYK_DECL_CLASS(SceneGraph, "SceneGraph")
 
         void render(const std::shared_ptr<serialize::Context> &ctx, const std::string &outImageFile);
 
+        // renders a scene built by buildScene() and writes the image, returns false if the render failed
+        bool render(const std::shared_ptr<serialize::Context> &ctx, const std::shared_ptr<Scene> &scene,
+                    const std::string &outImageFile);
+
+        // loads the shapes and builds the accelerator
+        std::shared_ptr<Scene> buildScene();
+
+        // the scene with the meshes and accelerator of this graph, not yet preprocessed
+        std::shared_ptr<Scene> createScene();
+
         Task<RenderOutput>
         createRenderTask(const std::shared_ptr<serialize::Context> &ctx, const mpsc::Sender<std::shared_ptr<Film>> &tx);
+
+        // renders a scene built by buildScene() of this graph, or of one with the same shapes and accelerator
+        Task<RenderOutput>
+        createRenderTask(const std::shared_ptr<serialize::Context> &ctx, const std::shared_ptr<Scene> &scene,
+                         const mpsc::Sender<std::shared_ptr<Film>> &tx);
     };
 } // namespace miyuki::core
 #endif // MIYUKIRENDERER_GRAPH_H
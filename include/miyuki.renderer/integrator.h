@@ -23,6 +23,8 @@
 #ifndef MIYUKIRENDERER_INTEGRATOR_H
 #define MIYUKIRENDERER_INTEGRATOR_H
 
+#include <atomic>
+#include <miyuki.foundation/filmsnapshot.h>
 #include <miyuki.foundation/math.hpp>
 #include <miyuki.renderer/interfaces.h>
 #include <miyuki.foundation/mpsc.hpp>
@@ -39,7 +41,16 @@ namespace miyuki::core {
 
     class LightDistribution;
 
-    struct Film;
+    // Written by the integrator while rendering, polled by whoever launched the render
+    struct RenderProgress {
+        std::atomic<double> fraction{0};
+        // average over the film
+        std::atomic<double> samplesPerPixel{0};
+        // for the ray counter, set before the render starts
+        std::shared_ptr<const Scene> scene;
+        // the image so far
+        FilmPublisher frame;
+    };
 
     struct RenderSettings {
         Point2i filmDimension;
@@ -48,6 +59,27 @@ namespace miyuki::core {
         std::shared_ptr<Camera> camera;
         std::shared_ptr<Sampler> sampler;
         std::shared_ptr<LightDistribution> lightDistribution;
+        // render state is saved here every checkpointInterval seconds when not empty
+        std::string checkpointFile;
+        Float checkpointInterval = 600;
+        // continue from checkpointFile instead of starting over
+        bool resume = false;
+        // optional
+        std::shared_ptr<RenderProgress> progress;
+
+        void reportProgress(double fraction, double samplesPerPixel) const {
+            if (progress) {
+                progress->fraction = fraction;
+                progress->samplesPerPixel = samplesPerPixel;
+            }
+        }
+
+        // call when the pixels in tile are done for this pass, by the thread that rendered them
+        void publishTile(const Film &film, const Bounds2i &tile) const {
+            if (progress) {
+                progress->frame.update(film, tile);
+            }
+        }
     };
 
     struct RenderOutput {
@@ -27,16 +27,163 @@
 #include <miyuki.renderer/material.h>
 #include <miyuki.renderer/interfaces.h>
 #include <miyuki.renderer/shape.h>
+#include <miyuki.foundation/mappedfile.h>
+#include <algorithm>
+#include <cmath>
 
 namespace miyuki::core {
     class Mesh;
 
     class AreaLight;
 
+    // Vertex attribute storage, either owned or a section of a mapped file that is used in place.
+    // Files are mapped copy-on-write, so elements can be modified either way; changing the size
+    // copies a mapped section into owned storage first. A copy always owns its elements, only a
+    // move takes the mapping over.
+    template<class T>
+    class MeshBuffer {
+        std::vector<T> owned;
+        std::shared_ptr<MappedFile> file;
+        T *ptr = nullptr;
+        size_t count = 0;
+
+        void own() {
+            if (file) {
+                owned.assign(ptr, ptr + count);
+                file.reset();
+            }
+        }
+
+        void sync() {
+            ptr = owned.data();
+            count = owned.size();
+        }
+
+    public:
+        MeshBuffer() = default;
+
+        MeshBuffer(const MeshBuffer &other) { *this = other; }
+
+        MeshBuffer(MeshBuffer &&other) noexcept { *this = std::move(other); }
+
+        MeshBuffer &operator=(const MeshBuffer &other) {
+            if (this != &other) {
+                file.reset();
+                owned.assign(other.begin(), other.end());
+                sync();
+            }
+            return *this;
+        }
+
+        MeshBuffer &operator=(MeshBuffer &&other) noexcept {
+            if (this == &other) {
+                return *this;
+            }
+            owned = std::move(other.owned);
+            file = std::move(other.file);
+            ptr = other.ptr;
+            count = other.count;
+            other.owned.clear();
+            other.sync();
+            return *this;
+        }
+
+        // refers to count elements at data, which lie in file
+        void map(const std::shared_ptr<MappedFile> &mapped, T *data, size_t n) {
+            std::vector<T>().swap(owned);
+            file = mapped;
+            ptr = data;
+            count = n;
+        }
+
+        [[nodiscard]] bool mapped() const { return file != nullptr; }
+
+        [[nodiscard]] size_t size() const { return count; }
+
+        [[nodiscard]] bool empty() const { return count == 0; }
+
+        T *data() { return ptr; }
+
+        const T *data() const { return ptr; }
+
+        T &operator[](size_t i) { return ptr[i]; }
+
+        const T &operator[](size_t i) const { return ptr[i]; }
+
+        T *begin() { return ptr; }
+
+        T *end() { return ptr + count; }
+
+        const T *begin() const { return ptr; }
+
+        const T *end() const { return ptr + count; }
+
+        void reserve(size_t n) {
+            own();
+            owned.reserve(n);
+            sync();
+        }
+
+        void resize(size_t n) {
+            own();
+            owned.resize(n);
+            sync();
+        }
+
+        void assign(const T *first, const T *last) {
+            file.reset();
+            owned.assign(first, last);
+            sync();
+        }
+
+        void clear() {
+            file.reset();
+            owned.clear();
+            sync();
+        }
+
+        template<class... Args>
+        T &emplace_back(Args &&... args) {
+            own();
+            owned.emplace_back(std::forward<Args>(args)...);
+            sync();
+            return owned.back();
+        }
+
+        void push_back(const T &v) { emplace_back(v); }
+    };
+
     struct VertexData {
-        std::vector<Point3f> position;
-        std::vector<Normal3f> normal;
-        std::vector<Point2f> tex_coord;
+        MeshBuffer<Point3f> position;
+        MeshBuffer<Normal3f> normal;
+        MeshBuffer<Point2f> tex_coord;
+    };
+
+    // Header of a version 2 .mesh file. Each array is a contiguous section at a multiple of
+    // Alignment, stored as laid out in memory so it can be used straight from a mapping:
+    // names (NUL terminated), positions, normals, tex coords, the VertexIndices of each triangle
+    // and its material (an index into names). Version 1 files start with "BINARY_MESH" instead.
+    struct MeshFileHeader {
+        static constexpr char Magic[8] = {'M', 'Y', 'K', 'M', 'E', 'S', 'H', 0};
+        static constexpr uint32_t Version = 2;
+        static constexpr size_t Alignment = 64;
+
+        char magic[8] = {};
+        uint32_t version = 0;
+        // element sizes, files from builds with another vector layout are rejected
+        uint32_t positionSize = 0, normalSize = 0, texCoordSize = 0, indicesSize = 0;
+        uint32_t reserved = 0;
+        uint64_t nNames = 0, nPositions = 0, nNormals = 0, nTexCoords = 0, nTriangles = 0;
+        // byte offsets of the sections from the start of the file
+        uint64_t names = 0, namesSize = 0, positions = 0, normals = 0, texCoords = 0, indices = 0, materials = 0;
+        uint64_t fileSize = 0;
+        // of everything after the header
+        uint64_t checksum = 0;
+
+        // sets magic, version and element sizes, and places the sections after the counts and namesSize
+        void layout();
+
+        static uint64_t Checksum(const char *data, size_t size);
     };
 
     struct VertexIndices {
@@ -47,14 +194,18 @@ namespace miyuki::core {
 
     class Light;
 
+    // Triangle primitiveId of mesh, whose vertex indices, material and light live in the mesh's
+    // arrays. Accelerators may hold copies of the triangle.
     struct MeshTriangle {
-        VertexIndices indices;
-        Light *light = nullptr;
         Mesh *mesh = nullptr;
-        uint16_t name_id = -1;
+        uint32_t primitiveId = 0;
 
         MeshTriangle() = default;
 
+        [[nodiscard]] inline uint16_t materialId() const;
+
+        [[nodiscard]] inline Light *light() const;
+
         [[nodiscard]] inline const Point3f &vertex(size_t) const;
 
         [[nodiscard]] inline Normal3f normal(size_t) const;
@@ -150,7 +301,17 @@ namespace miyuki::core {
 
     public:
         bool _loaded = false;
+        // Set by markDirty(); Scene::update() refits marked meshes and clears it.
+        bool _dirty = false;
+        // Set by setTriangles(); Scene::update() re-preprocesses the mesh and rebuilds its BVH
+        bool _topologyChanged = false;
         std::vector<MeshTriangle> triangles;
+        // one index per corner into all of _vertex_data; corners without a normal have a zero one
+        // and corners without a tex coord a NaN one
+        MeshBuffer<Point3i> indices;
+        MeshBuffer<uint16_t> materialIds;
+        // (primitiveId, light) of emissive triangles, sorted by primitiveId in Scene::preprocessMesh
+        std::vector<std::pair<uint32_t, Light *>> emissiveTriangles;
         VertexData _vertex_data;
         std::vector<std::string> _names;
         std::vector<std::shared_ptr<Material>> _materials;
@@ -161,12 +322,33 @@ namespace miyuki::core {
 
         MYK_SER(filename, materials)
 
+        // version 2 .mesh layout
         void toBinary(std::vector<char> &buffer) const;
 
+        // either version, copying the data
         void fromBinary(const std::vector<char> &buffer);
 
         void foreach(const std::function<void(MeshTriangle *)> &func);
 
+        // Welds the per-attribute indices of the triangles into indices, rebuilding _vertex_data
+        // unless every corner already uses one index for all of its attributes
+        void setTriangles(const VertexIndices *triangles, const uint16_t *materials, size_t count);
+
+        // makes triangles refer to this mesh, after indices have changed
+        void buildTriangles();
+
+        // call after moving vertices in _vertex_data, the next Scene::update() refits the mesh's BVH
+        void markDirty() { _dirty = true; }
+
+        [[nodiscard]] Light *lightOf(uint32_t primitiveId) const {
+            if (emissiveTriangles.empty())
+                return nullptr;
+            auto it = std::lower_bound(emissiveTriangles.begin(), emissiveTriangles.end(), primitiveId,
+                                       [](const std::pair<uint32_t, Light *> &e, uint32_t id) { return e.first < id; });
+            return it != emissiveTriangles.end() && it->first == primitiveId ? it->second : nullptr;
+        }
+
+        // maps the file, version 2 vertex data are used from the mapping without copying
         bool loadFromFile(const std::string &filename);
 
         void preprocess() override;
@@ -190,21 +372,36 @@ namespace miyuki::core {
         void preprocess() override { MIYUKI_NOT_IMPLEMENTED(); }
     };
     inline const Point3f &MeshTriangle::vertex(size_t i) const {
-        return mesh->_vertex_data.position[indices.position[i]];
+        return mesh->_vertex_data.position[mesh->indices[primitiveId][i]];
     }
 
     inline Normal3f MeshTriangle::normal(size_t i) const {
-        auto idx = indices.normal[i];
-        return idx >= 0 ? mesh->_vertex_data.normal[idx] : Ng();
+        const auto &normals = mesh->_vertex_data.normal;
+        if (normals.empty())
+            return Ng();
+        const auto &n = normals[mesh->indices[primitiveId][i]];
+        return n.x() == 0 && n.y() == 0 && n.z() == 0 ? Ng() : n;
     }
 
     inline Point2f MeshTriangle::texCoord(size_t i) const {
-        auto idx = indices.texCoord[i];
-        return idx >= 0 ? mesh->_vertex_data.tex_coord[idx] : Point2f(i > 0, i > 1);
+        const auto &texCoords = mesh->_vertex_data.tex_coord;
+        if (texCoords.empty())
+            return Point2f(i > 0, i > 1);
+        const auto &t = texCoords[mesh->indices[primitiveId][i]];
+        return std::isnan(t.x()) ? Point2f(i > 0, i > 1) : t;
+    }
+
+    inline uint16_t MeshTriangle::materialId() const {
+        return mesh->materialIds[primitiveId];
+    }
+
+    inline Light *MeshTriangle::light() const {
+        return mesh->lightOf(primitiveId);
     }
 
     inline Material *MeshTriangle::getMaterial() const {
-        return name_id >= 0 ? mesh->_materials[name_id].get() : nullptr;
+        auto id = materialId();
+        return id < mesh->_materials.size() ? mesh->_materials[id].get() : nullptr;
     }
 } // namespace miyuki::core
 
@@ -53,6 +53,8 @@ namespace miyuki::core {
 
     class Material;
 
+    class Light;
+
     struct MeshTriangle;
 
     template<class Value>
@@ -62,6 +64,8 @@ namespace miyuki::core {
         static const int N = LengthOf<Value>;
         TArray<const MeshTriangle *, N> shape = nullptr;
         TArray<const Material *, N> material = nullptr;
+        // the area light of an emissive hit, filled in by Scene
+        TArray<Light *, N> light = nullptr;
         Value distance = MaxFloat;
         Vector3 wo;
         Vector3 p;
@@ -100,5 +104,51 @@ namespace miyuki::core {
     using Intersection4 = TIntersection<float4>;
     using Intersection8 = TIntersection<float8>;
 
+    inline Ray GetLane(const Ray8 &ray, int i) {
+        return Ray(Vec3f(ray.o[0][i], ray.o[1][i], ray.o[2][i]),
+                   Vec3f(ray.d[0][i], ray.d[1][i], ray.d[2][i]), ray.tMin[i], ray.tMax[i]);
+    }
+
+    inline void SetLane(Ray8 &ray, int i, const Ray &r) {
+        for (int c = 0; c < 3; c++) {
+            ray.o[c][i] = r.o[c];
+            ray.d[c][i] = r.d[c];
+        }
+        ray.tMin[i] = r.tMin;
+        ray.tMax[i] = r.tMax;
+    }
+
+    // the local frame is not part of a packet, call computeLocalFrame() on the result
+    inline Intersection GetLane(const Intersection8 &isct, int i) {
+        Intersection r;
+        r.shape = isct.shape[i];
+        r.material = isct.material[i];
+        r.light = isct.light[i];
+        r.distance = isct.distance[i];
+        for (int c = 0; c < 3; c++) {
+            r.wo[c] = isct.wo[c][i];
+            r.p[c] = isct.p[c][i];
+            r.Ns[c] = isct.Ns[c][i];
+            r.Ng[c] = isct.Ng[c][i];
+        }
+        r.uv = Vec2f(isct.uv[0][i], isct.uv[1][i]);
+        return r;
+    }
+
+    inline void SetLane(Intersection8 &isct, int i, const Intersection &r) {
+        isct.shape[i] = r.shape;
+        isct.material[i] = r.material;
+        isct.light[i] = r.light;
+        isct.distance[i] = r.distance;
+        for (int c = 0; c < 3; c++) {
+            isct.wo[c][i] = r.wo[c];
+            isct.p[c][i] = r.p[c];
+            isct.Ns[c][i] = r.Ns[c];
+            isct.Ng[c][i] = r.Ng[c];
+        }
+        isct.uv[0][i] = r.uv[0];
+        isct.uv[1][i] = r.uv[1];
+    }
+
 }
 #endif //MIYUKIRENDERER_RAY_H
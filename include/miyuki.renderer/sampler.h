@@ -39,7 +39,8 @@ namespace miyuki::core {
             return Point2f(next1D(), next1D());
         }
 
-        virtual void startSample(int) = 0;
+        // the next startNextSample() begins sample s of the current pixel, call after startPixel()
+        virtual void startSample(int s) = 0;
 
         virtual void startNextSample() = 0;
 
@@ -35,9 +35,19 @@
 namespace miyuki::core {
     class EmbreeAccelerator;
 
+    class SnapshotReader;
+
     class Scene {
         std::shared_ptr<Accelerator> accelerator;
         std::atomic<size_t> rayCounter = 0;
+        size_t nPreprocessedMeshes = 0;
+
+        void preprocessMesh(Mesh &mesh);
+
+        // picks the default accelerator if none was set, then preprocesses all meshes
+        void preprocessMeshes();
+
+        void clearDirtyFlags();
 
     public:
         std::shared_ptr<Shader> background;
@@ -49,8 +59,27 @@ namespace miyuki::core {
 
         bool occlude(const Ray & ray);
 
+        // Batched intersect(), in the order given; check isct[i].hit() for the result
+        void intersect(const Ray *rays, Intersection *isct, size_t n);
+
+        // Traces a packet through the accelerator's packet path, isct holds 8 results
+        void intersect8(const Ray8 &ray, Intersection *isct);
+
+        // Batched occlude()
+        void occlude(const Ray *rays, uint8_t *occluded, size_t n);
+
+        // Uses the given accelerator instead of the default one picked by preprocess()
+        void setAccelerator(const std::shared_ptr<Accelerator> &accel) { accelerator = accel; }
+
         void preprocess();
 
+        // preprocess() with the accelerator restored from a snapshot, if it was saved there
+        void preprocess(SnapshotReader &snapshot);
+
+        // Incremental counterpart of preprocess(): picks up appended meshes, re-preprocesses meshes
+        // whose triangles were replaced and refits meshes marked dirty instead of rebuilding every BVH
+        void update();
+
         [[nodiscard]] size_t getRayCounter() const { return rayCounter; }
 
         void resetRayCounter() { rayCounter = 0; }
@@ -58,6 +87,8 @@ namespace miyuki::core {
         Bounds3f getBoundingBox()const{
             return accelerator->getBoundingBox();
         }
+
+        [[nodiscard]] const std::shared_ptr<Accelerator> &getAccelerator() const { return accelerator; }
     };
 } // namespace miyuki::core
 #endif // MIYUKIRENDERER_SCENE_H
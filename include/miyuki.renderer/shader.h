@@ -39,6 +39,12 @@ namespace miyuki::core {
 
         virtual Spectrum evaluate(const ShadingPoint &) const = 0;
 
+        virtual void evaluate8(const ShadingPoint *sp, Spectrum *out) const {
+            for (int i = 0; i < 8; i++) {
+                out[i] = evaluate(sp[i]);
+            }
+        }
+
         virtual void preprocess() {}
     };
 
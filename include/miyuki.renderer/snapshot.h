@@ -0,0 +1,171 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_SNAPSHOT_H
+#define MIYUKIRENDERER_SNAPSHOT_H
+
+#include <miyuki.foundation/defs.h>
+#include <miyuki.foundation/math.hpp>
+#include <fmt/format.h>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace miyuki::core {
+    class Scene;
+
+    class SceneGraph;
+
+    // Arrays are aligned to this in snapshot files
+    constexpr size_t SnapshotAlignment = 64;
+
+    // Sequential writer of a snapshot file: plain values, strings and arrays of trivially copyable types
+    class SnapshotWriter {
+        std::ofstream out;
+        size_t offset = 0;
+
+        void pad() {
+            static const char zeros[SnapshotAlignment] = {};
+            auto n = (SnapshotAlignment - offset % SnapshotAlignment) % SnapshotAlignment;
+            out.write(zeros, n);
+            offset += n;
+        }
+
+    public:
+        explicit SnapshotWriter(const std::string &filename) : out(filename, std::ios::binary) {
+            if (!out) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Cannot write {}", filename));
+            }
+        }
+
+        void writeBytes(const void *data, size_t size) {
+            out.write(static_cast<const char *>(data), size);
+            offset += size;
+        }
+
+        template<class T>
+        void write(const T &v) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            writeBytes(&v, sizeof(T));
+        }
+
+        void write(const std::string &s) {
+            write<uint64_t>(s.size());
+            writeBytes(s.data(), s.size());
+        }
+
+        template<class T>
+        void writeArray(const T *data, size_t count) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write<uint64_t>(count);
+            pad();
+            writeBytes(data, count * sizeof(T));
+        }
+
+        template<class T>
+        void write(const std::vector<T> &v) {
+            writeArray(v.data(), v.size());
+        }
+
+        [[nodiscard]] bool good() const { return out.good(); }
+    };
+
+    // Reads what SnapshotWriter wrote out of a mapped file
+    class SnapshotReader {
+        const char *begin, *ptr, *end;
+
+        const char *take(size_t size) {
+            if (size_t(end - ptr) < size) {
+                MIYUKI_THROW(std::runtime_error, "Truncated snapshot");
+            }
+            auto p = ptr;
+            ptr += size;
+            return p;
+        }
+
+        void skipPadding() {
+            auto offset = size_t(ptr - begin);
+            take((SnapshotAlignment - offset % SnapshotAlignment) % SnapshotAlignment);
+        }
+
+    public:
+        SnapshotReader(const void *data, size_t size)
+                : begin(static_cast<const char *>(data)), ptr(begin), end(begin + size) {}
+
+        template<class T>
+        void read(T &v) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            std::memcpy(&v, take(sizeof(T)), sizeof(T));
+        }
+
+        template<class T>
+        T read() {
+            T v;
+            read(v);
+            return v;
+        }
+
+        void read(std::string &s) {
+            auto size = read<uint64_t>();
+            auto p = take(size);
+            s.assign(p, size);
+        }
+
+        // points into the mapped file, no copy
+        template<class T>
+        const T *view(size_t &count) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            count = read<uint64_t>();
+            skipPadding();
+            if (count > size_t(end - ptr) / sizeof(T)) {
+                MIYUKI_THROW(std::runtime_error, "Truncated snapshot");
+            }
+            return reinterpret_cast<const T *>(take(count * sizeof(T)));
+        }
+
+        template<class T>
+        void read(std::vector<T> &v) {
+            size_t count;
+            auto p = view<T>(count);
+            v.resize(count);
+            std::memcpy(v.data(), p, count * sizeof(T));
+        }
+    };
+
+    // What a built Scene depends on: the working directory, the shapes and accelerator of the scene
+    // description and the size and modification time of every file they name
+    std::string SceneKey(const json &description);
+
+    // Writes a scene built from description by SceneGraph::buildScene(): the description, mesh
+    // buffers, decoded textures and, if the accelerator supports it, its nodes
+    void WriteSceneSnapshot(const std::string &filename, const json &description, const Scene &scene);
+
+    // Builds the scene of graph, deserialized from description, out of a snapshot instead of loading
+    // the meshes and textures and building the accelerator. nullptr if the file is missing, or was
+    // written for other shapes or files that changed since.
+    std::shared_ptr<Scene> LoadSceneSnapshot(const std::string &filename, const json &description, SceneGraph &graph);
+
+    // the scene description stored in a snapshot
+    json ReadSnapshotDescription(const std::string &filename);
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_SNAPSHOT_H
@@ -37,9 +37,46 @@ namespace miyuki::core {
 #ifdef MYK_USE_EMBREE
 
     class EmbreeAccelerator::Impl {
+        // what each attached geometry was built from, geomID == mesh index
+        struct GeometryRecord {
+            const Mesh *mesh = nullptr;
+            const void *vertices = nullptr;
+            const void *indices = nullptr;
+            size_t nVertices = 0;
+            size_t nTriangles = 0;
+        };
         RTCDevice device;
         RTCScene rtcScene = nullptr;
         const Scene *scene;
+        std::vector<GeometryRecord> records;
+
+        static GeometryRecord makeRecord(const Mesh &mesh) {
+            GeometryRecord record;
+            record.mesh = &mesh;
+            record.vertices = mesh._vertex_data.position.data();
+            record.indices = mesh.indices.data();
+            record.nVertices = mesh._vertex_data.position.size();
+            record.nTriangles = mesh.indices.size();
+            return record;
+        }
+
+        void setVertexBuffer(RTCGeometry geometry, const Mesh &mesh) {
+            rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0,
+                                       RTC_FORMAT_FLOAT3,
+                                       &mesh._vertex_data.position[0][0], 0,
+                                       sizeof(mesh._vertex_data.position[0]),
+                                       mesh._vertex_data.position.size());
+        }
+
+        void attachGeometry(const Mesh &mesh, unsigned int geomID) {
+            auto geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
+            setVertexBuffer(geometry, mesh);
+            rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, mesh.indices.data(), 0,
+                                       sizeof(Point3i), mesh.indices.size());
+            rtcCommitGeometry(geometry);
+            rtcAttachGeometryByID(rtcScene, geometry, geomID);
+            rtcReleaseGeometry(geometry);
+        }
 
     public:
         Impl() {
@@ -60,18 +97,48 @@ namespace miyuki::core {
             }
             this->scene = &scene;
             rtcScene = rtcNewScene(device);
-            for (const auto &mesh : scene.meshes) {
-                auto geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
-                rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0,
-                                           RTC_FORMAT_FLOAT3,
-                                           &mesh->_vertex_data.position[0][0], 0,
-                                           sizeof(mesh->_vertex_data.position[0]),
-                                           mesh->_vertex_data.position.size());
-                rtcSetSharedGeometryBuffer(geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, &mesh->triangles[0], 0,
-                                           sizeof(MeshTriangle), mesh->triangles.size());
-                rtcCommitGeometry(geometry);
-                rtcAttachGeometry(rtcScene, geometry);
-                rtcReleaseGeometry(geometry);
+            records.clear();
+            for (size_t i = 0; i < scene.meshes.size(); i++) {
+                attachGeometry(*scene.meshes[i], i);
+                records.emplace_back(makeRecord(*scene.meshes[i]));
+            }
+            rtcCommitScene(rtcScene);
+        }
+
+        void update(const Scene &scene) {
+            if (rtcScene == nullptr) {
+                build(scene);
+                return;
+            }
+            this->scene = &scene;
+            // favors fast rebuilds from now on since the scene is being animated
+            rtcSetSceneFlags(rtcScene, RTC_SCENE_FLAG_DYNAMIC);
+            for (size_t i = 0; i < scene.meshes.size(); i++) {
+                const auto &mesh = *scene.meshes[i];
+                auto record = makeRecord(mesh);
+                if (i >= records.size()) {
+                    attachGeometry(mesh, i);
+                    records.emplace_back(record);
+                } else if (records[i].mesh != record.mesh || records[i].indices != record.indices ||
+                           records[i].nTriangles != record.nTriangles || mesh._topologyChanged) {
+                    rtcDetachGeometry(rtcScene, i);
+                    attachGeometry(mesh, i);
+                    records[i] = record;
+                } else if (mesh._dirty) {
+                    auto geometry = rtcGetGeometry(rtcScene, i);
+                    rtcSetGeometryBuildQuality(geometry, RTC_BUILD_QUALITY_REFIT);
+                    if (records[i].vertices != record.vertices || records[i].nVertices != record.nVertices) {
+                        setVertexBuffer(geometry, mesh);
+                    } else {
+                        rtcUpdateGeometryBuffer(geometry, RTC_BUFFER_TYPE_VERTEX, 0);
+                    }
+                    rtcCommitGeometry(geometry);
+                    records[i] = record;
+                }
+            }
+            while (records.size() > scene.meshes.size()) {
+                rtcDetachGeometry(rtcScene, records.size() - 1);
+                records.pop_back();
             }
             rtcCommitScene(rtcScene);
         }
@@ -111,6 +178,70 @@ namespace miyuki::core {
             return true;
         }
 
+        void intersectStream(const Ray *rays, Intersection *isct, size_t n) {
+            thread_local std::vector<RTCRayHit> rayHits;
+            rayHits.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                rayHits[i].ray = toRTCRay(rays[i]);
+                rayHits[i].hit.geomID = RTC_INVALID_GEOMETRY_ID;
+                rayHits[i].hit.primID = RTC_INVALID_GEOMETRY_ID;
+                rayHits[i].hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+            }
+            RTCIntersectContext context;
+            rtcInitIntersectContext(&context);
+            context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+            rtcIntersect1M(rtcScene, &context, rayHits.data(), n, sizeof(RTCRayHit));
+            for (size_t i = 0; i < n; i++) {
+                auto &rayHit = rayHits[i];
+                if (rayHit.hit.geomID == RTC_INVALID_GEOMETRY_ID || rayHit.hit.primID == RTC_INVALID_GEOMETRY_ID)
+                    continue;
+                isct[i].shape = &scene->meshes[rayHit.hit.geomID]->triangles[rayHit.hit.primID];
+                isct[i].Ng = normalize(Vec3f(rayHit.hit.Ng_x, rayHit.hit.Ng_y, rayHit.hit.Ng_z));
+                isct[i].uv = Point2f(rayHit.hit.u, rayHit.hit.v);
+                isct[i].distance = rayHit.ray.tfar;
+                isct[i].p = rays[i].o + isct[i].distance * rays[i].d;
+            }
+        }
+
+        bool8 intersect8(const Ray8 &ray, Intersection8 &isct) {
+            alignas(32) int valid[8];
+            alignas(32) RTCRayHit8 rayHit{};
+            for (int i = 0; i < 8; i++) {
+                valid[i] = ray.tMin[i] <= ray.tMax[i] ? -1 : 0;
+                rayHit.ray.org_x[i] = ray.o[0][i];
+                rayHit.ray.org_y[i] = ray.o[1][i];
+                rayHit.ray.org_z[i] = ray.o[2][i];
+                rayHit.ray.dir_x[i] = ray.d[0][i];
+                rayHit.ray.dir_y[i] = ray.d[1][i];
+                rayHit.ray.dir_z[i] = ray.d[2][i];
+                rayHit.ray.tnear[i] = ray.tMin[i];
+                rayHit.ray.tfar[i] = ray.tMax[i];
+                rayHit.ray.mask[i] = -1;
+                rayHit.ray.flags[i] = 0;
+                rayHit.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+                rayHit.hit.primID[i] = RTC_INVALID_GEOMETRY_ID;
+            }
+            RTCIntersectContext context;
+            rtcInitIntersectContext(&context);
+            context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+            rtcIntersect8(valid, rtcScene, &context, &rayHit);
+            bool8 hit;
+            for (int i = 0; i < 8; i++) {
+                hit[i] = rayHit.hit.geomID[i] != RTC_INVALID_GEOMETRY_ID &&
+                         rayHit.hit.primID[i] != RTC_INVALID_GEOMETRY_ID;
+                Intersection lane;
+                if (hit[i]) {
+                    lane.shape = &scene->meshes[rayHit.hit.geomID[i]]->triangles[rayHit.hit.primID[i]];
+                    lane.Ng = normalize(Vec3f(rayHit.hit.Ng_x[i], rayHit.hit.Ng_y[i], rayHit.hit.Ng_z[i]));
+                    lane.uv = Point2f(rayHit.hit.u[i], rayHit.hit.v[i]);
+                    lane.distance = rayHit.ray.tfar[i];
+                    lane.p = GetLane(ray, i).o + lane.distance * GetLane(ray, i).d;
+                }
+                SetLane(isct, i, lane);
+            }
+            return hit;
+        }
+
         bool occlude(const Ray &ray) {
             RTCRay rtcRay = toRTCRay(ray);
             RTCIntersectContext context;
@@ -119,6 +250,20 @@ namespace miyuki::core {
             return rtcRay.tfar < 0;
         }
 
+        void occludeStream(const Ray *rays, uint8_t *occluded, size_t n) {
+            thread_local std::vector<RTCRay> rtcRays;
+            rtcRays.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                rtcRays[i] = toRTCRay(rays[i]);
+            }
+            RTCIntersectContext context;
+            rtcInitIntersectContext(&context);
+            rtcOccluded1M(rtcScene, &context, rtcRays.data(), n, sizeof(RTCRay));
+            for (size_t i = 0; i < n; i++) {
+                occluded[i] = rtcRays[i].tfar < 0;
+            }
+        }
+
         [[nodiscard]] Bounds3f getBoundingBox() const {
             RTCBounds bounds{};
             rtcGetSceneBounds(rtcScene, &bounds);
@@ -139,12 +284,26 @@ namespace miyuki::core {
 
     void EmbreeAccelerator::build(Scene &scene) { impl->build(scene); }
 
+    void EmbreeAccelerator::update(Scene &scene) { impl->update(scene); }
+
     bool EmbreeAccelerator::intersect(const Ray &ray, Intersection &isct) { return impl->intersect(ray, isct); }
 
     bool EmbreeAccelerator::occlude(const Ray &ray) {
         return impl->occlude(ray);
     }
 
+    void EmbreeAccelerator::intersectStream(const Ray *rays, Intersection *isct, size_t n) {
+        impl->intersectStream(rays, isct, n);
+    }
+
+    void EmbreeAccelerator::occludeStream(const Ray *rays, uint8_t *occluded, size_t n) {
+        impl->occludeStream(rays, occluded, n);
+    }
+
+    bool8 EmbreeAccelerator::intersect8(const Ray8 &ray, Intersection8 &isct) {
+        return impl->intersect8(ray, isct);
+    }
+
     EmbreeAccelerator::~EmbreeAccelerator() { delete impl; }
 
     Bounds3f EmbreeAccelerator::getBoundingBox() const {
@@ -155,14 +314,24 @@ namespace miyuki::core {
 #else
     EmbreeAccelerator::EmbreeAccelerator(){}
     EmbreeAccelerator::~EmbreeAccelerator() {}
-    bool EmbreeAccelerator::occlude(const Ray &ray) {
+    bool EmbreeAccelerator::occlude(const Ray &/*ray*/) {
+        MIYUKI_NOT_IMPLEMENTED();
+    }
+    void miyuki::core::EmbreeAccelerator::build(miyuki::core::Scene &/*scene*/) { MIYUKI_NOT_IMPLEMENTED(); }
+    void EmbreeAccelerator::update(Scene &/*scene*/) { MIYUKI_NOT_IMPLEMENTED(); }
+    void EmbreeAccelerator::intersectStream(const Ray */*rays*/, Intersection */*isct*/, size_t /*n*/) {
+        MIYUKI_NOT_IMPLEMENTED();
+    }
+    void EmbreeAccelerator::occludeStream(const Ray */*rays*/, uint8_t */*occluded*/, size_t /*n*/) {
+        MIYUKI_NOT_IMPLEMENTED();
+    }
+    bool8 EmbreeAccelerator::intersect8(const Ray8 &/*ray*/, Intersection8 &/*isct*/) {
         MIYUKI_NOT_IMPLEMENTED();
     }
-    void miyuki::core::EmbreeAccelerator::build(miyuki::core::Scene &scene) { MIYUKI_NOT_IMPLEMENTED(); }
     Bounds3f EmbreeAccelerator::getBoundingBox() const {
         MIYUKI_NOT_IMPLEMENTED();
     }
-    bool miyuki::core::EmbreeAccelerator::intersect(const miyuki::core::Ray &ray, miyuki::core::Intersection &isct) {
+    bool miyuki::core::EmbreeAccelerator::intersect(const miyuki::core::Ray &/*ray*/, miyuki::core::Intersection &/*isct*/) {
         MIYUKI_NOT_IMPLEMENTED();
         return false;
     }
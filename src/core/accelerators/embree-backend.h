@@ -41,13 +41,19 @@ namespace miyuki::core {
 
         void build(Scene &scene) override;
 
+        void update(Scene &scene) override;
+
         bool intersect(const Ray &ray, Intersection &isct) override;
 
         bool occlude(const Ray &ray) override;
 
+        void intersectStream(const Ray *rays, Intersection *isct, size_t n) override;
+
+        void occludeStream(const Ray *rays, uint8_t *occluded, size_t n) override;
+
         bool4 intersect4(const Ray4 &ray, Intersection4 &isct) override { MIYUKI_NOT_IMPLEMENTED(); }
 
-        bool8 intersect8(const Ray8 &ray, Intersection8 &isct) override { MIYUKI_NOT_IMPLEMENTED(); }
+        bool8 intersect8(const Ray8 &ray, Intersection8 &isct) override;
 
         Bounds3f getBoundingBox() const;
 
@@ -21,9 +21,16 @@
 // SOFTWARE.
 
 #include "sahbvh.h"
+#include <miyuki.foundation/algorithm.hpp>
 #include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/parallel.h>
+#include <miyuki.foundation/profiler.h>
 #include <miyuki.renderer/mesh.h>
 #include <miyuki.renderer/scene.h>
+#include <miyuki.renderer/snapshot.h>
+#include <miyuki.foundation/rng.h>
+#include <atomic>
+#include <cstring>
 #include <vector>
 
 namespace miyuki::core {
@@ -37,10 +44,91 @@ namespace miyuki::core {
             [[nodiscard]] bool isLeaf() const { return left < 0 && right < 0; }
         };
 
+        // Both children of a binary node, their boxes quantized against the node's own box.
+        // Leaf children store first << 4 | (count - 1), inner children the node index.
+        template<class T>
+        struct QuantizedNode {
+            float origin[3];
+            int8_t exponent[3];
+            uint8_t leafMask;
+            T qMin[2][3];
+            T qMax[2][3];
+            uint32_t child[2];
+        };
+
+        static constexpr uint32_t invalidChild = -1;
+        static constexpr uint32_t maxLeafSize = 16;
+
+        // a node of the float tree, or a run of primitives from an oversized leaf, while quantizing
+        struct ChildRef {
+            Bounds3f box;
+            int node = -1;
+            uint32_t first = 0, count = 0;
+            bool leaf = false;
+            bool valid = false;
+        };
+
+        // Linear BVH as emitted by the parallel builder: inner nodes are [0, n - 1),
+        // the leaf for sorted primitive i is n - 1 + i
+        struct LBVHNode {
+            Bounds3f box;
+            int parent = -1;
+            int child[2] = {-1, -1};
+            uint32_t nLeaves = 1;
+            // SAH cost of the subtree, used by treelet restructuring
+            Float cost = 0;
+        };
+
+        static constexpr int treeletSize = 7;
+
+        // a triangle, or the part of it that falls on one side of a spatial split
+        struct Reference {
+            Bounds3f box;
+            uint32_t index;
+        };
+
+        struct Split {
+            Float cost = MaxFloat;
+            int axis = -1;
+            // object splits: last bucket on the left; spatial splits: split plane
+            int bucket = -1;
+            Float position = 0;
+            Bounds3f left, right;
+            size_t nLeft = 0, nRight = 0;
+        };
+
+        // subtrees below this depth are refit as independent parallel jobs
+        static constexpr int refitSubtreeDepth = 6;
+        static constexpr size_t parallelRefitThreshold = 16384;
+        static constexpr Float traversalCost = 0.125f;
+        static constexpr size_t nBuckets = 12;
+        static constexpr size_t nSpatialBins = 16;
+
         std::vector<MeshTriangle> primitive;
         std::vector<BVHNode> nodes;
+        std::vector<QuantizedNode<uint8_t>> nodes8;
+        std::vector<QuantizedNode<uint16_t>> nodes16;
+        Layout layout = Layout::Float;
 
         Bounds3f boundBox;
+        const Mesh *mesh = nullptr;
+        size_t nTriangles = 0;
+
+        // spatial split build state
+        const std::vector<MeshTriangle> *source = nullptr;
+        Float rootArea = 0;
+        Float minOverlap = 0;
+        size_t nReferences = 0;
+        size_t maxReferences = 0;
+
+        static Bounds3f emptyBox() {
+            return Bounds3f{{MaxFloat, MaxFloat, MaxFloat},
+                            {MinFloat, MinFloat, MinFloat}};
+        }
+
+        static Float area(const Bounds3f &box) {
+            return box.isEmpty() ? 0.0f : box.surfaceArea();
+        }
 
         static Float intersectAABB(const Bounds3f &box, const Ray &ray,
                                    const Vec3f &invd) {
@@ -48,7 +136,8 @@ namespace miyuki::core {
             Vec3f t1 = (box.pMax - ray.o) * invd;
             Vec3f tMin = min(t0, t1), tMax = max(t0, t1);
             if (maxComp(tMin) <= minComp(tMax)) {
-                auto t = std::max(ray.tMin + RayBias, maxComp(tMin));
+                // clamped to tMin itself, a larger value would cull boxes holding hits closer than it
+                auto t = std::max(ray.tMin, maxComp(tMin));
                 if (t >= ray.tMax + RayBias) {
                     return -1;
                 }
@@ -123,17 +212,17 @@ namespace miyuki::core {
                                 buckets[b].bound.unionOf(primitive[i].getBoundingBox());
                     }
                     Float cost[nBuckets - 1] = {0};
-                    for (int i = 0; i < nBuckets - 1; i++) {
+                    for (size_t i = 0; i < nBuckets - 1; i++) {
                         Bounds3f b0{{MaxFloat, MaxFloat, MaxFloat},
                                     {MinFloat, MinFloat, MinFloat}};
                         Bounds3f b1{{MaxFloat, MaxFloat, MaxFloat},
                                     {MinFloat, MinFloat, MinFloat}};
                         int count0 = 0, count1 = 0;
-                        for (int j = 0; j <= i; j++) {
+                        for (size_t j = 0; j <= i; j++) {
                             b0 = b0.unionOf(buckets[j].bound);
                             count0 += buckets[j].count;
                         }
-                        for (int j = i + 1; j < nBuckets; j++) {
+                        for (size_t j = i + 1; j < nBuckets; j++) {
                             b1 = b1.unionOf(buckets[j].bound);
                             count1 += buckets[j].count;
                         }
@@ -143,7 +232,7 @@ namespace miyuki::core {
                     }
                     int splitBuckets = 0;
                     Float minCost = cost[0];
-                    for (int i = 1; i < nBuckets - 1; i++) {
+                    for (size_t i = 1; i < nBuckets - 1; i++) {
                         if (cost[i] <= minCost) {
                             minCost = cost[i];
                             splitBuckets = i;
@@ -170,7 +259,6 @@ namespace miyuki::core {
                 BVHNode &node = nodes.back();
                 node.box = box;
                 node.count = -1;
-                nodes.push_back(node);
                 nodes[ret].left =
                         recursiveBuild(begin, mid - &primitive[0], depth + 1);
                 nodes[ret].right =
@@ -180,19 +268,833 @@ namespace miyuki::core {
             }
         }
 
+        // bounds of the part of the triangle between lo and hi along axis, clamped to the reference box
+        Bounds3f clipTriangle(const MeshTriangle &triangle, int axis, Float lo, Float hi,
+                              const Bounds3f &refBox) const {
+            Bounds3f box = emptyBox();
+            for (int i = 0; i < 3; i++) {
+                Vec3f a = triangle.vertex(i);
+                Vec3f b = triangle.vertex((i + 1) % 3);
+                Float ta = a[axis], tb = b[axis];
+                if (ta >= lo && ta <= hi) {
+                    box = box.unionOf(a);
+                }
+                for (auto plane : {lo, hi}) {
+                    if ((ta < plane && tb > plane) || (ta > plane && tb < plane)) {
+                        Float t = (plane - ta) / (tb - ta);
+                        Vec3f p = a + (b - a) * t;
+                        p[axis] = plane;
+                        box = box.unionOf(p);
+                    }
+                }
+            }
+            return box.intersectionOf(refBox);
+        }
+
+        Split findObjectSplit(const std::vector<Reference> &refs, const Bounds3f &box,
+                              const Bounds3f &centroidBound) const {
+            Split best;
+            for (int axis = 0; axis < 3; axis++) {
+                if (centroidBound.size()[axis] <= 0)
+                    continue;
+                Bounds3f bucketBox[nBuckets];
+                size_t bucketCount[nBuckets] = {0};
+                for (auto &b : bucketBox) {
+                    b = emptyBox();
+                }
+                for (auto &ref : refs) {
+                    auto b = objectBucket(centroidBound, ref.box.centroid(), axis);
+                    bucketCount[b]++;
+                    bucketBox[b] = bucketBox[b].unionOf(ref.box);
+                }
+                Bounds3f rightBox[nBuckets];
+                size_t rightCount[nBuckets] = {0};
+                Bounds3f acc = emptyBox();
+                size_t count = 0;
+                for (int i = nBuckets - 1; i > 0; i--) {
+                    acc = acc.unionOf(bucketBox[i]);
+                    count += bucketCount[i];
+                    rightBox[i] = acc;
+                    rightCount[i] = count;
+                }
+                acc = emptyBox();
+                count = 0;
+                for (size_t i = 0; i < nBuckets - 1; i++) {
+                    acc = acc.unionOf(bucketBox[i]);
+                    count += bucketCount[i];
+                    if (count == 0 || rightCount[i + 1] == 0)
+                        continue;
+                    Float cost = traversalCost + (count * area(acc) + rightCount[i + 1] * area(rightBox[i + 1])) /
+                                                 box.surfaceArea();
+                    if (cost < best.cost) {
+                        best.cost = cost;
+                        best.axis = axis;
+                        best.bucket = i;
+                        best.left = acc;
+                        best.right = rightBox[i + 1];
+                        best.nLeft = count;
+                        best.nRight = rightCount[i + 1];
+                    }
+                }
+            }
+            return best;
+        }
+
+        static int objectBucket(const Bounds3f &centroidBound, const Vec3f &centroid, int axis) {
+            int b = centroidBound.offset(centroid)[axis] * nBuckets;
+            return std::clamp<int>(b, 0, nBuckets - 1);
+        }
+
+        Split findSpatialSplit(const std::vector<Reference> &refs, const Bounds3f &box) const {
+            Split best;
+            for (int axis = 0; axis < 3; axis++) {
+                Float lower = box.pMin[axis];
+                Float width = box.size()[axis] / nSpatialBins;
+                if (width <= 0)
+                    continue;
+                Bounds3f binBox[nSpatialBins];
+                size_t enter[nSpatialBins] = {0}, exit[nSpatialBins] = {0};
+                for (auto &b : binBox) {
+                    b = emptyBox();
+                }
+                auto binOf = [=](Float x) {
+                    return std::clamp<int>((x - lower) / width, 0, nSpatialBins - 1);
+                };
+                for (auto &ref : refs) {
+                    int first = binOf(ref.box.pMin[axis]);
+                    int last = binOf(ref.box.pMax[axis]);
+                    if (first == last) {
+                        binBox[first] = binBox[first].unionOf(ref.box);
+                    } else {
+                        for (int b = first; b <= last; b++) {
+                            auto piece = clipTriangle((*source)[ref.index], axis, lower + b * width,
+                                                      lower + (b + 1) * width, ref.box);
+                            if (!piece.isEmpty())
+                                binBox[b] = binBox[b].unionOf(piece);
+                        }
+                    }
+                    enter[first]++;
+                    exit[last]++;
+                }
+                Bounds3f rightBox[nSpatialBins];
+                size_t rightCount[nSpatialBins] = {0};
+                Bounds3f acc = emptyBox();
+                size_t count = 0;
+                for (int i = nSpatialBins - 1; i > 0; i--) {
+                    acc = acc.unionOf(binBox[i]);
+                    count += exit[i];
+                    rightBox[i] = acc;
+                    rightCount[i] = count;
+                }
+                acc = emptyBox();
+                count = 0;
+                for (size_t i = 0; i < nSpatialBins - 1; i++) {
+                    acc = acc.unionOf(binBox[i]);
+                    count += enter[i];
+                    if (count == 0 || rightCount[i + 1] == 0)
+                        continue;
+                    Float cost = traversalCost + (count * area(acc) + rightCount[i + 1] * area(rightBox[i + 1])) /
+                                                 box.surfaceArea();
+                    if (cost < best.cost) {
+                        best.cost = cost;
+                        best.axis = axis;
+                        best.position = lower + (i + 1) * width;
+                        best.left = acc;
+                        best.right = rightBox[i + 1];
+                        best.nLeft = count;
+                        best.nRight = rightCount[i + 1];
+                    }
+                }
+            }
+            return best;
+        }
+
+        void performSpatialSplit(const std::vector<Reference> &refs, const Split &split,
+                                 std::vector<Reference> &left, std::vector<Reference> &right) {
+            auto axis = split.axis;
+            for (auto &ref : refs) {
+                if (ref.box.pMax[axis] <= split.position) {
+                    left.emplace_back(ref);
+                } else if (ref.box.pMin[axis] >= split.position) {
+                    right.emplace_back(ref);
+                } else {
+                    // reference unsplitting: keep the triangle whole on one side when that is cheaper
+                    Float splitCost = area(split.left) * split.nLeft + area(split.right) * split.nRight;
+                    Float leftCost = area(split.left.unionOf(ref.box)) * split.nLeft +
+                                     area(split.right) * (split.nRight - 1);
+                    Float rightCost = area(split.left) * (split.nLeft - 1) +
+                                      area(split.right.unionOf(ref.box)) * split.nRight;
+                    if (nReferences >= maxReferences || leftCost < std::min(splitCost, rightCost)) {
+                        (leftCost <= rightCost ? left : right).emplace_back(ref);
+                        continue;
+                    }
+                    if (rightCost < splitCost) {
+                        right.emplace_back(ref);
+                        continue;
+                    }
+                    auto &triangle = (*source)[ref.index];
+                    auto l = clipTriangle(triangle, axis, MinFloat, split.position, ref.box);
+                    auto r = clipTriangle(triangle, axis, split.position, MaxFloat, ref.box);
+                    if (l.isEmpty()) {
+                        right.emplace_back(ref);
+                    } else if (r.isEmpty()) {
+                        left.emplace_back(ref);
+                    } else {
+                        left.emplace_back(Reference{l, ref.index});
+                        right.emplace_back(Reference{r, ref.index});
+                        nReferences++;
+                    }
+                }
+            }
+        }
+
+        int spatialSplitBuild(std::vector<Reference> &refs, int depth) {
+            if (refs.empty())
+                return -1;
+            Bounds3f box = emptyBox();
+            Bounds3f centroidBound = emptyBox();
+            for (auto &ref : refs) {
+                box = box.unionOf(ref.box);
+                centroidBound = centroidBound.unionOf(ref.box.centroid());
+            }
+            if (refs.size() <= 4 || depth >= 48) {
+                BVHNode node;
+                node.box = box;
+                node.first = primitive.size();
+                node.count = refs.size();
+                for (auto &ref : refs) {
+                    primitive.emplace_back((*source)[ref.index]);
+                }
+                nodes.push_back(node);
+                return nodes.size() - 1;
+            }
+            std::vector<Reference> left, right;
+            auto objectSplit = findObjectSplit(refs, box, centroidBound);
+            Split spatialSplit;
+            if (nReferences < maxReferences &&
+                (objectSplit.axis < 0 || area(objectSplit.left.intersectionOf(objectSplit.right)) > minOverlap)) {
+                spatialSplit = findSpatialSplit(refs, box);
+            }
+            if (spatialSplit.cost < objectSplit.cost) {
+                performSpatialSplit(refs, spatialSplit, left, right);
+            }
+            if (left.empty() || right.empty()) {
+                left.clear();
+                right.clear();
+                if (objectSplit.axis >= 0) {
+                    for (auto &ref : refs) {
+                        auto b = objectBucket(centroidBound, ref.box.centroid(), objectSplit.axis);
+                        (b <= objectSplit.bucket ? left : right).emplace_back(ref);
+                    }
+                } else {
+                    // every centroid coincides
+                    left.assign(refs.begin(), refs.begin() + refs.size() / 2);
+                    right.assign(refs.begin() + refs.size() / 2, refs.end());
+                }
+            }
+            std::vector<Reference>().swap(refs);
+
+            auto ret = nodes.size();
+            nodes.emplace_back();
+            nodes[ret].box = box;
+            nodes[ret].count = -1;
+            nodes[ret].left = spatialSplitBuild(left, depth + 1);
+            nodes[ret].right = spatialSplitBuild(right, depth + 1);
+            return ret;
+        }
+
+        static int commonPrefix(const std::vector<uint64_t> &keys, int64_t i, int64_t j) {
+            if (j < 0 || j >= (int64_t) keys.size())
+                return -1;
+            return CountLeadingZeros(keys[i] ^ keys[j]);
+        }
+
+        // Karras 2012, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees"
+        static void emitHierarchy(const std::vector<uint64_t> &keys, std::vector<LBVHNode> &lnodes, int64_t i) {
+            const int64_t n = keys.size();
+            int d = commonPrefix(keys, i, i + 1) - commonPrefix(keys, i, i - 1) > 0 ? 1 : -1;
+            int deltaMin = commonPrefix(keys, i, i - d);
+            int64_t lMax = 2;
+            while (commonPrefix(keys, i, i + lMax * d) > deltaMin)
+                lMax *= 2;
+            int64_t l = 0;
+            for (auto t = lMax / 2; t >= 1; t /= 2) {
+                if (commonPrefix(keys, i, i + (l + t) * d) > deltaMin)
+                    l += t;
+            }
+            int64_t j = i + l * d;
+            int deltaNode = commonPrefix(keys, i, j);
+            int64_t s = 0;
+            for (int64_t div = 2, t = 0; t != 1; div *= 2) {
+                t = (l + div - 1) / div;
+                if (commonPrefix(keys, i, i + (s + t) * d) > deltaNode)
+                    s += t;
+            }
+            int64_t gamma = i + s * d + std::min(d, 0);
+            auto &node = lnodes[i];
+            node.child[0] = std::min(i, j) == gamma ? n - 1 + gamma : gamma;
+            node.child[1] = std::max(i, j) == gamma + 1 ? n + gamma : gamma + 1;
+            lnodes[node.child[0]].parent = i;
+            lnodes[node.child[1]].parent = i;
+        }
+
+        // Walks from every leaf to the root; the second thread to reach an inner node finishes it,
+        // so each node is visited once and only after both of its children
+        static void bottomUp(std::vector<LBVHNode> &lnodes, const std::function<void(int)> &visit) {
+            const int64_t n = (lnodes.size() + 1) / 2;
+            std::vector<std::atomic<int>> visits(n - 1);
+            for (auto &i : visits) {
+                i = 0;
+            }
+            ParallelFor(0, n, [&](int64_t i, size_t) {
+                int idx = lnodes[n - 1 + i].parent;
+                while (idx >= 0) {
+                    if (visits[idx].fetch_add(1, std::memory_order_acq_rel) == 0)
+                        return;
+                    visit(idx);
+                    idx = lnodes[idx].parent;
+                }
+            }, 1024);
+        }
+
+        static void updateNode(std::vector<LBVHNode> &lnodes, int idx) {
+            auto &node = lnodes[idx];
+            auto &l = lnodes[node.child[0]];
+            auto &r = lnodes[node.child[1]];
+            node.box = l.box.unionOf(r.box);
+            node.nLeaves = l.nLeaves + r.nLeaves;
+            node.cost = traversalCost * area(node.box) + l.cost + r.cost;
+        }
+
+        static int bitIndex(int singleBit) {
+            int i = 0;
+            while (!(singleBit & (1 << i)))
+                i++;
+            return i;
+        }
+
+        // Karras and Aila 2013, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies":
+        // finds the SAH-optimal topology of the treelet of up to seven subtrees below idx
+        static void restructureTreelet(std::vector<LBVHNode> &lnodes, int idx) {
+            if (lnodes[idx].nLeaves < treeletSize)
+                return;
+            int leaves[treeletSize];
+            int inner[treeletSize - 1];
+            int nLeaves = 2, nInner = 1;
+            inner[0] = idx;
+            leaves[0] = lnodes[idx].child[0];
+            leaves[1] = lnodes[idx].child[1];
+            while (nLeaves < treeletSize) {
+                int best = -1;
+                Float bestArea = -1;
+                for (int i = 0; i < nLeaves; i++) {
+                    auto &node = lnodes[leaves[i]];
+                    if (node.nLeaves > 1 && area(node.box) > bestArea) {
+                        best = i;
+                        bestArea = area(node.box);
+                    }
+                }
+                if (best < 0)
+                    return;
+                auto expanded = leaves[best];
+                inner[nInner++] = expanded;
+                leaves[best] = lnodes[expanded].child[0];
+                leaves[nLeaves++] = lnodes[expanded].child[1];
+            }
+            constexpr int nSubsets = 1 << treeletSize;
+            Float cost[nSubsets];
+            int partition[nSubsets] = {0};
+            for (int s = 1; s < nSubsets; s++) {
+                Bounds3f box = emptyBox();
+                for (int i = 0; i < treeletSize; i++) {
+                    if (s & (1 << i))
+                        box = box.unionOf(lnodes[leaves[i]].box);
+                }
+                if ((s & (s - 1)) == 0) {
+                    cost[s] = lnodes[leaves[bitIndex(s)]].cost;
+                    continue;
+                }
+                // subsets are visited in increasing order, so every proper subset is already solved;
+                // only partitions holding the lowest bit are tried since the other half is symmetric
+                Float best = MaxFloat;
+                auto lowest = s & -s;
+                for (int p = (s - 1) & s; p > 0; p = (p - 1) & s) {
+                    if (!(p & lowest))
+                        continue;
+                    auto c = cost[p] + cost[s ^ p];
+                    if (c < best) {
+                        best = c;
+                        partition[s] = p;
+                    }
+                }
+                cost[s] = traversalCost * area(box) + best;
+            }
+            if (cost[nSubsets - 1] >= lnodes[idx].cost)
+                return;
+            int nextInner = 1;
+            std::function<void(int, int)> rebuild = [&](int s, int nodeIdx) {
+                int halves[2] = {partition[s], s ^ partition[s]};
+                for (int c = 0; c < 2; c++) {
+                    int child;
+                    if ((halves[c] & (halves[c] - 1)) == 0) {
+                        child = leaves[bitIndex(halves[c])];
+                    } else {
+                        child = inner[nextInner++];
+                        rebuild(halves[c], child);
+                    }
+                    lnodes[nodeIdx].child[c] = child;
+                    lnodes[child].parent = nodeIdx;
+                }
+                updateNode(lnodes, nodeIdx);
+            };
+            rebuild(nSubsets - 1, idx);
+        }
+
+        void gatherLeaves(const std::vector<LBVHNode> &lnodes, const std::vector<uint64_t> &keys, int idx) {
+            const auto n = keys.size();
+            if (idx >= (int) n - 1) {
+                primitive.emplace_back((*source)[keys[idx - (n - 1)] & 0xffffffffu]);
+                return;
+            }
+            gatherLeaves(lnodes, keys, lnodes[idx].child[0]);
+            gatherLeaves(lnodes, keys, lnodes[idx].child[1]);
+        }
+
+        // converts to the DFS layout used by traversal, collapsing small subtrees into leaves
+        int emitLinear(const std::vector<LBVHNode> &lnodes, const std::vector<uint64_t> &keys, int idx) {
+            auto &lnode = lnodes[idx];
+            if (lnode.nLeaves <= 4) {
+                BVHNode node;
+                node.box = lnode.box;
+                node.first = primitive.size();
+                gatherLeaves(lnodes, keys, idx);
+                node.count = primitive.size() - node.first;
+                nodes.push_back(node);
+                return nodes.size() - 1;
+            }
+            auto ret = nodes.size();
+            nodes.emplace_back();
+            nodes[ret].box = lnode.box;
+            nodes[ret].count = -1;
+            nodes[ret].left = emitLinear(lnodes, keys, lnode.child[0]);
+            nodes[ret].right = emitLinear(lnodes, keys, lnode.child[1]);
+            return ret;
+        }
+
+        void linearBuild(const std::vector<MeshTriangle> &triangles, int treeletPasses) {
+            const int64_t n = triangles.size();
+            source = &triangles;
+            primitive.clear();
+            primitive.reserve(n);
+            constexpr int64_t chunkSize = 4096;
+            const int64_t nChunks = (n + chunkSize - 1) / chunkSize;
+            auto forEach = [&](const std::function<void(int64_t)> &f) {
+                ParallelFor(0, nChunks, [&](int64_t chunk, size_t) {
+                    for (auto i = chunk * chunkSize; i < std::min(n, (chunk + 1) * chunkSize); i++) {
+                        f(i);
+                    }
+                });
+            };
+            std::vector<LBVHNode> lnodes(2 * n - 1);
+            Bounds3f centroidBound = emptyBox();
+            for (int64_t i = 0; i < n; i++) {
+                auto &leaf = lnodes[n - 1 + i];
+                leaf.box = triangles[i].getBoundingBox();
+                centroidBound = centroidBound.unionOf(leaf.box.centroid());
+            }
+            // primitive index in the low half keeps keys unique, as the hierarchy emission requires
+            std::vector<uint64_t> keys(n);
+            forEach([&](int64_t i) {
+                auto p = centroidBound.offset(lnodes[n - 1 + i].box.centroid());
+                uint32_t q[3];
+                for (int a = 0; a < 3; a++) {
+                    auto x = centroidBound.size()[a] > 0 ? p[a] : 0.0f;
+                    q[a] = std::clamp<int>(x * 1024.0f, 0, 1023);
+                }
+                keys[i] = uint64_t(EncodeMorton3(q[0], q[1], q[2])) << 32u | uint64_t(i);
+            });
+            ParallelRadixSort(keys, 32, 62);
+            // leaves follow the sorted order
+            std::vector<Bounds3f> boxes(n);
+            forEach([&](int64_t i) { boxes[i] = lnodes[n - 1 + i].box; });
+            forEach([&](int64_t i) {
+                auto &leaf = lnodes[n - 1 + i];
+                leaf.box = boxes[keys[i] & 0xffffffffu];
+                leaf.cost = area(leaf.box);
+                leaf.parent = -1;
+            });
+            if (n > 1) {
+                forEach([&](int64_t i) {
+                    if (i < n - 1)
+                        emitHierarchy(keys, lnodes, i);
+                });
+                lnodes[0].parent = -1;
+                bottomUp(lnodes, [&](int idx) { updateNode(lnodes, idx); });
+                for (int pass = 0; pass < treeletPasses; pass++) {
+                    bottomUp(lnodes, [&](int idx) {
+                        updateNode(lnodes, idx);
+                        restructureTreelet(lnodes, idx);
+                    });
+                }
+            }
+            boundBox = lnodes[0].box;
+            emitLinear(lnodes, keys, 0);
+            source = nullptr;
+        }
+
+        void logStatistics(const std::string &builder) const {
+            if (nodes.empty())
+                return;
+            Float cost = 0, overlap = 0;
+            auto boxArea = area(nodes[0].box);
+            for (auto &node : nodes) {
+                if (node.isLeaf()) {
+                    cost += area(node.box) / boxArea * node.count;
+                } else {
+                    cost += traversalCost * area(node.box) / boxArea;
+                    if (node.left >= 0 && node.right >= 0) {
+                        overlap += area(nodes[node.left].box.intersectionOf(nodes[node.right].box)) / boxArea;
+                    }
+                }
+            }
+            log::log("BVH ({}) nodes:{} refs:{} SAH cost:{:.3f} overlap:{:.3f}\n", builder, nodes.size(),
+                     primitive.size(), cost, overlap);
+        }
+
+    public:
+        [[nodiscard]] size_t nodeBytes() const {
+            switch (layout) {
+                case Layout::Quantized8:
+                    return nodes8.size() * sizeof(QuantizedNode<uint8_t>);
+                case Layout::Quantized16:
+                    return nodes16.size() * sizeof(QuantizedNode<uint16_t>);
+                default:
+                    return nodes.size() * sizeof(BVHNode);
+            }
+        }
+
+        static float exp2i(int e) {
+            uint32_t bits = uint32_t(e + 127) << 23u;
+            float f;
+            std::memcpy(&f, &bits, sizeof(float));
+            return f;
+        }
+
+        ChildRef rangeRef(uint32_t first, uint32_t count) const {
+            ChildRef ref;
+            ref.box = emptyBox();
+            for (auto i = first; i < first + count; i++) {
+                ref.box = ref.box.unionOf(primitive[i].getBoundingBox());
+            }
+            ref.first = first;
+            ref.count = count;
+            ref.leaf = count <= maxLeafSize;
+            ref.valid = true;
+            return ref;
+        }
+
+        ChildRef childRef(int idx) const {
+            ChildRef ref;
+            if (idx < 0)
+                return ref;
+            auto &node = nodes[idx];
+            if (node.isLeaf()) {
+                ref = rangeRef(node.first, node.count);
+            } else {
+                ref.node = idx;
+                ref.valid = true;
+            }
+            ref.box = node.box;
+            return ref;
+        }
+
+        // entries of traverseQuantized()'s stack, it holds at most depth + 2 of them
+        static constexpr int QuantizedStackSize = 128;
+
+        template<class T>
+        uint32_t emitQuantized(std::vector<QuantizedNode<T>> &out, const ChildRef &parent, int depth) {
+            constexpr auto maxQ = std::numeric_limits<T>::max();
+            if (depth + 2 > QuantizedStackSize) {
+                MIYUKI_THROW(std::runtime_error, "BVH too deep for a quantized layout");
+            }
+            ChildRef children[2];
+            if (parent.leaf) {
+                children[0] = parent;
+            } else if (parent.node >= 0) {
+                children[0] = childRef(nodes[parent.node].left);
+                children[1] = childRef(nodes[parent.node].right);
+            } else {
+                children[0] = rangeRef(parent.first, parent.count / 2);
+                children[1] = rangeRef(parent.first + parent.count / 2, parent.count - parent.count / 2);
+            }
+            QuantizedNode<T> node{};
+            for (int a = 0; a < 3; a++) {
+                Float origin = parent.box.pMin[a];
+                Float extent = parent.box.pMax[a] - origin;
+                int e = extent > 0 ? std::clamp<int>(std::ceil(std::log2(extent / maxQ)), -126, 127) : -126;
+                while (e < 127 && origin + maxQ * exp2i(e) < parent.box.pMax[a])
+                    e++;
+                node.origin[a] = origin;
+                node.exponent[a] = e;
+                auto scale = exp2i(e);
+                for (int c = 0; c < 2; c++) {
+                    if (!children[c].valid)
+                        continue;
+                    // rounded outwards, and nudged so that decoding reproduces a conservative box
+                    auto lo = std::clamp<Float>(std::floor((children[c].box.pMin[a] - origin) / scale), 0, maxQ);
+                    auto hi = std::clamp<Float>(std::ceil((children[c].box.pMax[a] - origin) / scale), 0, maxQ);
+                    while (lo > 0 && origin + lo * scale > children[c].box.pMin[a])
+                        lo--;
+                    while (hi < maxQ && origin + hi * scale < children[c].box.pMax[a])
+                        hi++;
+                    node.qMin[c][a] = lo;
+                    node.qMax[c][a] = hi;
+                }
+            }
+            auto idx = out.size();
+            out.emplace_back();
+            for (int c = 0; c < 2; c++) {
+                if (!children[c].valid) {
+                    node.child[c] = invalidChild;
+                } else if (children[c].leaf) {
+                    if (children[c].first >= (1u << 28u)) {
+                        MIYUKI_THROW(std::runtime_error, "Too many primitives for a quantized BVH");
+                    }
+                    node.leafMask |= 1u << c;
+                    node.child[c] = children[c].first << 4u | (children[c].count - 1);
+                } else {
+                    node.child[c] = emitQuantized(out, children[c], depth + 1);
+                }
+            }
+            out[idx] = node;
+            return idx;
+        }
+
+        template<class T>
+        void quantize(std::vector<QuantizedNode<T>> &out) {
+            out.clear();
+            if (nodes.empty())
+                return;
+            emitQuantized(out, childRef(0), 0);
+            out.shrink_to_fit();
+            std::vector<BVHNode>().swap(nodes);
+        }
+
+        template<bool anyHit, class T>
+        bool traverseQuantized(const std::vector<QuantizedNode<T>> &qnodes, const Ray &ray,
+                               Intersection &isct) const {
+            if (qnodes.empty())
+                return false;
+            auto invd = Vec3f(1) / ray.d;
+            if (intersectAABB(boundBox, ray, invd) < 0)
+                return false;
+            bool hit = false;
+            uint32_t stack[QuantizedStackSize];
+            int sp = 0;
+            stack[sp++] = 0;
+            while (sp > 0) {
+                auto &node = qnodes[stack[--sp]];
+                Vec3f origin(node.origin[0], node.origin[1], node.origin[2]);
+                Vec3f scale(exp2i(node.exponent[0]), exp2i(node.exponent[1]), exp2i(node.exponent[2]));
+                for (int c = 0; c < 2; c++) {
+                    if (node.child[c] == invalidChild)
+                        continue;
+                    Bounds3f box{origin + Vec3f(node.qMin[c][0], node.qMin[c][1], node.qMin[c][2]) * scale,
+                                 origin + Vec3f(node.qMax[c][0], node.qMax[c][1], node.qMax[c][2]) * scale};
+                    auto t = intersectAABB(box, ray, invd);
+                    if (t < 0 || t > isct.distance) {
+                        continue;
+                    }
+                    if (node.leafMask & (1u << c)) {
+                        auto first = node.child[c] >> 4u;
+                        auto count = (node.child[c] & 15u) + 1;
+                        for (auto i = first; i < first + count; i++) {
+                            if (primitive[i].intersect(ray, isct)) {
+                                if constexpr (anyHit) {
+                                    return true;
+                                }
+                                hit = true;
+                            }
+                        }
+                    } else {
+                        stack[sp++] = node.child[c];
+                    }
+                }
+            }
+            return hit;
+        }
+
+    private:
+        // per component, about four times faster than unionOf() on the Array expressions
+        static void Grow(Bounds3f &box, const Point3f &pMin, const Point3f &pMax) {
+            for (int c = 0; c < 3; c++) {
+                box.pMin[c] = std::min(box.pMin[c], pMin[c]);
+                box.pMax[c] = std::max(box.pMax[c], pMax[c]);
+            }
+        }
+
+        Bounds3f refitSubtree(int idx) {
+            auto &node = nodes[idx];
+            Bounds3f box{{MaxFloat, MaxFloat, MaxFloat},
+                         {MinFloat, MinFloat, MinFloat}};
+            if (node.isLeaf()) {
+                for (auto i = node.first; i < node.first + node.count; i++) {
+                    for (int v = 0; v < 3; v++) {
+                        const auto &p = primitive[i].vertex(v);
+                        Grow(box, p, p);
+                    }
+                }
+            } else {
+                if (node.left >= 0) {
+                    auto child = refitSubtree(node.left);
+                    Grow(box, child.pMin, child.pMax);
+                }
+                if (node.right >= 0) {
+                    auto child = refitSubtree(node.right);
+                    Grow(box, child.pMin, child.pMax);
+                }
+            }
+            node.box = box;
+            return box;
+        }
+
+        void collectSubtrees(int idx, int depth, std::vector<int> &roots) const {
+            if (idx < 0)
+                return;
+            auto &node = nodes[idx];
+            if (depth == refitSubtreeDepth || node.isLeaf()) {
+                roots.emplace_back(idx);
+                return;
+            }
+            collectSubtrees(node.left, depth + 1, roots);
+            collectSubtrees(node.right, depth + 1, roots);
+        }
+
+        // recomputes the nodes above the subtree roots, whose boxes are already up to date
+        Bounds3f refitTop(int idx, int depth) {
+            auto &node = nodes[idx];
+            if (depth == refitSubtreeDepth || node.isLeaf()) {
+                return node.box;
+            }
+            Bounds3f box{{MaxFloat, MaxFloat, MaxFloat},
+                         {MinFloat, MinFloat, MinFloat}};
+            if (node.left >= 0)
+                box = box.unionOf(refitTop(node.left, depth + 1));
+            if (node.right >= 0)
+                box = box.unionOf(refitTop(node.right, depth + 1));
+            node.box = box;
+            return box;
+        }
+
     public:
 
-        void build(const std::vector<MeshTriangle> &primitives) {
+        void build(const Mesh &mesh, const BVHAccelerator &settings) {
+            this->mesh = &mesh;
+            nTriangles = mesh.triangles.size();
             nodes.clear();
-            primitive = primitives;
-            recursiveBuild(0, primitive.size(), 0);
-            log::log("BVH nodes:{}\n", nodes.size());
+            if (settings.builder == "sbvh" && !mesh.triangles.empty()) {
+                primitive.clear();
+                source = &mesh.triangles;
+                std::vector<Reference> refs;
+                refs.reserve(mesh.triangles.size());
+                boundBox = emptyBox();
+                for (uint32_t i = 0; i < mesh.triangles.size(); i++) {
+                    refs.emplace_back(Reference{mesh.triangles[i].getBoundingBox(), i});
+                    boundBox = boundBox.unionOf(refs.back().box);
+                }
+                rootArea = area(boundBox);
+                minOverlap = settings.overlapThreshold * rootArea;
+                nReferences = refs.size();
+                maxReferences = refs.size() + size_t(settings.splitBudget * refs.size());
+                spatialSplitBuild(refs, 0);
+                source = nullptr;
+            } else if (settings.builder == "lbvh" && !mesh.triangles.empty()) {
+                linearBuild(mesh.triangles, settings.treeletPasses);
+            } else {
+                primitive = mesh.triangles;
+                recursiveBuild(0, primitive.size(), 0);
+            }
+            logStatistics(settings.builder);
+            layout = settings._layout;
+            nodes8.clear();
+            nodes16.clear();
+            if (layout == Layout::Quantized8) {
+                quantize(nodes8);
+            } else if (layout == Layout::Quantized16) {
+                quantize(nodes16);
+            }
+        }
+
+        // leaves keep primitive ids, the triangles are taken from the mesh again on load
+        void save(SnapshotWriter &out) const {
+            out.write(uint32_t(layout));
+            out.write(boundBox);
+            out.write(uint64_t(nTriangles));
+            out.write(nodes);
+            out.write(nodes8);
+            out.write(nodes16);
+            std::vector<uint32_t> ids(primitive.size());
+            for (size_t i = 0; i < primitive.size(); i++) {
+                ids[i] = primitive[i].primitiveId;
+            }
+            out.write(ids);
+        }
+
+        void load(SnapshotReader &in, const Mesh &mesh) {
+            this->mesh = &mesh;
+            layout = Layout(in.read<uint32_t>());
+            in.read(boundBox);
+            nTriangles = in.read<uint64_t>();
+            if (nTriangles != mesh.triangles.size()) {
+                MIYUKI_THROW(std::runtime_error, "Snapshot BVH is of another mesh");
+            }
+            in.read(nodes);
+            in.read(nodes8);
+            in.read(nodes16);
+            size_t count;
+            auto ids = in.view<uint32_t>(count);
+            primitive.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                if (ids[i] >= mesh.triangles.size()) {
+                    MIYUKI_THROW(std::runtime_error, "Corrupt snapshot BVH");
+                }
+                primitive[i] = mesh.triangles[ids[i]];
+            }
+        }
+
+        [[nodiscard]] bool canRefit() const { return layout == Layout::Float; }
+
+        // Topology is unchanged, so the cached primitives still reference the right vertices;
+        // only node bounds need to be recomputed. Spatial-split leaves fall back to whole triangle bounds.
+        void refit() {
+            if (nodes.empty())
+                return;
+            if (primitive.size() < parallelRefitThreshold) {
+                refitSubtree(0);
+            } else {
+                std::vector<int> roots;
+                collectSubtrees(0, 0, roots);
+                ParallelFor(0, roots.size(), [&](int64_t i, size_t) { refitSubtree(roots[i]); });
+                refitTop(0, 0);
+            }
+            boundBox = nodes[0].box;
+        }
+
+        // spatial splits duplicate references, so compare against the source triangles
+        [[nodiscard]] bool needsRebuild(const Mesh &m) const {
+            return mesh != &m || nTriangles != m.triangles.size() || m._topologyChanged;
         }
 
         bool intersect(const Ray &ray, Intersection &isct) const {
+            if (layout == Layout::Quantized8)
+                return traverseQuantized<false>(nodes8, ray, isct);
+            if (layout == Layout::Quantized16)
+                return traverseQuantized<false>(nodes16, ray, isct);
+            if (nodes.empty())
+                return false;
             bool hit = false;
             auto invd = Vec3f(1) / ray.d;
-            constexpr int maxDepth = 64;
+            constexpr int maxDepth = 128;
             const BVHNode *stack[maxDepth];
             int sp = 0;
             stack[sp++] = &nodes[0];
@@ -204,7 +1106,7 @@ namespace miyuki::core {
                     continue;
                 }
                 if (p->isLeaf()) {
-                    for (int i = p->first; i < p->first + p->count; i++) {
+                    for (uint32_t i = p->first; i < p->first + p->count; i++) {
                         if (primitive[i].intersect(ray, isct)) {
                             hit = true;
                         }
@@ -219,11 +1121,77 @@ namespace miyuki::core {
             return hit;
         }
 
+        // Packet traversal: the tree is walked once for all 8 rays, a node is entered if
+        // any lane hits its box. Compressed layouts trace lane by lane.
+        void intersect8(const Ray *rays, Intersection *hits) const {
+            if (layout != Layout::Float) {
+                for (int l = 0; l < 8; l++) {
+                    intersect(rays[l], hits[l]);
+                }
+                return;
+            }
+            if (nodes.empty())
+                return;
+            alignas(32) float o[3][8], invd[3][8], tMin[8], tMax[8], tHit[8];
+            for (int l = 0; l < 8; l++) {
+                for (int c = 0; c < 3; c++) {
+                    o[c][l] = rays[l].o[c];
+                    invd[c][l] = 1.0f / rays[l].d[c];
+                }
+                tMin[l] = rays[l].tMin;
+                tMax[l] = rays[l].tMax + RayBias;
+            }
+            constexpr int maxDepth = 128;
+            const BVHNode *stack[maxDepth];
+            int sp = 0;
+            stack[sp++] = &nodes[0];
+            while (sp > 0) {
+                auto p = stack[--sp];
+                for (int l = 0; l < 8; l++) {
+                    tHit[l] = hits[l].distance;
+                }
+                uint32_t mask = 0;
+                for (int l = 0; l < 8; l++) {
+                    float near = -MaxFloat, far = MaxFloat;
+                    for (int c = 0; c < 3; c++) {
+                        float t0 = (p->box.pMin[c] - o[c][l]) * invd[c][l];
+                        float t1 = (p->box.pMax[c] - o[c][l]) * invd[c][l];
+                        near = std::max(near, std::min(t0, t1));
+                        far = std::min(far, std::max(t0, t1));
+                    }
+                    float t = std::max(tMin[l], near);
+                    mask |= uint32_t(near <= far && t >= 0 && t < tMax[l] && t <= tHit[l]) << l;
+                }
+                if (!mask) {
+                    continue;
+                }
+                if (p->isLeaf()) {
+                    for (int l = 0; l < 8; l++) {
+                        if (mask & (1u << l)) {
+                            for (uint32_t i = p->first; i < p->first + p->count; i++) {
+                                primitive[i].intersect(rays[l], hits[l]);
+                            }
+                        }
+                    }
+                } else {
+                    if (p->left >= 0)
+                        stack[sp++] = &nodes[p->left];
+                    if (p->right >= 0)
+                        stack[sp++] = &nodes[p->right];
+                }
+            }
+        }
+
         bool occlude(const Ray &ray) {
             Intersection isct;
-            bool hit = false;
+            if (layout == Layout::Quantized8)
+                return traverseQuantized<true>(nodes8, ray, isct);
+            if (layout == Layout::Quantized16)
+                return traverseQuantized<true>(nodes16, ray, isct);
+            if (nodes.empty())
+                return false;
             auto invd = Vec3f(1) / ray.d;
-            constexpr int maxDepth = 64;
+            constexpr int maxDepth = 128;
             const BVHNode *stack[maxDepth];
             int sp = 0;
             stack[sp++] = &nodes[0];
@@ -235,7 +1203,7 @@ namespace miyuki::core {
                     continue;
                 }
                 if (p->isLeaf()) {
-                    for (int i = p->first; i < p->first + p->count; i++) {
+                    for (uint32_t i = p->first; i < p->first + p->count; i++) {
                         if (primitive[i].intersect(ray, isct)) {
                             return true;
                         }
@@ -253,14 +1221,134 @@ namespace miyuki::core {
         [[nodiscard]] Bounds3f getBoundingBox() const { return boundBox; }
     };
 
+    void BVHAccelerator::parseSettings() {
+        if (builder != "sah" && builder != "sbvh" && builder != "lbvh") {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Unknown BVH builder {}", builder));
+        }
+        if (layout == "float") {
+            _layout = Layout::Float;
+        } else if (layout == "quantized8") {
+            _layout = Layout::Quantized8;
+        } else if (layout == "quantized16") {
+            _layout = Layout::Quantized16;
+        } else {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Unknown BVH layout {}", layout));
+        }
+    }
+
     void BVHAccelerator::build(Scene &scene) {
+        parseSettings();
+        for (auto i : internal) {
+            delete i;
+        }
+        internal.clear();
+        Profiler profiler;
+        size_t nTriangles = 0, bytes = 0;
         for (const auto &i : scene.meshes) {
             auto node = new BVHAcceleratorInternal();
-            node->build(i->triangles);
+            node->build(*i, *this);
             internal.emplace_back(node);
+            nTriangles += i->triangles.size();
+            bytes += node->nodeBytes();
+        }
+        auto seconds = profiler.elapsed<double>().count();
+        log::log("BVH ({}, {}) built in {:.3f}s ({:.2f}ms/Mtri), {:.2f} bytes/tri\n", builder, layout, seconds,
+                 seconds * 1e3 / std::max(1e-6, nTriangles / 1e6), double(bytes) / std::max<size_t>(1, nTriangles));
+        if (benchmark) {
+            auto box = getBoundingBox();
+            auto report = [&](BVHAccelerator &accel) {
+                size_t nodeBytes = 0;
+                for (auto i : accel.internal) {
+                    nodeBytes += i->nodeBytes();
+                }
+                log::log("{}, {}: {:.3f}M rays/s, {:.1f}KB of nodes ({:.2f} bytes/tri)\n", accel.builder,
+                         accel.layout, accel.measureRaysPerSecond(box) / 1e6, nodeBytes / 1e3,
+                         double(nodeBytes) / std::max<size_t>(1, nTriangles));
+            };
+            auto compare = [&](const std::string &builder, const std::string &layout) {
+                if (builder == this->builder && layout == this->layout) {
+                    report(*this);
+                    return;
+                }
+                BVHAccelerator reference;
+                reference.builder = builder;
+                reference.layout = layout;
+                reference.treeletPasses = treeletPasses;
+                reference.splitBudget = splitBudget;
+                reference.overlapThreshold = overlapThreshold;
+                reference.build(scene);
+                report(reference);
+            };
+            // the chosen builder in every node layout, against the float object-split build
+            for (auto layout : {"float", "quantized8", "quantized16"}) {
+                compare(builder, layout);
+            }
+            if (builder != "sah")
+                compare("sah", "float");
         }
     }
 
+    double BVHAccelerator::measureRaysPerSecond(const Bounds3f &box) {
+        // rays between random points inside the scene bounds, so most of them hit something
+        constexpr size_t nRays = 1u << 20u;
+        constexpr size_t chunkSize = 4096;
+        std::vector<Ray> rays;
+        rays.reserve(nRays);
+        Rng rng(0);
+        auto randomPoint = [&]() {
+            Vec3f u(rng.uniformFloat(), rng.uniformFloat(), rng.uniformFloat());
+            return Vec3f(box.pMin + u * box.size());
+        };
+        while (rays.size() < nRays) {
+            auto o = randomPoint();
+            auto d = randomPoint() - o;
+            if (length(d) > 0)
+                rays.emplace_back(o, normalize(d), RayBias);
+        }
+        std::atomic<size_t> nHits = 0;
+        Profiler profiler;
+        ParallelFor(0, nRays / chunkSize, [&](int64_t chunk, size_t) {
+            size_t hits = 0;
+            for (size_t i = chunk * chunkSize; i < (chunk + 1) * chunkSize; i++) {
+                Intersection isct;
+                if (intersect(rays[i], isct))
+                    hits++;
+            }
+            nHits += hits;
+        });
+        auto seconds = profiler.elapsed<double>().count();
+        log::log("{} rays, {} hits in {:.3f}s\n", nRays, nHits, seconds);
+        return nRays / seconds;
+    }
+
+    void BVHAccelerator::update(Scene &scene) {
+        Profiler profiler;
+        size_t rebuilt = 0, refitted = 0;
+        for (size_t i = 0; i < scene.meshes.size(); i++) {
+            const auto &mesh = *scene.meshes[i];
+            if (i >= internal.size()) {
+                internal.emplace_back(new BVHAcceleratorInternal());
+                internal[i]->build(mesh, *this);
+                rebuilt++;
+            } else if (internal[i]->needsRebuild(mesh)) {
+                internal[i]->build(mesh, *this);
+                rebuilt++;
+            } else if (mesh._dirty && internal[i]->canRefit()) {
+                internal[i]->refit();
+                refitted++;
+            } else if (mesh._dirty) {
+                internal[i]->build(mesh, *this);
+                rebuilt++;
+            }
+        }
+        while (internal.size() > scene.meshes.size()) {
+            delete internal.back();
+            internal.pop_back();
+        }
+        log::log("BVH updated in {:.3f}ms, {} rebuilt, {} refitted\n",
+                 profiler.elapsed<double>().count() * 1e3, rebuilt, refitted);
+    }
+
     bool BVHAccelerator::intersect(const Ray &ray, Intersection &isct) {
         bool hit = false;
         for (auto i : internal) {
@@ -273,6 +1361,26 @@ namespace miyuki::core {
         return hit;
     }
 
+    bool8 BVHAccelerator::intersect8(const Ray8 &ray, Intersection8 &isct) {
+        Ray rays[8];
+        Intersection hits[8];
+        for (int l = 0; l < 8; l++) {
+            rays[l] = GetLane(ray, l);
+        }
+        for (auto i : internal) {
+            i->intersect8(rays, hits);
+        }
+        bool8 hit;
+        for (int l = 0; l < 8; l++) {
+            hit[l] = hits[l].hit();
+            if (hit[l]) {
+                hits[l].p = hits[l].distance * rays[l].d + rays[l].o;
+            }
+            SetLane(isct, l, hits[l]);
+        }
+        return hit;
+    }
+
     bool BVHAccelerator::occlude(const Ray &ray) {
         for (auto i : internal) {
             if (i->occlude(ray))
@@ -281,6 +1389,30 @@ namespace miyuki::core {
         return false;
     }
 
+    void BVHAccelerator::saveSnapshot(SnapshotWriter &out) const {
+        out.write(uint64_t(internal.size()));
+        for (auto i : internal) {
+            i->save(out);
+        }
+    }
+
+    void BVHAccelerator::loadSnapshot(SnapshotReader &in, Scene &scene) {
+        parseSettings();
+        for (auto i : internal) {
+            delete i;
+        }
+        internal.clear();
+        auto n = in.read<uint64_t>();
+        if (n != scene.meshes.size()) {
+            MIYUKI_THROW(std::runtime_error, "Snapshot BVH is of another scene");
+        }
+        for (size_t i = 0; i < n; i++) {
+            auto node = new BVHAcceleratorInternal();
+            internal.emplace_back(node);
+            node->load(in, *scene.meshes[i]);
+        }
+    }
+
     BVHAccelerator::~BVHAccelerator() {
         for (auto i : internal) {
             delete i;
@@ -33,18 +33,60 @@ namespace miyuki::core {
     class BVHAccelerator final : public Accelerator {
         class BVHAcceleratorInternal;
 
+        enum class Layout {
+            Float,
+            Quantized8,
+            Quantized16
+        };
+
         std::vector<BVHAcceleratorInternal *> internal;
+        Layout _layout = Layout::Float;
+
+        double measureRaysPerSecond(const Bounds3f &box);
+
+        // checks builder and sets _layout from layout
+        void parseSettings();
+
     public:
-        MYK_DECL_CLASS(BVHAccelerator, "BVHAccelerator", interface = "BVHAccelerator")
+        MYK_DECL_CLASS(BVHAccelerator, "BVHAccelerator", interface = "Accelerator")
+
+        // "sah": binned object splits; "sbvh": object and spatial splits;
+        // "lbvh": Morton-ordered linear BVH, much faster to build but of lower quality
+        std::string builder = "sah";
+        // lbvh only: rounds of treelet restructuring to recover SAH quality, 0 disables it
+        int treeletPasses = 0;
+        // extra references spatial splits may create, as a fraction of the triangle count
+        Float splitBudget = 0.3f;
+        // spatial splits are only tried when the children of an object split overlap by
+        // more than this fraction of the root's surface area
+        Float overlapThreshold = 1e-5f;
+        // "float": full precision nodes; "quantized8"/"quantized16": child boxes stored as
+        // 8/16-bit offsets from the parent box, which cuts node memory at some decoding cost
+        std::string layout = "float";
+        // traces random rays through this builder in every layout and the float object-split build,
+        // logs rays/s and node memory of each
+        bool benchmark = false;
+
+        MYK_SER(builder, treeletPasses, splitBudget, overlapThreshold, layout, benchmark)
 
         void build(Scene &scene) override;
 
+        void update(Scene &scene) override;
+
         bool intersect(const Ray &ray, Intersection &isct) override;
 
         bool occlude(const Ray & ray)override;
 
+        bool8 intersect8(const Ray8 &ray, Intersection8 &isct) override;
+
         Bounds3f getBoundingBox() const override;
 
+        [[nodiscard]] bool supportsSnapshot() const override { return true; }
+
+        void saveSnapshot(SnapshotWriter &out) const override;
+
+        void loadSnapshot(SnapshotReader &in, Scene &scene) override;
+
         ~BVHAccelerator();
     };
 }
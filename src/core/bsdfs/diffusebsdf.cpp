@@ -25,6 +25,17 @@
 #include <miyuki.renderer/sampling.h>
 
 namespace miyuki::core {
+    // cosine-weighted direction around the side of wo, color is the albedo at the shading point
+    static inline void SampleLambertian(Point2f u, const Spectrum &color, BSDFSample &sample) {
+        sample.wi = CosineHemisphereSampling(u);
+        if (sample.wo.y() * sample.wi.y() < 0) {
+            sample.wi.y() = -sample.wi.y();
+        }
+        sample.pdf = std::abs(sample.wi.y()) * InvPi;
+        sample.f = sample.wo.y() * sample.wi.y() > 0 ? Spectrum(color * InvPi) : Spectrum();
+        sample.sampledType = BSDF::Type(int(BSDF::Type::EReflection) | int(BSDF::Type::EDiffuse));
+    }
+
     Spectrum DiffuseBSDF::evaluate(const ShadingPoint &point, const Vec3f &wo, const Vec3f &wi) const {
         if (wo.y() * wi.y() > 0)
             return Spectrum(color->evaluate(point) * InvPi);
@@ -32,14 +43,15 @@ namespace miyuki::core {
     }
 
     void DiffuseBSDF::sample(Point2f u, const ShadingPoint &sp, BSDFSample &sample) const {
-        sample.wi = CosineHemisphereSampling(u);
-        sample.sampledType = BSDF::Type(sample.sampledType | getBSDFType());
-        if (sample.wo.y() * sample.wi.y() < 0) {
-            sample.wi.y() = -sample.wi.y();
+        SampleLambertian(u, color->evaluate(sp), sample);
+    }
+
+    void DiffuseBSDF::sample8(const Point2f *u, const ShadingPoint *sp, BSDFSample *sample) const {
+        Spectrum colors[8];
+        color->evaluate8(sp, colors);
+        for (int i = 0; i < 8; i++) {
+            SampleLambertian(u[i], colors[i], sample[i]);
         }
-        sample.pdf = std::abs(sample.wi.y()) * InvPi;
-        sample.f = evaluate(sp, sample.wo, sample.wi);
-        sample.sampledType = BSDF::Type(int(BSDF::Type::EReflection) | int(BSDF::Type::EDiffuse));
     }
 
     Float DiffuseBSDF::evaluatePdf(const ShadingPoint &point, const Vec3f &wo, const Vec3f &wi) const {
@@ -46,6 +46,8 @@ namespace miyuki::core {
 
         void sample(Point2f u, const ShadingPoint &sp, BSDFSample &sample) const override;
 
+        void sample8(const Point2f *u, const ShadingPoint *sp, BSDFSample *sample) const override;
+
         [[nodiscard]] Float evaluatePdf(const ShadingPoint &point, const Vec3f &wo, const Vec3f &wi) const override;
 
         [[nodiscard]] Type getBSDFType() const override {
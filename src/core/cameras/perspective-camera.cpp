@@ -43,17 +43,46 @@ namespace miyuki::core {
         x = -(2 * x - 1);
         y = 2 * y - 1;
         y *= float(filmDimension.y()) / filmDimension.x();
-        float z = 1.0f / std::atan(fov.get() / 2);
-        Vec3f d = Vec3f(x, y, 0) - Vec3f(0, 0, -z);
+        Vec3f d = Vec3f(x, y, 0) - Vec3f(0, 0, -_focalLength);
         d = normalize(d);
-        Point3f o = Vec3f(sample.pLens.x(), sample.pLens.y(), 0);
-        o = _transform.transformPoint3(o);
         d = _transform.transformVec3(d);
-        sample.ray = Ray(o, d, RayBias);
+        sample.ray = Ray(_origin, d, RayBias);
+    }
+
+    void PerspectiveCamera::generateRays8(const Point2f *u1, const Point2f */*u2*/, const Point2i *raster,
+                                          Point2i filmDimension, CameraSample8 &sample) const {
+        const float invWidth = 1.0f / filmDimension.x(), invHeight = 1.0f / filmDimension.y();
+        const float aspect = float(filmDimension.y()) / filmDimension.x();
+        float8 x, y;
+        for (int i = 0; i < 8; i++) {
+            sample.pFilm[i] = raster[i];
+            x[i] = (raster[i].x() + u1[i].x() - 0.5f) * invWidth;
+            y[i] = (raster[i].y() + u1[i].y() - 0.5f) * invHeight;
+        }
+        x = float8(1.0f) - float8(2.0f) * x;
+        y = (float8(1.0f) - float8(2.0f) * y) * float8(aspect);
+        float8 z(_focalLength);
+        float8 invLength = float8(1.0f) / sqrt(x * x + y * y + z * z);
+        x *= invLength;
+        y *= invLength;
+        z *= invLength;
+        for (int c = 0; c < 3; c++) {
+            sample.ray.o[c] = float8(_origin[c]);
+            sample.ray.d[c] = float8(_axis[0][c]) * x + float8(_axis[1][c]) * y + float8(_axis[2][c]) * z;
+        }
+        sample.ray.tMin = float8(RayBias);
+        sample.ray.tMax = float8(MaxFloat);
     }
 
     void PerspectiveCamera::preprocess() {
         _transform = transform.toTransform();
         _invTransform = _transform.inverse();
+        _focalLength = 1.0f / std::atan(fov.get() / 2);
+        _origin = _transform.transformPoint3(Vec3f(0));
+        for (int i = 0; i < 3; i++) {
+            Vec3f e(0);
+            e[i] = 1;
+            _axis[i] = _transform.transformVec3(e);
+        }
     }
 }
\ No newline at end of file
@@ -31,6 +31,10 @@ namespace miyuki::core {
         Transform _transform{}, _invTransform{};
         Angle<float> fov = DegreesToRadians(80);
         TransformManipulator transform{};
+        // per-camera constants, set by preprocess()
+        float _focalLength = 1.0f;
+        Point3f _origin;
+        Vec3f _axis[3];
     public:
         PerspectiveCamera() = default;
 
@@ -44,6 +48,11 @@ namespace miyuki::core {
         void generateRay(const Point2f &u1, const Point2f &u2, const Point2i &raster, Point2i filmDimension,
                          CameraSample &sample) const override;
 
+        void generateRays8(const Point2f *u1, const Point2f *u2, const Point2i *raster, Point2i filmDimension,
+                           CameraSample8 &sample) const override;
+
+        [[nodiscard]] bool isPinhole() const override { return true; }
+
         void preprocess() override;
     };
 
@@ -32,6 +32,7 @@
 #include "integrators/rtao.h"
 #include "integrators/pt.h"
 #include "integrators/guided-pt.h"
+#include "integrators/wavefront-pt.h"
 #include "samplers/random-sampler.h"
 #include "shaders/common-shader.h"
 #include "shaders/expr-shader.h"
@@ -61,6 +62,7 @@ namespace miyuki::core {
         ctx->registerType<RTAO>();
         ctx->registerType<PathTracer>();
         ctx->registerType<GuidedPathTracer>();
+        ctx->registerType<WavefrontPathTracer>();
         ctx->registerType<RandomSampler>();
         ctx->registerType<SobolSampler>();
         ctx->registerType<EmbreeAccelerator>();
@@ -28,12 +28,13 @@
 #include <miyuki.renderer/lightdistribution.h>
 
 namespace miyuki::core {
-    Task<RenderOutput> SceneGraph::createRenderTask(const std::shared_ptr<serialize::Context> &ctx,
-                                                    const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+    std::shared_ptr<Scene> SceneGraph::buildScene() {
+        auto scene = createScene();
+        scene->preprocess();
+        return scene;
+    }
 
-        camera->preprocess();
-        integrator->preprocess();
-        sampler->preprocess();
+    std::shared_ptr<Scene> SceneGraph::createScene() {
         auto scene = std::make_shared<Scene>();
         for (const auto &i: shapes) {
             if (auto mesh = std::dynamic_pointer_cast<Mesh>(i)) {
@@ -44,32 +45,66 @@ namespace miyuki::core {
                 MIYUKI_THROW(std::runtime_error, "Unknown shape type");
             }
         }
-        scene->preprocess();
+        if (accelerator) {
+            scene->setAccelerator(accelerator);
+        }
+        return scene;
+    }
+
+    Task<RenderOutput> SceneGraph::createRenderTask(const std::shared_ptr<serialize::Context> &ctx,
+                                                    const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+        return createRenderTask(ctx, buildScene(), tx);
+    }
 
+    Task<RenderOutput> SceneGraph::createRenderTask(const std::shared_ptr<serialize::Context> &ctx,
+                                                    const std::shared_ptr<Scene> &scene,
+                                                    const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+        camera->preprocess();
+        integrator->preprocess();
+        sampler->preprocess();
+        scene->resetRayCounter();
         RenderSettings settings;
         settings.filmDimension = filmDimension;
         settings.scene = scene;
         settings.camera = camera;
         settings.sampler = sampler;
+        settings.checkpointFile = checkpointFile;
+        settings.checkpointInterval = checkpointInterval;
+        settings.resume = resume;
+        settings.progress = progress;
+        if (progress) {
+            progress->scene = scene;
+        }
         settings.lightDistribution = std::dynamic_pointer_cast<LightDistribution>(
                 std::shared_ptr<serialize::Serializable>(ctx->getType("UniformLightDistribution")->_create()));
         settings.lightDistribution->build(*scene);
         return integrator->createRenderTask(settings, tx);
     }
 
-    void SceneGraph::render(const std::shared_ptr<serialize::Context> &ctx,const std::string &outImageFile) {
-        auto[tx, rx] = mpsc::channel<std::shared_ptr<Film>>();
-        Task<RenderOutput> task = createRenderTask(ctx, tx);
+    void SceneGraph::render(const std::shared_ptr<serialize::Context> &ctx, const std::string &outFile) {
+        render(ctx, buildScene(), outFile);
+    }
+
+    bool SceneGraph::render(const std::shared_ptr<serialize::Context> &ctx, const std::shared_ptr<Scene> &scene,
+                            const std::string &outFile) {
+        auto outImageFile = ResolvePath(outFile).string();
+        // the film is taken from the result, without a receiver intermediate films aren't copied
+        auto tx = mpsc::channel<std::shared_ptr<Film>>().tx;
+        Task<RenderOutput> task = createRenderTask(ctx, scene, tx);
         log::log("Start Rendering...\n");
         task.launch();
         std::shared_ptr<Film> film;
         if (auto r = task.wait()) {
             film = r.value().film;
         }
-        if (film) {
+        if (film && fs::path(outImageFile).extension() == ".film") {
+            film->writeDump(outImageFile);
+            log::log("saved to {}\n", outImageFile);
+        } else if (film) {
             film->writeImage(outImageFile);
         } else {
             log::log("Render failed\n");
         }
+        return film != nullptr;
     }
 }
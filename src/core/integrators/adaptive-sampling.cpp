@@ -0,0 +1,121 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "adaptive-sampling.h"
+#include <miyuki.foundation/log.hpp>
+#include <algorithm>
+
+namespace miyuki::core {
+    AdaptiveSampling::AdaptiveSampling(const Point2i &filmDimension, int spp, float errorThreshold,
+                                       int samplesPerRound, int blockSize)
+            : filmDimension(filmDimension), errorThreshold(errorThreshold),
+              samplesPerRound(std::max(1, samplesPerRound)),
+              budget(uint64_t(std::max(1, spp)) * filmDimension.x() * filmDimension.y()) {
+        for (int y = 0; y < filmDimension.y(); y += blockSize) {
+            for (int x = 0; x < filmDimension.x(); x += blockSize) {
+                blocks.push_back({Vec2i(x, y), min(filmDimension, Vec2i(x + blockSize, y + blockSize))});
+            }
+        }
+        blockSamples.resize(blocks.size(), 0);
+    }
+
+    float AdaptiveSampling::blockError(const Film &film, const Bounds2i &block) const {
+        const float epsilon = 1e-2f;
+        float error = 0;
+        for (int y = block.pMin.y(); y < block.pMax.y(); y++) {
+            for (int x = block.pMin.x(); x < block.pMax.x(); x++) {
+                auto variance = film.varianceOfMean(Vec2i(x, y));
+                if (variance < 0) {
+                    return MaxFloat;
+                }
+                auto n = film.weight(x, y).r();
+                auto mean = film.color(x, y) / n;
+                error += std::sqrt(variance) / (epsilon + (mean[0] + mean[1] + mean[2]) / 3.0f);
+            }
+        }
+        return error / block.size().x() / block.size().y();
+    }
+
+    bool AdaptiveSampling::nextRound(const Film &film) {
+        for (auto i : active) {
+            blockSamples[i] += roundSamples;
+        }
+        if (rounds == 0) {
+            active.resize(blocks.size());
+            for (uint32_t i = 0; i < blocks.size(); i++) {
+                active[i] = i;
+            }
+        } else {
+            active.erase(std::remove_if(active.begin(), active.end(), [&](uint32_t i) {
+                return blockError(film, blocks[i]) <= errorThreshold;
+            }), active.end());
+        }
+        uint64_t pixels = 0;
+        for (auto i : active) {
+            pixels += blocks[i].size().x() * blocks[i].size().y();
+        }
+        // the first round needs two samples for a variance estimate
+        auto wanted = rounds == 0 ? std::max(2, samplesPerRound) : samplesPerRound;
+        if (pixels == 0 || used + pixels > budget) {
+            active.clear();
+            roundSamples = 0;
+            return false;
+        }
+        roundSamples = std::min<uint64_t>(wanted, (budget - used) / pixels);
+        used += roundSamples * pixels;
+        rounds++;
+        return true;
+    }
+
+    void AdaptiveSampling::report(const Film &film, double seconds) const {
+        float minSpp = MaxFloat, maxSpp = 0;
+        for (size_t i = 0; i < film.width * film.height; i++) {
+            auto n = film.weight.data()[i].r();
+            minSpp = std::min(minSpp, n);
+            maxSpp = std::max(maxSpp, n);
+        }
+        auto pixels = double(filmDimension.x()) * filmDimension.y();
+        size_t converged = 0;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (blockError(film, blocks[i]) <= errorThreshold) {
+                converged++;
+            }
+        }
+        log::log("Adaptive sampling: {} rounds, {:.2f}% blocks converged, effective spp: avg {:.2f} min {} max {}\n",
+                 rounds, 100.0 * converged / blocks.size(), used / pixels, minSpp, maxSpp);
+        log::log("Used {} of {} samples, about {:.3f}secs saved\n", used, budget,
+                 used == 0 ? 0.0 : seconds * (double(budget) / used - 1.0));
+    }
+
+    void AdaptiveSampling::WriteSppMap(const Film &film, const std::string &filename) {
+        float maxSpp = 0;
+        for (size_t i = 0; i < film.width * film.height; i++) {
+            maxSpp = std::max(maxSpp, film.weight.data()[i].r());
+        }
+        RGBAImage image(Vec2i(film.width, film.height));
+        for (size_t i = 0; i < film.width * film.height; i++) {
+            auto v = maxSpp == 0 ? 0.0f : film.weight.data()[i].r() / maxSpp;
+            image.data()[i] = float4(Vec3f(v), 1.0f);
+        }
+        image.write(ResolvePath(filename).string(), 1.0f);
+    }
+} // namespace miyuki::core
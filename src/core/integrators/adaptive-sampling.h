@@ -0,0 +1,72 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_ADAPTIVE_SAMPLING_H
+#define MIYUKIRENDERER_ADAPTIVE_SAMPLING_H
+
+#include <miyuki.foundation/film.h>
+#include <vector>
+
+namespace miyuki::core {
+    // Hands out samples in rounds. Every block of pixels gets a first round; afterwards only blocks
+    // whose relative error is still above the threshold are sampled, until the budget of
+    // spp * pixels is spent or every block converged.
+    class AdaptiveSampling {
+        Point2i filmDimension;
+        float errorThreshold;
+        int samplesPerRound;
+        uint64_t budget, used = 0;
+        std::vector<Bounds2i> blocks;
+        std::vector<int> blockSamples;
+        std::vector<uint32_t> active;
+        int roundSamples = 0;
+        int rounds = 0;
+
+        [[nodiscard]] float blockError(const Film &film, const Bounds2i &block) const;
+
+    public:
+        AdaptiveSampling(const Point2i &filmDimension, int spp, float errorThreshold, int samplesPerRound,
+                         int blockSize = 8);
+
+        // picks the blocks of the next round from the film so far, false when sampling is done
+        bool nextRound(const Film &film);
+
+        [[nodiscard]] const std::vector<uint32_t> &activeBlocks() const { return active; }
+
+        [[nodiscard]] const Bounds2i &block(uint32_t i) const { return blocks[i]; }
+
+        // index of the first sample block i takes this round
+        [[nodiscard]] int firstSample(uint32_t i) const { return blockSamples[i]; }
+
+        [[nodiscard]] int samplesThisRound() const { return roundSamples; }
+
+        [[nodiscard]] double progress() const { return double(used) / budget; }
+
+        // logs the effective spp and the time saved over spending the whole budget
+        void report(const Film &film, double seconds) const;
+
+        // the film's per-pixel sample counts, scaled to the maximum
+        static void WriteSppMap(const Film &film, const std::string &filename);
+    };
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_ADAPTIVE_SAMPLING_H
@@ -0,0 +1,74 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_CAMERA_PACKETS_H
+#define MIYUKIRENDERER_CAMERA_PACKETS_H
+
+#include <miyuki.renderer/camera.h>
+#include <miyuki.renderer/sampler.h>
+#include <miyuki.renderer/scene.h>
+#include <algorithm>
+
+namespace miyuki::core {
+    // Camera samples of pixels[0, n) in packets of 8 neighbours, packets[j] covers pixels [8j, 8j + 8).
+    // Pixel i draws from samplers[i], which must have started its next sample. Lanes past n are
+    // disabled so that the last packet can be traced as is.
+    inline void GenerateCameraPackets(const Camera &camera, const Point2i &filmDimension, const Point2i *pixels,
+                                      const std::shared_ptr<Sampler> *samplers, size_t n, CameraSample *samples,
+                                      Ray8 *packets) {
+        for (size_t j = 0; j < n; j += 8) {
+            Point2f u1[8], u2[8];
+            Point2i raster[8];
+            for (size_t l = 0; l < 8; l++) {
+                auto i = std::min(j + l, n - 1);
+                raster[l] = pixels[i];
+                if (j + l < n) {
+                    u1[l] = samplers[i]->next2D();
+                    u2[l] = samplers[i]->next2D();
+                }
+            }
+            CameraSample8 sample;
+            camera.generateRays8(u1, u2, raster, filmDimension, sample);
+            for (size_t l = 0; l < 8; l++) {
+                if (j + l < n) {
+                    samples[j + l].pFilm = sample.pFilm[l];
+                    samples[j + l].ray = GetLane(sample.ray, l);
+                } else {
+                    sample.ray.tMin[l] = 1;
+                    sample.ray.tMax[l] = 0;
+                }
+            }
+            packets[j / 8] = sample.ray;
+        }
+    }
+
+    // traces the packets of GenerateCameraPackets, hits[i] is the camera hit of pixel i
+    inline void IntersectCameraPackets(Scene &scene, const Ray8 *packets, size_t n, Intersection *hits) {
+        for (size_t j = 0; j < n; j += 8) {
+            Intersection lanes[8];
+            scene.intersect8(packets[j / 8], lanes);
+            std::copy(lanes, lanes + std::min<size_t>(8, n - j), hits + j);
+        }
+    }
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_CAMERA_PACKETS_H
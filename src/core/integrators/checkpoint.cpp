@@ -0,0 +1,178 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "checkpoint.h"
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/log.hpp>
+#include <fstream>
+
+namespace miyuki::core {
+    static const char CheckpointMagic[8] = {'M', 'Y', 'K', 'C', 'K', 'P', 'T', 0};
+    static const uint32_t CheckpointVersion = 1;
+
+    template<class T>
+    static void WriteBinary(std::ostream &out, const T *data, size_t count) {
+        out.write(reinterpret_cast<const char *>(data), sizeof(T) * count);
+    }
+
+    template<class T>
+    static void ReadBinary(std::istream &in, T *data, size_t count) {
+        in.read(reinterpret_cast<char *>(data), sizeof(T) * count);
+        if (!in) {
+            MIYUKI_THROW(std::runtime_error, "Checkpoint is truncated");
+        }
+    }
+
+    static void WriteString(std::ostream &out, const std::string &s) {
+        uint64_t size = s.size();
+        WriteBinary(out, &size, 1);
+        WriteBinary(out, s.data(), s.size());
+    }
+
+    static std::string ReadString(std::istream &in) {
+        uint64_t size;
+        ReadBinary(in, &size, 1);
+        std::string s(size, 0);
+        ReadBinary(in, s.data(), size);
+        return s;
+    }
+
+    // texels are written as is, the header records their size so a build with another layout rejects the file
+    static RGBImage *FilmImages(Film &film, size_t i) {
+        RGBImage *images[] = {&film.color, &film.normal, &film.albedo, &film.weight, &film.secondMoment};
+        return images[i];
+    }
+
+    static const size_t FilmImageCount = 5;
+
+    void WriteCheckpoint(const std::string &filename, const Checkpoint &checkpoint) {
+        auto &film = *checkpoint.film;
+        MIYUKI_CHECK(checkpoint.sampleIndex.size() == film.width * film.height);
+        auto tmp = filename + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            if (!out) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Cannot open {}", tmp));
+            }
+            WriteBinary(out, CheckpointMagic, sizeof(CheckpointMagic));
+            uint32_t header[] = {CheckpointVersion, uint32_t(sizeof(Vec3f)), uint32_t(film.width),
+                                 uint32_t(film.height)};
+            WriteBinary(out, header, 4);
+            WriteString(out, checkpoint.integrator);
+            for (size_t i = 0; i < FilmImageCount; i++) {
+                WriteBinary(out, FilmImages(film, i)->data(), film.width * film.height);
+            }
+            WriteBinary(out, checkpoint.sampleIndex.data(), checkpoint.sampleIndex.size());
+            WriteString(out, checkpoint.state);
+            if (!out) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Error writing {}", tmp));
+            }
+        }
+        fs::rename(tmp, filename);
+    }
+
+    Checkpoint ReadCheckpoint(const std::string &filename) {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Cannot open {}", filename));
+        }
+        char magic[sizeof(CheckpointMagic)];
+        ReadBinary(in, magic, sizeof(magic));
+        uint32_t header[4];
+        ReadBinary(in, header, 4);
+        if (!std::equal(magic, magic + sizeof(magic), CheckpointMagic) || header[0] != CheckpointVersion ||
+            header[1] != sizeof(Vec3f)) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{} is not a checkpoint of this build", filename));
+        }
+        Checkpoint checkpoint;
+        checkpoint.integrator = ReadString(in);
+        checkpoint.film = std::make_shared<Film>(Vec2i(header[2], header[3]));
+        auto &film = *checkpoint.film;
+        for (size_t i = 0; i < FilmImageCount; i++) {
+            ReadBinary(in, FilmImages(film, i)->data(), film.width * film.height);
+        }
+        checkpoint.sampleIndex.resize(film.width * film.height);
+        ReadBinary(in, checkpoint.sampleIndex.data(), checkpoint.sampleIndex.size());
+        checkpoint.state = ReadString(in);
+        return checkpoint;
+    }
+
+    RenderCheckpoint::RenderCheckpoint(const RenderSettings &settings, std::string integrator)
+            : filename(settings.checkpointFile.empty() ? "" : ResolvePath(settings.checkpointFile).string()),
+              integrator(std::move(integrator)), interval(settings.checkpointInterval), resuming(settings.resume) {}
+
+    int RenderCheckpoint::resume(Film &film, std::string *state) {
+        if (!enabled() || !resuming) {
+            return 0;
+        }
+        if (!fs::exists(filename)) {
+            log::log("No checkpoint at {}, starting over\n", filename);
+            return 0;
+        }
+        auto checkpoint = ReadCheckpoint(filename);
+        if (checkpoint.integrator != integrator) {
+            MIYUKI_THROW(std::runtime_error,
+                         fmt::format("{} was written by {}, not {}", filename, checkpoint.integrator, integrator));
+        }
+        if (checkpoint.film->width != film.width || checkpoint.film->height != film.height) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{} has a different film size", filename));
+        }
+        // passes cover the whole film, so every pixel continues from the same index
+        auto samples = checkpoint.sampleIndex.front();
+        if (std::any_of(checkpoint.sampleIndex.begin(), checkpoint.sampleIndex.end(),
+                        [=](uint32_t i) { return i != samples; })) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{} has uneven sample counts", filename));
+        }
+        for (size_t i = 0; i < FilmImageCount; i++) {
+            std::copy(FilmImages(*checkpoint.film, i)->data(),
+                      FilmImages(*checkpoint.film, i)->data() + film.width * film.height,
+                      FilmImages(film, i)->data());
+        }
+        if (state) {
+            *state = std::move(checkpoint.state);
+        }
+        log::log("Resuming from {}, {} spp done\n", filename, samples);
+        written = samples;
+        return samples;
+    }
+
+    void RenderCheckpoint::update(const Film &film, int samplesDone, const std::function<std::string()> &state,
+                                  bool force) {
+        auto now = profiler.elapsed<double>().count();
+        if (!enabled() || samplesDone == written || (!force && now - lastWrite < interval)) {
+            return;
+        }
+        Profiler writeTime;
+        Checkpoint checkpoint;
+        checkpoint.integrator = integrator;
+        checkpoint.film = std::make_shared<Film>(film);
+        checkpoint.sampleIndex.assign(film.width * film.height, samplesDone);
+        if (state) {
+            checkpoint.state = state();
+        }
+        WriteCheckpoint(filename, checkpoint);
+        lastWrite = now;
+        written = samplesDone;
+        log::log("Checkpoint: {} spp to {} in {:.3f}secs\n", samplesDone, filename,
+                 writeTime.elapsed<double>().count());
+    }
+} // namespace miyuki::core
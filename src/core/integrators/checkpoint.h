@@ -0,0 +1,76 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_CHECKPOINT_H
+#define MIYUKIRENDERER_CHECKPOINT_H
+
+#include <miyuki.renderer/integrator.h>
+#include <miyuki.foundation/profiler.h>
+#include <functional>
+
+namespace miyuki::core {
+    // Render state saved between sample passes, enough to continue the sample sequence of every pixel
+    struct Checkpoint {
+        std::string integrator;
+        std::shared_ptr<Film> film;
+        // per pixel, index of the next sample to take
+        std::vector<uint32_t> sampleIndex;
+        // integrator specific, e.g. the trained STree of GuidedPathTracer
+        std::string state;
+    };
+
+    // Writes to a temporary file first, a render killed while writing leaves the previous checkpoint intact
+    void WriteCheckpoint(const std::string &filename, const Checkpoint &checkpoint);
+
+    Checkpoint ReadCheckpoint(const std::string &filename);
+
+    // Checkpointing for integrators that render whole-image passes: restores the film when
+    // settings.resume is set and saves it after a pass once settings.checkpointInterval has passed
+    class RenderCheckpoint {
+        std::string filename;
+        std::string integrator;
+        double interval;
+        bool resuming;
+        Profiler profiler;
+        double lastWrite = 0;
+        int written = -1;
+
+    public:
+        RenderCheckpoint(const RenderSettings &settings, std::string integrator);
+
+        [[nodiscard]] bool enabled() const { return !filename.empty(); }
+
+        void disable() { filename.clear(); }
+
+        [[nodiscard]] double getInterval() const { return interval; }
+
+        // Loads the checkpoint into film and returns the samples per pixel it holds.
+        // 0 if not resuming or there is no checkpoint yet.
+        int resume(Film &film, std::string *state = nullptr);
+
+        // call between passes, writes if the interval has passed or force is set, and the samples changed
+        void update(const Film &film, int samplesDone, const std::function<std::string()> &state = {},
+                    bool force = false);
+    };
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_CHECKPOINT_H
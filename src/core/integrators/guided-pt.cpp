@@ -34,6 +34,10 @@
 #include <miyuki.renderer/progressreporter.h>
 #include <miyuki.foundation/arena.hpp>
 #include <miyuki.renderer/stat.hpp>
+#include "adaptive-sampling.h"
+#include "progressive.h"
+#include "checkpoint.h"
+#include <sstream>
 
 namespace miyuki::core {
     static float MisWeight(float pdfA, float pdfB) {
@@ -46,23 +50,61 @@ namespace miyuki::core {
     }
 
 
-    static RenderOutput
-    GuidedPathTracerRender(int trainingPasses, bool denoise, const Task<RenderSettings>::ContFunc &cont,
-                           int spp, int minDepth, int maxDepth, const RenderSettings &settings,
-                           const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+    struct GuidedPathTracerConfig {
+        int spp = 16;
+        int minDepth = 3;
+        int maxDepth = 5;
+        bool denoise = false;
+        int trainingPasses = 64;
+        bool adaptiveSampling = false;
+        float errorThreshold = 0.01f;
+        int samplesPerRound = 4;
+        std::string sppMapFile;
+        bool progressive = false;
+        float timeBudget = 0;
+        // the tree left by the previous render, continued instead of starting over
+        std::shared_ptr<STree> tree;
+        int retrainingPasses = 8;
+    };
+
+    static std::pair<RenderOutput, std::shared_ptr<STree>>
+    GuidedPathTracerRender(GuidedPathTracerConfig config, const Task<RenderSettings>::ContFunc &cont,
+                           const RenderSettings &settings, const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+        const int spp = config.spp, minDepth = config.minDepth, maxDepth = config.maxDepth;
         RatioCounter<size_t> nonZeroPath;
         auto *scene = settings.scene.get();
         scene->resetRayCounter();
         Profiler profiler;
+        ProgressiveSchedule schedule(spp, config.timeBudget);
+        RenderCheckpoint checkpoint(settings, "GuidedPathTracer");
         auto filmPtr = std::make_shared<Film>(settings.filmDimension);
         auto &film = *filmPtr;
-        log::log("Integrator: Guided Path Tracer, samples: {}\n", spp);
+        if (config.timeBudget > 0 || checkpoint.enabled()) {
+            config.progressive = true;
+        }
+        log::log("Integrator: Guided Path Tracer, samples: {}, adaptive sampling: {}, progressive: {}\n", spp,
+                 config.adaptiveSampling, config.progressive);
+        if (config.adaptiveSampling && config.progressive) {
+            log::log("Adaptive sampling has its own rounds, ignoring progressive mode and the time budget\n");
+            config.progressive = false;
+        }
+        if (config.adaptiveSampling && checkpoint.enabled()) {
+            log::log("Checkpoints need whole-image passes, not writing them with adaptive sampling\n");
+            checkpoint.disable();
+        }
 
-        auto backgroundLi = [=](const Ray &ray) -> Spectrum {
+        auto backgroundLi = [=](const Ray &) -> Spectrum {
             return Spectrum(0);
         };
 
-        std::shared_ptr<STree> sTree(new STree(scene->getBoundingBox()));
+        std::shared_ptr<STree> sTree;
+        if (config.tree) {
+            sTree = config.tree;
+            config.trainingPasses = std::min(config.trainingPasses, config.retrainingPasses);
+            log::log("Continuing the previous SDTree with {} nodes\n", sTree->nodes.size());
+        } else {
+            sTree.reset(new STree(scene->getBoundingBox()));
+        }
         struct PathVertex {
             Vec3f wi;
             Point3f p;
@@ -117,7 +159,7 @@ namespace miyuki::core {
                 if (intersection.material->emission && intersection.material->emissionStrength &&
                     dot(ray.d, intersection.Ng) < 0) {
 
-                    auto light = intersection.shape->light;
+                    auto light = intersection.light;
                     auto lightPdf = settings.lightDistribution->lightPdf(light);
                     Spectrum radiance;
                     if (!enableNEE || depth == 0 || !light || lightPdf <= 0.0f || specular) {
@@ -252,14 +294,15 @@ namespace miyuki::core {
 
         const size_t tileSize = 64;
         std::vector<Bounds2i> tiles;
-        for (int i = 0; i < film.width; i += tileSize) {
-            for (int j = 0; j < film.height; j += tileSize) {
+        for (int i = 0; i < int(film.width); i += tileSize) {
+            for (int j = 0; j < int(film.height); j += tileSize) {
                 tiles.push_back({Vec2i(i, j), min(Vec2i(film.width, film.height), Vec2i(i + tileSize, j + tileSize))});
             }
         }
 
         std::mutex _reporterMutex;
-        ProgressReporter reporter(tiles.size(), [=, &_reporterMutex](size_t cur, size_t total) {
+        ProgressReporter reporter(tiles.size(), [=, &_reporterMutex, &settings](size_t cur, size_t total) {
+            settings.reportProgress(double(cur + 1) / total, double(spp) * (cur + 1) / total);
             std::unique_lock<std::mutex> lock(_reporterMutex, std::try_to_lock);
             if (lock.owns_lock()) {
                 PrintProgressBar(double(cur) / total);
@@ -267,17 +310,32 @@ namespace miyuki::core {
         });
         uint32_t pass = 0;
         uint32_t accumulatedSamples = 0;
-        for (pass = 0; pass < trainingPasses; pass++) {
+        // the trained tree and the number of training samples taken
+        auto trainingState = [&]() {
+            std::ostringstream out;
+            SaveTreeField(out, accumulatedSamples);
+            sTree->save(out);
+            return out.str();
+        };
+        std::string restoredState;
+        auto resumedSamples = checkpoint.resume(film, &restoredState);
+        if (!restoredState.empty()) {
+            std::istringstream in(restoredState);
+            LoadTreeField(in, accumulatedSamples);
+            sTree->load(in);
+            log::log("Restored SDTree with {} nodes, skipping training\n", sTree->nodes.size());
+        }
+        for (pass = 0; restoredState.empty() && pass < uint32_t(config.trainingPasses); pass++) {
             auto samples = 2;//1u << pass;//2 * std::pow(1.1, pass);//1ull << pass;
             accumulatedSamples += samples;
             ParallelFor(0, tiles.size(), [=, &tiles, &film](int64_t i, uint64_t) {
                 auto sampler = settings.sampler->clone();
-                sampler->startSample(accumulatedSamples);
                 Arena arena;
                 auto &tile = tiles[i];
                 for (int y = tile.pMin.y(); cont() && y < tile.pMax.y(); y++) {
                     for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
                         sampler->startPixel(Point2i(x, y), Point2i(film.width, film.height));
+                        sampler->startSample(accumulatedSamples - samples);
                         for (int s = 0; s < samples && cont(); s++) {
                             CameraSample sample;
                             sampler->startNextSample();
@@ -295,6 +353,9 @@ namespace miyuki::core {
             sTree->refine(12000 * std::sqrt(samples));
 //            log::log("Done refining SDTree\n");
         }
+        if (restoredState.empty() && cont()) {
+            checkpoint.update(film, 0, trainingState, true);
+        }
 //        int cnt = 0;
 //        for (auto &i:sTree->nodes) {
 //            auto &tree = i.dTree.sampling;
@@ -311,26 +372,66 @@ namespace miyuki::core {
 //            }
 //        }
         log::log("Start Rendering\n");
-        {
-            ParallelFor(0, tiles.size(), [=, &tiles, &film, &reporter](int64_t i, uint64_t) {
-                auto sampler = settings.sampler->clone();
-                Arena arena;
-                auto &tile = tiles[i];
-                for (int y = tile.pMin.y(); cont() && y < tile.pMax.y(); y++) {
-                    for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
-                        sampler->startSample(accumulatedSamples);
-                        sampler->startPixel(Point2i(x, y), Point2i(film.width, film.height));
-                        for (int s = 0; s < spp && cont(); s++) {
-                            CameraSample sample;
-                            sampler->startNextSample();
-                            settings.camera->generateRay(sampler->next2D(), sampler->next2D(), Point2i(x, y),
-                                                         Point2i(film.width, film.height), sample);
+        // samples [firstSample, firstSample + nSamples) after the training samples
+        auto renderTile = [=, &film](const Bounds2i &tile, int firstSample, int nSamples) {
+            auto sampler = settings.sampler->clone();
+            Arena arena;
+            for (int y = tile.pMin.y(); cont() && y < tile.pMax.y(); y++) {
+                for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
+                    sampler->startPixel(Point2i(x, y), Point2i(film.width, film.height));
+                    sampler->startSample(accumulatedSamples + firstSample);
+                    for (int s = 0; s < nSamples && cont(); s++) {
+                        CameraSample sample;
+                        sampler->startNextSample();
+                        settings.camera->generateRay(sampler->next2D(), sampler->next2D(), Point2i(x, y),
+                                                     Point2i(film.width, film.height), sample);
 
-                            film.addSample(sample.pFilm, Li(false, false, arena, *sampler, sample.ray), 1);
-                            arena.reset();
-                        }
+                        film.addSample(sample.pFilm, Li(false, false, arena, *sampler, sample.ray), 1);
+                        arena.reset();
                     }
                 }
+            }
+            settings.publishTile(film, tile);
+        };
+        std::unique_ptr<AdaptiveSampling> adaptive;
+        if (config.adaptiveSampling) {
+            adaptive = std::make_unique<AdaptiveSampling>(settings.filmDimension, spp, config.errorThreshold,
+                                                          config.samplesPerRound);
+            while (cont() && adaptive->nextRound(film)) {
+                auto &blocks = adaptive->activeBlocks();
+                ParallelFor(0, blocks.size(), [&](int64_t i, uint64_t) {
+                    renderTile(adaptive->block(blocks[i]), adaptive->firstSample(blocks[i]),
+                               adaptive->samplesThisRound());
+                });
+                settings.reportProgress(adaptive->progress(), adaptive->progress() * spp);
+                PrintProgressBar(adaptive->progress());
+            }
+        } else if (config.progressive) {
+            schedule.resume(resumedSamples);
+            if (checkpoint.enabled()) {
+                schedule.setMaxPassTime(checkpoint.getInterval());
+            }
+            for (int samples; cont() && (samples = schedule.nextPass()) > 0;) {
+                if (schedule.samplesDone() > 0 && tx.connected()) {
+                    tx.send(std::make_shared<Film>(film));
+                }
+                ParallelFor(0, tiles.size(), [&](int64_t i, uint64_t) {
+                    renderTile(tiles[i], schedule.samplesDone(), samples);
+                });
+                if (!cont()) {
+                    break;
+                }
+                schedule.endPass();
+                checkpoint.update(film, schedule.samplesDone(), trainingState);
+                settings.reportProgress(schedule.progress(), schedule.samplesDone());
+                PrintProgressBar(schedule.progress());
+            }
+            if (cont()) {
+                checkpoint.update(film, schedule.samplesDone(), trainingState, true);
+            }
+        } else {
+            ParallelFor(0, tiles.size(), [&](int64_t i, uint64_t) {
+                renderTile(tiles[i], 0, spp);
                 reporter.update();
             });
         }
@@ -341,15 +442,49 @@ namespace miyuki::core {
         log::log("Rendering done in {}secs, traced {} rays, {:.4f} M rays/sec, non-zero path: {:.4f}%\n",
                  duration.count(), scene->getRayCounter(),
                  scene->getRayCounter() / duration.count() / 1e6f, nonZeroPath.ratio() * 100);
+        if (config.progressive) {
+            schedule.report();
+        }
+        if (adaptive) {
+            adaptive->report(film, duration.count());
+            if (!config.sppMapFile.empty()) {
+                AdaptiveSampling::WriteSppMap(film, config.sppMapFile);
+            }
+        }
         tx.send(std::shared_ptr<Film>(filmPtr));
-        return RenderOutput{filmPtr};
+        return {RenderOutput{filmPtr}, sTree};
     }
 
     Task<RenderOutput>
     core::GuidedPathTracer::createRenderTask(const RenderSettings &settings,
                                              const mpsc::Sender<std::shared_ptr<Film>> &tx) {
         return Task<RenderOutput>([=, &tx](const Task<RenderSettings>::ContFunc &func) {
-            return GuidedPathTracerRender(trainingPasses, denoise, func, spp, minDepth, maxDepth, settings, tx);
+            GuidedPathTracerConfig config;
+            config.spp = spp;
+            config.minDepth = minDepth;
+            config.maxDepth = maxDepth;
+            config.denoise = denoise;
+            config.trainingPasses = trainingPasses;
+            config.adaptiveSampling = adaptiveSampling;
+            config.errorThreshold = errorThreshold;
+            config.samplesPerRound = samplesPerRound;
+            config.sppMapFile = sppMapFile;
+            config.progressive = progressive;
+            config.timeBudget = timeBudget;
+            config.retrainingPasses = retrainingPasses;
+            if (reuseTraining) {
+                std::lock_guard<std::mutex> lock(trainedTreeMutex);
+                if (trainedScene.lock() == settings.scene) {
+                    config.tree = trainedTree;
+                }
+            }
+            auto[output, tree] = GuidedPathTracerRender(config, func, settings, tx);
+            if (reuseTraining && output.film) {
+                std::lock_guard<std::mutex> lock(trainedTreeMutex);
+                trainedTree = tree;
+                trainedScene = settings.scene;
+            }
+            return output;
         });
     }
 }
\ No newline at end of file
@@ -29,6 +29,7 @@
 #include <miyuki.renderer/shader.h>
 #include <miyuki.renderer/ray.h>
 #include "sdtree.hpp"
+#include <mutex>
 
 namespace miyuki::core {
     class GuidedPathTracer final : public Integrator {
@@ -38,10 +39,26 @@ namespace miyuki::core {
         bool denoise = false;
         bool enableNEE = true;
         int trainingPasses = 64;
+        // samples the final pass in rounds, see PathTracer
+        bool adaptiveSampling = false;
+        float errorThreshold = 0.01f;
+        int samplesPerRound = 4;
+        std::string sppMapFile;
+        // renders the final pass progressively, the time budget includes training; see PathTracer
+        bool progressive = false;
+        float timeBudget = 0;
+        // keeps the trained SDTree for the next render of the same scene (e.g. the next frame of a
+        // sequence), which then only trains for retrainingPasses
+        bool reuseTraining = false;
+        int retrainingPasses = 8;
+        std::shared_ptr<STree> trainedTree;
+        std::weak_ptr<Scene> trainedScene;
+        std::mutex trainedTreeMutex;
     public:
         MYK_DECL_CLASS(GuidedPathTracer, "GuidedPathTracer", interface = "Integrator");
 
-        MYK_SER(spp, minDepth, maxDepth, denoise, enableNEE, trainingPasses)
+        MYK_SER(spp, minDepth, maxDepth, denoise, enableNEE, trainingPasses, adaptiveSampling, errorThreshold,
+                samplesPerRound, sppMapFile, progressive, timeBudget, reuseTraining, retrainingPasses)
 
 
         Task<RenderOutput>
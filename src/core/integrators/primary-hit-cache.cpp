@@ -0,0 +1,137 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "primary-hit-cache.h"
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/parallel.h>
+#include <miyuki.foundation/profiler.h>
+#include <miyuki.renderer/material.h>
+#include <miyuki.renderer/mesh.h>
+#include <miyuki.renderer/sampler.h>
+#include <miyuki.renderer/scene.h>
+#include <algorithm>
+
+namespace miyuki::core {
+    PrimaryHitCache::PrimaryHitCache(const RenderSettings &settings, int jitterCount)
+            : scene(settings.scene), camera(settings.camera), filmDimension(settings.filmDimension),
+              jitterCount(std::max(1, jitterCount)) {
+        // R2 sequence, well spread out for any number of jitters
+        for (int i = 0; i < this->jitterCount; i++) {
+            auto x = 0.5f + 0.7548776662f * i, y = 0.5f + 0.5698402910f * i;
+            jitters.emplace_back(x - std::floor(x), y - std::floor(y));
+        }
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < scene->meshes.size(); i++) {
+            meshOffset.emplace_back(count);
+            meshIndex[scene->meshes[i].get()] = i;
+            MIYUKI_CHECK(uint64_t(count) + scene->meshes[i]->triangles.size() < FlippedNg);
+            count += scene->meshes[i]->triangles.size();
+        }
+    }
+
+    PrimaryHitCache::Entry PrimaryHitCache::encode(const Intersection &isct) const {
+        Entry entry;
+        if (!isct.hit()) {
+            return entry;
+        }
+        auto *shape = isct.shape;
+        entry.primitive = meshOffset[meshIndex.at(shape->mesh)] + shape->primitiveId;
+        if (dot(isct.Ng, shape->Ng()) < 0) {
+            entry.primitive |= FlippedNg;
+        }
+        entry.u = isct.uv[0];
+        entry.v = isct.uv[1];
+        entry.distance = isct.distance;
+        return entry;
+    }
+
+    bool PrimaryHitCache::build(const Task<RenderOutput>::ContFunc &cont) {
+        Profiler profiler;
+        const int width = filmDimension.x();
+        const size_t rowSize = size_t(width) * jitterCount;
+        entries.assign(rowSize * filmDimension.y(), Entry());
+        ParallelFor(0, filmDimension.y(), [&](int64_t y, uint64_t) {
+            if (!cont()) {
+                return;
+            }
+            std::vector<Ray> rays(rowSize);
+            std::vector<Intersection> hits(rowSize);
+            for (int x = 0; x < width; x++) {
+                for (int k = 0; k < jitterCount; k++) {
+                    CameraSample sample;
+                    camera->generateRay(jitters[k], Point2f(0.5f), Point2i(x, y), filmDimension, sample);
+                    rays[x * jitterCount + k] = sample.ray;
+                }
+            }
+            scene->intersect(rays.data(), hits.data(), rowSize);
+            for (size_t i = 0; i < rowSize; i++) {
+                entries[y * rowSize + i] = encode(hits[i]);
+            }
+        });
+        if (!cont()) {
+            return false;
+        }
+        log::log("Primary hit cache: {} jitters, {:.1f}MB, built in {:.3f}secs\n", jitterCount,
+                 memoryUsage() / (1024.0 * 1024.0), profiler.elapsed<double>().count());
+        return true;
+    }
+
+    bool PrimaryHitCache::lookup(Sampler &sampler, const Point2i &p, uint32_t sampleIndex, CameraSample &sample,
+                                 Intersection &isct) const {
+        sampler.next2D();
+        sampler.next2D();
+        auto k = sampleIndex % jitterCount;
+        camera->generateRay(jitters[k], Point2f(0.5f), p, filmDimension, sample);
+        isct = Intersection();
+        auto &entry = entries[(size_t(p.y()) * filmDimension.x() + p.x()) * jitterCount + k];
+        if (entry.primitive == Miss) {
+            return false;
+        }
+        auto id = entry.primitive & ~FlippedNg;
+        auto m = std::upper_bound(meshOffset.begin(), meshOffset.end(), id) - meshOffset.begin() - 1;
+        const auto *shape = &scene->meshes[m]->triangles[id - meshOffset[m]];
+        isct.shape = shape;
+        isct.uv = Point2f(entry.u, entry.v);
+        isct.distance = entry.distance;
+        isct.Ng = entry.primitive & FlippedNg ? -1.0f * shape->Ng() : shape->Ng();
+        isct.p = isct.distance * sample.ray.d + sample.ray.o;
+        isct.Ns = shape->normalAt(isct.uv);
+        isct.material = shape->getMaterial();
+        isct.light = isct.material && isct.material->markAsLight ? shape->light() : nullptr;
+        isct.wo = -1.0f * sample.ray.d;
+        isct.computeLocalFrame();
+        return true;
+    }
+
+    std::shared_ptr<PrimaryHitCache> CreatePrimaryHitCache(const RenderSettings &settings, int jitterCount,
+                                                           const Task<RenderOutput>::ContFunc &cont) {
+        if (!settings.camera->isPinhole()) {
+            log::log("Primary hit cache needs a pinhole camera, tracing camera rays instead\n");
+            return nullptr;
+        }
+        auto cache = std::make_shared<PrimaryHitCache>(settings, jitterCount);
+        if (!cache->build(cont)) {
+            return nullptr;
+        }
+        return cache;
+    }
+} // namespace miyuki::core
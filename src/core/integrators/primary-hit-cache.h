@@ -0,0 +1,84 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_PRIMARY_HIT_CACHE_H
+#define MIYUKIRENDERER_PRIMARY_HIT_CACHE_H
+
+#include <miyuki.renderer/integrator.h>
+#include <miyuki.renderer/camera.h>
+#include <miyuki.renderer/ray.h>
+#include <unordered_map>
+
+namespace miyuki::core {
+    class Sampler;
+
+    class Mesh;
+
+    // Camera hits of every pixel at a fixed set of sub-pixel jitters, traced once and reused by
+    // all later samples. Only valid for a pinhole camera that doesn't move while the cache is in use.
+    class PrimaryHitCache {
+    public:
+        static constexpr uint32_t Miss = 0xffffffffu;
+        // set in Entry::primitive when the accelerator's Ng is opposite to the triangle's winding
+        static constexpr uint32_t FlippedNg = 0x80000000u;
+
+        struct Entry {
+            uint32_t primitive = Miss;
+            float u = 0, v = 0;
+            float distance = 0;
+        };
+
+    private:
+        std::shared_ptr<Scene> scene;
+        std::shared_ptr<Camera> camera;
+        Point2i filmDimension;
+        int jitterCount;
+        std::vector<Point2f> jitters;
+        std::vector<Entry> entries;
+        // first primitive id of each scene mesh
+        std::vector<uint32_t> meshOffset;
+        std::unordered_map<const Mesh *, uint32_t> meshIndex;
+
+        [[nodiscard]] Entry encode(const Intersection &isct) const;
+
+    public:
+        PrimaryHitCache(const RenderSettings &settings, int jitterCount);
+
+        // traces every entry, returns false if cont() stopped it
+        bool build(const Task<RenderOutput>::ContFunc &cont);
+
+        // Camera sample and primary hit for sample sampleIndex of pixel p, returns false on a miss.
+        // Draws the same sampler dimensions as a generateRay() call so that later ones line up.
+        bool lookup(Sampler &sampler, const Point2i &p, uint32_t sampleIndex, CameraSample &sample,
+                    Intersection &isct) const;
+
+        [[nodiscard]] int getJitterCount() const { return jitterCount; }
+
+        [[nodiscard]] size_t memoryUsage() const { return entries.size() * sizeof(Entry); }
+    };
+
+    // A built cache, or nullptr if the camera has a lens or cont() stopped the build
+    std::shared_ptr<PrimaryHitCache> CreatePrimaryHitCache(const RenderSettings &settings, int jitterCount,
+                                                           const Task<RenderOutput>::ContFunc &cont);
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_PRIMARY_HIT_CACHE_H
@@ -0,0 +1,67 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "progressive.h"
+#include <miyuki.foundation/log.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace miyuki::core {
+    int ProgressiveSchedule::nextPass() {
+        int samples = std::min(passes == 0 ? 1 : 2 * current, spp - done);
+        if (timeBudget > 0 && passes > 0) {
+            auto fit = (timeBudget - elapsed()) / secondsPerSample;
+            samples = std::min<double>(samples, std::floor(std::max(0.0, fit)));
+        }
+        if (maxPassTime > 0 && passes > 0 && samples > 1) {
+            samples = std::min<double>(samples, std::max(1.0, std::floor(maxPassTime / secondsPerSample)));
+        }
+        current = std::max(0, samples);
+        passStart = elapsed();
+        return current;
+    }
+
+    void ProgressiveSchedule::endPass() {
+        auto seconds = elapsed() - passStart;
+        secondsPerSample = seconds / current;
+        done += current;
+        passes++;
+        log::log("Pass {}: {} spp in {:.3f}secs, {} spp in total\n", passes, current, seconds, done);
+    }
+
+    double ProgressiveSchedule::progress() const {
+        auto p = double(done) / spp;
+        if (timeBudget > 0) {
+            p = std::max(p, elapsed() / timeBudget);
+        }
+        return std::min(1.0, p);
+    }
+
+    void ProgressiveSchedule::report() const {
+        if (timeBudget > 0) {
+            log::log("Progressive: {} passes, {} of {} spp in {:.3f}secs, budget {:.3f}secs\n", passes, done, spp,
+                     elapsed(), timeBudget);
+        } else {
+            log::log("Progressive: {} passes, {} spp in {:.3f}secs\n", passes, done, elapsed());
+        }
+    }
+} // namespace miyuki::core
@@ -0,0 +1,69 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_PROGRESSIVE_H
+#define MIYUKIRENDERER_PROGRESSIVE_H
+
+#include <miyuki.foundation/profiler.h>
+
+namespace miyuki::core {
+    // Sample passes of doubling size up to spp. With a time budget (in seconds, from construction)
+    // a pass is cut down to what the time per sample of the previous pass says still fits, and
+    // the render stops once not even one sample per pixel does. The first pass always runs.
+    class ProgressiveSchedule {
+        Profiler profiler;
+        int spp;
+        double timeBudget;
+        int done = 0;
+        int current = 0;
+        int passes = 0;
+        double passStart = 0;
+        double secondsPerSample = 0;
+        double maxPassTime = 0;
+
+        [[nodiscard]] double elapsed() const { return profiler.elapsed<double>().count(); }
+
+    public:
+        ProgressiveSchedule(int spp, double timeBudget) : spp(spp), timeBudget(timeBudget) {}
+
+        // continue after the samples already in a restored film
+        void resume(int samples) { done = samples; }
+
+        // keeps passes (but at least one sample per pixel) under this many seconds, e.g. to checkpoint on time
+        void setMaxPassTime(double seconds) { maxPassTime = seconds; }
+
+        // samples per pixel of the next pass, 0 when rendering is done
+        int nextPass();
+
+        // call after every pass returned by nextPass()
+        void endPass();
+
+        // samples per pixel in the film so far, also the first sample index of the next pass
+        [[nodiscard]] int samplesDone() const { return done; }
+
+        [[nodiscard]] double progress() const;
+
+        void report() const;
+    };
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_PROGRESSIVE_H
@@ -0,0 +1,286 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_PT_KERNEL_H
+#define MIYUKIRENDERER_PT_KERNEL_H
+
+#include <miyuki.renderer/integrator.h>
+#include <miyuki.renderer/bsdf.h>
+#include <miyuki.renderer/light.h>
+#include <miyuki.renderer/lightdistribution.h>
+#include <miyuki.renderer/material.h>
+#include <miyuki.renderer/sampler.h>
+#include <miyuki.renderer/scene.h>
+#include <miyuki.renderer/shape.h>
+#include <miyuki.renderer/stat.hpp>
+#include <miyuki.foundation/film.h>
+#include <algorithm>
+
+namespace miyuki::core {
+
+    inline float MisWeight(float pdfA, float pdfB) {
+        pdfA *= pdfA;
+        pdfB *= pdfB;
+        return pdfA / (pdfA + pdfB);
+    }
+
+    // NEE samples waiting for their shadow ray. Visible ones go straight to the film,
+    // so a batch must be flushed before the film is read.
+    class ShadowRayBatch {
+        std::vector<Ray> rays;
+        std::vector<Point2i> pFilm;
+        std::vector<Spectrum> contribution;
+        std::vector<uint8_t> occluded;
+        Scene &scene;
+        Film &film;
+        const size_t batchSize;
+
+    public:
+        ShadowRayBatch(Scene &scene, Film &film, size_t batchSize) : scene(scene), film(film),
+                                                                     batchSize(batchSize) {}
+
+        void push(const Ray &ray, const Point2i &p, const Spectrum &c) {
+            rays.emplace_back(ray);
+            pFilm.emplace_back(p);
+            contribution.emplace_back(c);
+            if (rays.size() >= batchSize) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if (rays.empty()) {
+                return;
+            }
+            occluded.resize(rays.size());
+            scene.occlude(rays.data(), occluded.data(), rays.size());
+            for (size_t i = 0; i < rays.size(); i++) {
+                if (!occluded[i]) {
+                    film.addContribution(pFilm[i], RemoveNaN(clamp(contribution[i], Vec3f(0), Vec3f(1e16f))));
+                }
+            }
+            rays.clear();
+            pFilm.clear();
+            contribution.clear();
+        }
+    };
+
+    struct PathState {
+        Spectrum Li = Spectrum(0);
+        Spectrum beta = Spectrum(1);
+        Ray ray;
+        Intersection intersection, prevIntersection;
+        Float prevScatteringPdf = 0.0f;
+        int depth = 0;
+        bool specular = false;
+        // set to defer the path's shadow rays
+        ShadowRayBatch *shadowRays = nullptr;
+        Point2i pFilm;
+        bool hasDeferredLight = false;
+    };
+
+    // The path tracing estimator, one path vertex at a time. processVertex() runs a whole vertex so
+    // that paths can run to completion one by one or advance together with their bounce rays traced
+    // as a batch; its stages are public for integrators that run them over many paths at once.
+    class PathTracerKernel {
+        const RenderSettings &settings;
+        Scene *scene;
+        bool enableNEE;
+        int minDepth, maxDepth;
+        RatioCounter<size_t> &nonZeroPath;
+
+    public:
+        PathTracerKernel(const RenderSettings &settings, bool enableNEE, int minDepth, int maxDepth,
+                         RatioCounter<size_t> &nonZeroPath)
+                : settings(settings), scene(settings.scene.get()), enableNEE(enableNEE), minDepth(minDepth),
+                  maxDepth(maxDepth), nonZeroPath(nonZeroPath) {}
+
+        [[nodiscard]] Spectrum backgroundLi(const Ray &) const {
+            return Spectrum(0);
+        }
+
+        void miss(PathState &state) const {
+            state.Li += state.beta * backgroundLi(state.ray);
+        }
+
+        // emission reaching the path through ray at intersection, also fills sp;
+        // returns false if the path is too deep to scatter
+        bool beginVertex(PathState &state, const Ray &ray, const Intersection &intersection,
+                         ShadingPoint &sp) const {
+            sp.texCoord = intersection.shape->texCoordAt(intersection.uv);
+            sp.Ng = intersection.Ng;
+            sp.Ns = intersection.Ns;
+
+            if (intersection.material->emission && intersection.material->emissionStrength &&
+                dot(ray.d, intersection.Ng) < 0) {
+
+                auto light = intersection.light;
+                auto lightPdf = settings.lightDistribution->lightPdf(light);
+                if (!enableNEE || state.depth == 0 || !light || lightPdf <= 0.0f || state.specular) {
+                    state.Li += state.beta * intersection.material->emission->evaluate(sp)
+                                * intersection.material->emissionStrength->evaluate(sp);
+                } else {
+                    lightPdf *= light->pdfLi(state.prevIntersection, ray.d);
+                    auto weight = MisWeight(state.prevScatteringPdf, lightPdf);
+                    state.Li += state.beta * weight * intersection.material->emission->evaluate(sp)
+                                * intersection.material->emissionStrength->evaluate(sp);
+                }
+            }
+            return ++state.depth <= maxDepth;
+        }
+
+        // records a BSDF sample for MIS at the next vertex, false if it ends the path
+        bool acceptSample(PathState &state, const BSDFSample &bsdfSample) const {
+            MIYUKI_CHECK(!std::isnan(bsdfSample.pdf));
+            MIYUKI_CHECK(bsdfSample.pdf >= 0.0);
+            MIYUKI_CHECK(minComp(bsdfSample.f) >= 0.0f);
+            if (std::isnan(bsdfSample.pdf) || bsdfSample.pdf <= 0.0f) {
+                return false;
+            }
+            state.prevScatteringPdf = bsdfSample.pdf;
+            state.specular = (bsdfSample.sampledType & BSDF::ESpecular) != 0;
+            return true;
+        }
+
+        // Next event estimation, contribution counts only if shadowRay is unoccluded.
+        // Returns false if there is nothing to test.
+        bool sampleLight(const PathState &state, Intersection &intersection, const ShadingPoint &sp,
+                         const Vec3f &wo, Sampler &sampler, Ray &shadowRay, Spectrum &contribution) const {
+            if (!enableNEE) {
+                return false;
+            }
+            Float lightPdf = 0;
+            auto light = settings.lightDistribution->sampleLight(sampler, &lightPdf);
+            if (!light) {
+                return false;
+            }
+            BSDF *bsdf = intersection.material->bsdf.get();
+            LightSample lightSample;
+            VisibilityTester visibilityTester;
+            light->sampleLi(sampler.next2D(), intersection, lightSample, visibilityTester);
+            lightPdf *= lightSample.pdf;
+            auto wi = intersection.worldToLocal(lightSample.wi);
+            auto f = bsdf->evaluate(sp, wo, wi) * abs(dot(lightSample.wi, intersection.Ns));
+            if (lightPdf <= 0 || IsBlack(f)) {
+                return false;
+            }
+            contribution = state.beta * f * lightSample.Li / lightPdf;
+            if (!state.specular) {
+                auto scatteringPdf = bsdf->evaluatePdf(sp, wo, wi);
+                MIYUKI_CHECK(!std::isnan(scatteringPdf));
+                MIYUKI_CHECK(scatteringPdf > 0.0f);
+                contribution *= MisWeight(lightPdf, scatteringPdf);
+            }
+            shadowRay = visibilityTester.shadowRay;
+            return true;
+        }
+
+        // throughput and Russian roulette after scattering, false if the path ends
+        bool continuePath(PathState &state, const Intersection &intersection, const BSDFSample &bsdfSample,
+                          Sampler &sampler, Ray &next) const {
+            auto wiW = intersection.localToWorld(bsdfSample.wi);
+            state.beta *= bsdfSample.f * abs(dot(intersection.Ng, wiW)) / bsdfSample.pdf;
+            next = intersection.spawnRay(wiW);
+
+            if (state.depth > minDepth) {
+                auto p = std::min(1.0f, maxComp(state.beta)) * 0.95;
+                if (sampler.next1D() < p) {
+                    state.beta /= p;
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // shades state.intersection; returns true if the path continues along state.ray
+        bool processVertex(PathState &state, Sampler &sampler) const {
+            auto &intersection = state.intersection;
+            if (!intersection.material || !intersection.material->bsdf)
+                return false;
+            ShadingPoint sp;
+            if (!beginVertex(state, state.ray, intersection, sp)) {
+                return false;
+            }
+
+            BSDFSample bsdfSample;
+            bsdfSample.wo = intersection.worldToLocal(normalize(-1.0f * state.ray.d));
+            intersection.material->bsdf->sample(sampler.next2D(), sp, bsdfSample);
+            if (!acceptSample(state, bsdfSample)) {
+                return false;
+            }
+
+            Ray shadowRay;
+            Spectrum contribution;
+            if (sampleLight(state, intersection, sp, bsdfSample.wo, sampler, shadowRay, contribution)) {
+                if (state.shadowRays) {
+                    state.shadowRays->push(shadowRay, state.pFilm, contribution);
+                    state.hasDeferredLight = true;
+                } else if (!scene->occlude(shadowRay)) {
+                    state.Li += contribution;
+                }
+            }
+
+            if (!continuePath(state, intersection, bsdfSample, sampler, state.ray)) {
+                return false;
+            }
+            state.prevIntersection = intersection;
+            intersection = Intersection();
+            return true;
+        }
+
+        Spectrum finish(const PathState &state) const {
+            nonZeroPath.update(maxComp(state.Li) > 0 || state.hasDeferredLight);
+            MIYUKI_CHECK(minComp(state.Li) >= 0.0f);
+            return RemoveNaN(clamp(state.Li, Vec3f(0), Vec3f(1e16f)));
+        }
+
+        Spectrum Li(Sampler &sampler, const Ray &ray, ShadowRayBatch *shadowRays = nullptr,
+                    const Point2i &pFilm = Point2i()) const {
+            Intersection intersection;
+            scene->intersect(ray, intersection);
+            return Li(sampler, ray, intersection, shadowRays, pFilm);
+        }
+
+        // continues a camera ray whose hit is already known
+        Spectrum Li(Sampler &sampler, const Ray &ray, const Intersection &primary, ShadowRayBatch *shadowRays,
+                    const Point2i &pFilm) const {
+            PathState state;
+            state.ray = ray;
+            state.shadowRays = shadowRays;
+            state.pFilm = pFilm;
+            state.intersection = primary;
+            if (!primary.hit()) {
+                return backgroundLi(ray);
+            }
+            while (processVertex(state, sampler)) {
+                if (!scene->intersect(state.ray, state.intersection)) {
+                    miss(state);
+                    break;
+                }
+            }
+            return finish(state);
+        }
+    };
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_PT_KERNEL_H
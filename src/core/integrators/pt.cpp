@@ -21,6 +21,12 @@
 // SOFTWARE.
 
 #include "pt.h"
+#include "pt-kernel.h"
+#include "primary-hit-cache.h"
+#include "camera-packets.h"
+#include "adaptive-sampling.h"
+#include "progressive.h"
+#include "checkpoint.h"
 #include <miyuki.renderer/camera.h>
 #include <miyuki.foundation/film.h>
 #include <miyuki.foundation/log.hpp>
@@ -34,184 +40,354 @@
 #include <miyuki.renderer/progressreporter.h>
 #include <miyuki.foundation/arena.hpp>
 #include <miyuki.renderer/stat.hpp>
+#include <miyuki.foundation/algorithm.hpp>
+#include <miyuki.foundation/perfcounter.h>
+#include <algorithm>
 
 
 namespace miyuki::core {
 
-    static float MisWeight(float pdfA, float pdfB) {
-        pdfA *= pdfA;
-        pdfB *= pdfB;
-        return pdfA / (pdfA + pdfB);
+    static constexpr size_t ShadowRayBatchSize = 1024;
+
+    // Sort key of a bounce ray: direction octant, then the Morton code of its origin
+    static uint64_t CoherenceKey(const Ray &ray, const Bounds3f &sceneBound) {
+        uint32_t octant = (ray.d.x() < 0) | (ray.d.y() < 0) << 1u | (ray.d.z() < 0) << 2u;
+        auto p = sceneBound.offset(ray.o);
+        uint32_t q[3];
+        for (int i = 0; i < 3; i++) {
+            q[i] = std::clamp<int>(p[i] * 1024.0f, 0, 1023);
+        }
+        return uint64_t(octant) << 30u | EncodeMorton3(q[0], q[1], q[2]);
     }
 
-    static RenderOutput PathTracerRender(bool enableNEE, bool denoise, const Task<RenderSettings>::ContFunc &cont,
-                                         int spp, int minDepth, int maxDepth, const RenderSettings &settings,
+    // LLC misses and time spent tracing bounce rays, to compare the two tracing orders
+    struct TraceStatistics {
+        std::atomic<uint64_t> rays = 0, cacheMisses = 0, nanoseconds = 0;
+        // camera ray packets
+        std::atomic<uint64_t> primaryRays = 0, primaryNanoseconds = 0;
+    };
+
+    // Traces all pixels of a tile one sample at a time. Each bounce the surviving paths'
+    // rays are sorted for coherence and traced as one batch, then scattered back.
+    // The paths interleave, so every pixel needs a sampler of its own; samplers holds the
+    // calling worker's, it grows to the largest tile and is reseeded here.
+    // With packets set, camera rays are generated and traced 8 neighbouring pixels at a time.
+    static void RenderTileReordered(const PathTracerKernel &kernel, const RenderSettings &settings,
+                                    const Task<RenderSettings>::ContFunc &cont, const Bounds2i &tile,
+                                    int firstSample, int spp, Film &film, TraceStatistics &statistics,
+                                    ShadowRayBatch *shadowRays, const PrimaryHitCache *primaryHits, bool packets,
+                                    std::vector<std::shared_ptr<Sampler>> &samplers) {
+        auto *scene = settings.scene.get();
+        auto sceneBound = scene->getBoundingBox();
+        auto filmDimension = Point2i(film.width, film.height);
+        std::vector<Point2i> pixels;
+        for (int y = tile.pMin.y(); y < tile.pMax.y(); y++) {
+            for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
+                pixels.emplace_back(x, y);
+            }
+        }
+        const size_t n = pixels.size();
+        while (samplers.size() < n) {
+            samplers.emplace_back(settings.sampler->clone());
+        }
+        for (size_t i = 0; i < n; i++) {
+            samplers[i]->startPixel(pixels[i], filmDimension);
+            samplers[i]->startSample(firstSample);
+        }
+        std::vector<PathState> states(n);
+        std::vector<Point2f> pFilm(n);
+        std::vector<char> cameraMiss(n);
+        std::vector<uint32_t> active, next;
+        std::vector<uint64_t> keys;
+        std::vector<Ray> rays;
+        std::vector<Intersection> hits;
+        std::vector<CameraSample> cameraSamples(packets ? n : 0);
+        std::vector<Ray8> cameraPackets(packets ? (n + 7) / 8 : 0);
+        CacheMissCounter cacheMisses;
+        auto traceBatch = [&](const std::vector<uint32_t> &paths) {
+            rays.resize(paths.size());
+            hits.assign(paths.size(), Intersection());
+            for (size_t i = 0; i < paths.size(); i++) {
+                rays[i] = states[paths[i]].ray;
+            }
+            auto misses = cacheMisses.read();
+            Profiler profiler;
+            scene->intersect(rays.data(), hits.data(), rays.size());
+            statistics.nanoseconds += uint64_t(profiler.elapsed<double>().count() * 1e9);
+            statistics.cacheMisses += cacheMisses.read() - misses;
+            statistics.rays += rays.size();
+            for (size_t i = 0; i < paths.size(); i++) {
+                states[paths[i]].intersection = hits[i];
+            }
+        };
+        for (int s = firstSample; s < firstSample + spp && cont(); s++) {
+            active.clear();
+            for (size_t i = 0; i < n; i++) {
+                samplers[i]->startNextSample();
+            }
+            if (packets) {
+                GenerateCameraPackets(*settings.camera, filmDimension, pixels.data(), samplers.data(), n,
+                                      cameraSamples.data(), cameraPackets.data());
+            }
+            for (size_t i = 0; i < n; i++) {
+                CameraSample sample;
+                states[i] = PathState();
+                if (packets) {
+                    sample = cameraSamples[i];
+                } else if (primaryHits) {
+                    primaryHits->lookup(*samplers[i], pixels[i], s, sample, states[i].intersection);
+                } else {
+                    settings.camera->generateRay(samplers[i]->next2D(), samplers[i]->next2D(), pixels[i],
+                                                 filmDimension, sample);
+                }
+                states[i].ray = sample.ray;
+                states[i].shadowRays = shadowRays;
+                states[i].pFilm = sample.pFilm;
+                pFilm[i] = sample.pFilm;
+                cameraMiss[i] = false;
+                active.emplace_back(i);
+            }
+            // camera rays are coherent already
+            if (packets) {
+                hits.resize(n);
+                Profiler profiler;
+                IntersectCameraPackets(*scene, cameraPackets.data(), n, hits.data());
+                statistics.primaryNanoseconds += uint64_t(profiler.elapsed<double>().count() * 1e9);
+                statistics.primaryRays += n;
+                for (size_t i = 0; i < n; i++) {
+                    states[i].intersection = hits[i];
+                }
+            } else if (!primaryHits) {
+                traceBatch(active);
+            }
+            while (!active.empty()) {
+                next.clear();
+                for (auto i : active) {
+                    auto &state = states[i];
+                    if (!state.intersection.hit()) {
+                        if (state.depth == 0) {
+                            cameraMiss[i] = true;
+                            state.Li = kernel.backgroundLi(state.ray);
+                        } else {
+                            kernel.miss(state);
+                        }
+                    } else if (kernel.processVertex(state, *samplers[i])) {
+                        next.emplace_back(i);
+                    }
+                }
+                keys.resize(next.size());
+                for (size_t i = 0; i < next.size(); i++) {
+                    keys[i] = CoherenceKey(states[next[i]].ray, sceneBound) << 32u | next[i];
+                }
+                std::sort(keys.begin(), keys.end());
+                for (size_t i = 0; i < next.size(); i++) {
+                    next[i] = keys[i] & 0xffffffffu;
+                }
+                traceBatch(next);
+                std::swap(active, next);
+            }
+            for (size_t i = 0; i < n; i++) {
+                film.addSample(pFilm[i], cameraMiss[i] ? states[i].Li : kernel.finish(states[i]), 1);
+            }
+        }
+    }
+
+    struct PathTracerConfig {
+        int spp = 16;
+        int minDepth = 3;
+        int maxDepth = 5;
+        bool denoise = false;
+        bool enableNEE = true;
+        bool reorderRays = false;
+        bool deferShadowRays = false;
+        bool cachePrimaryHits = false;
+        int primaryHitJitters = 8;
+        bool primaryPackets = false;
+        bool adaptiveSampling = false;
+        float errorThreshold = 0.01f;
+        int samplesPerRound = 4;
+        std::string sppMapFile;
+        bool progressive = false;
+        float timeBudget = 0;
+    };
+
+    static RenderOutput PathTracerRender(PathTracerConfig config, const Task<RenderSettings>::ContFunc &cont,
+                                         const RenderSettings &settings,
                                          const mpsc::Sender<std::shared_ptr<Film>> &tx) {
         RatioCounter<size_t> nonZeroPath;
         auto *scene = settings.scene.get();
         scene->resetRayCounter();
         Profiler profiler;
+        ProgressiveSchedule schedule(config.spp, config.timeBudget);
+        RenderCheckpoint checkpoint(settings, "PathTracer");
         auto filmPtr = std::make_shared<Film>(settings.filmDimension);
         auto &film = *filmPtr;
-        log::log("Integrator: MIS Path Tracer, samples: {}\n", spp);
+        if (config.timeBudget > 0 || checkpoint.enabled()) {
+            config.progressive = true;
+        }
+        log::log("Integrator: MIS Path Tracer, samples: {}, ray reordering: {}, deferred shadow rays: {}, "
+                 "primary hit cache: {}, adaptive sampling: {}, progressive: {}\n", config.spp, config.reorderRays,
+                 config.deferShadowRays, config.cachePrimaryHits, config.adaptiveSampling, config.progressive);
+        if (config.adaptiveSampling && config.deferShadowRays) {
+            log::log("Deferred shadow rays bypass the variance estimate, not deferring them\n");
+            config.deferShadowRays = false;
+        }
+        if (config.adaptiveSampling && config.progressive) {
+            log::log("Adaptive sampling has its own rounds, ignoring progressive mode and the time budget\n");
+            config.progressive = false;
+        }
+        if (config.adaptiveSampling && checkpoint.enabled()) {
+            log::log("Checkpoints need whole-image passes, not writing them with adaptive sampling\n");
+            checkpoint.disable();
+        }
+        if (config.primaryPackets && !config.reorderRays) {
+            log::log("Camera packets need ray reordering, tracing camera rays one at a time\n");
+            config.primaryPackets = false;
+        }
+        std::shared_ptr<PrimaryHitCache> primaryHits;
+        if (config.cachePrimaryHits) {
+            primaryHits = CreatePrimaryHitCache(settings, config.primaryHitJitters, cont);
+        }
+        if (primaryHits) {
+            config.primaryPackets = false;
+        }
+
+        PathTracerKernel kernel(settings, config.enableNEE, config.minDepth, config.maxDepth, nonZeroPath);
+        TraceStatistics statistics;
 
-        auto backgroundLi = [=](const Ray &ray) -> Spectrum {
-            return Spectrum(0);
+        // per worker thread, reseeded for every pixel
+        struct WorkerSamplers {
+            std::shared_ptr<Sampler> pixel;
+            std::vector<std::shared_ptr<Sampler>> tile;
         };
+        std::vector<WorkerSamplers> workerSamplers(GetCoreNumber());
+        for (auto &i : workerSamplers) {
+            i.pixel = settings.sampler->clone();
+        }
 
-        auto Li = [=, &nonZeroPath](Sampler &sampler, Ray ray) -> Spectrum {
-            Spectrum Li(0);
-            Spectrum beta(1);
-            bool specular = false;
-            Intersection intersection, prevIntersection;
-            if (!scene->intersect(ray, intersection)) {
-                return backgroundLi(ray);
+        // samples [firstSample, firstSample + spp) of every pixel in the tile
+        auto renderTile = [=, &film, &kernel, &statistics, &workerSamplers](const Bounds2i &tile, int firstSample,
+                                                                            int spp, size_t threadIdx) {
+            ShadowRayBatch batch(*scene, film, ShadowRayBatchSize);
+            auto *shadowRays = config.deferShadowRays ? &batch : nullptr;
+            if (config.reorderRays) {
+                RenderTileReordered(kernel, settings, cont, tile, firstSample, spp, film, statistics, shadowRays,
+                                    primaryHits.get(), config.primaryPackets, workerSamplers[threadIdx].tile);
+                batch.flush();
+                settings.publishTile(film, tile);
+                return;
             }
-            Float prevScatteringPdf = 0.0f;
-            int depth = 0;
-            while (true) {
-
-                if (!intersection.material)
-                    break;
-                BSDF *bsdf = intersection.material->bsdf.get();
-                if (!bsdf)break;
-
-                Vec3f wo = intersection.worldToLocal(normalize(-1.0f * ray.d));
-                ShadingPoint sp;
-                sp.texCoord = intersection.shape->texCoordAt(intersection.uv);
-                sp.Ng = intersection.Ng;
-                sp.Ns = intersection.Ns;
-
-                if (intersection.material->emission && intersection.material->emissionStrength &&
-                    dot(ray.d, intersection.Ng) < 0) {
-
-                    auto light = intersection.shape->light;
-                    auto lightPdf = settings.lightDistribution->lightPdf(light);
-                    if (!enableNEE || depth == 0 || !light || lightPdf <= 0.0f || specular) {
-                        Li += beta * intersection.material->emission->evaluate(sp)
-                              * intersection.material->emissionStrength->evaluate(sp);
-                    } else {
-                        lightPdf *= light->pdfLi(prevIntersection, ray.d);
-                        auto weight = MisWeight(prevScatteringPdf, lightPdf);
-                        Li += beta * weight * intersection.material->emission->evaluate(sp)
-                              * intersection.material->emissionStrength->evaluate(sp);
-                    }
-                }
-                if (++depth > maxDepth) {
-                    break;
-                }
-
-
-                BSDFSample bsdfSample;
-                // BSDF Sampling
-                {
-
-                    bsdfSample.wo = wo;
-                    bsdf->sample(sampler.next2D(), sp, bsdfSample);
-                    MIYUKI_CHECK(!std::isnan(bsdfSample.pdf));
-                    MIYUKI_CHECK(bsdfSample.pdf >= 0.0);
-                    MIYUKI_CHECK(minComp(bsdfSample.f) >= 0.0f);
-                    if (std::isnan(bsdfSample.pdf) || bsdfSample.pdf <= 0.0f) {
-                        break;
-                    }
-                    prevScatteringPdf = bsdfSample.pdf;
-                    specular = (bsdfSample.sampledType & BSDF::ESpecular) != 0;
-                }
-
-                // Light Sampling
-                if (enableNEE) {
-                    Float lightPdf = 0;
-                    auto light = settings.lightDistribution->sampleLight(sampler, &lightPdf);
-                    if (light) {
-                        LightSample lightSample;
-                        VisibilityTester visibilityTester;
-                        light->sampleLi(sampler.next2D(), intersection, lightSample, visibilityTester);
-                        lightPdf *= lightSample.pdf;
-                        auto f = bsdf->evaluate(sp, wo, intersection.worldToLocal(lightSample.wi)) *
-                                 abs(dot(lightSample.wi, intersection.Ns));
-
-                        if (lightPdf > 0 && !IsBlack(f) && visibilityTester.visible(*scene)) {
-
-                            if (specular) {
-                                Li += beta * f * lightSample.Li / lightPdf;
-                            } else {
-                                auto scatteringPdf = bsdf->evaluatePdf(sp, wo,
-                                                                       intersection.worldToLocal(lightSample.wi));
-                                MIYUKI_CHECK(!std::isnan(scatteringPdf));
-                                MIYUKI_CHECK(scatteringPdf > 0.0f);
-                                auto weight = MisWeight(lightPdf, scatteringPdf);
-                                Li += beta * f * lightSample.Li / lightPdf * weight;
-                            }
+            auto &sampler = workerSamplers[threadIdx].pixel;
+            for (int y = tile.pMin.y(); cont() && y < tile.pMax.y(); y++) {
+                for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
+                    sampler->startPixel(Point2i(x, y), Point2i(film.width, film.height));
+                    sampler->startSample(firstSample);
+                    for (int s = firstSample; s < firstSample + spp && cont(); s++) {
+                        CameraSample sample;
+                        sampler->startNextSample();
+                        if (primaryHits) {
+                            Intersection primary;
+                            primaryHits->lookup(*sampler, Point2i(x, y), s, sample, primary);
+                            film.addSample(sample.pFilm,
+                                           kernel.Li(*sampler, sample.ray, primary, shadowRays, sample.pFilm), 1);
+                        } else {
+                            settings.camera->generateRay(sampler->next2D(), sampler->next2D(), Point2i(x, y),
+                                                         Point2i(film.width, film.height), sample);
+                            film.addSample(sample.pFilm,
+                                           kernel.Li(*sampler, sample.ray, shadowRays, sample.pFilm), 1);
                         }
                     }
                 }
-
-                auto wiW = intersection.localToWorld(bsdfSample.wi);
-                beta *= bsdfSample.f * abs(dot(intersection.Ng, wiW)) / bsdfSample.pdf;
-                ray = intersection.spawnRay(wiW);
-
-                if (depth > minDepth) {
-                    auto p = std::min(1.0f, maxComp(beta)) * 0.95;
-                    if (sampler.next1D() < p) {
-                        beta /= p;
-                    } else {
-                        break;
-                    }
-                }
-
-                prevIntersection = intersection;
-                intersection = Intersection();
-                if (!scene->intersect(ray, intersection)) {
-                    Li += beta * backgroundLi(ray);
-                    break;
-                }
-
             }
-            nonZeroPath.update(maxComp(Li) > 0);
-            MIYUKI_CHECK(minComp(Li) >= 0.0f);
-            return RemoveNaN(clamp(Li, Vec3f(0), Vec3f(1e16f)));
+            batch.flush();
+            settings.publishTile(film, tile);
         };
 
         const size_t tileSize = 64;
         std::vector<Bounds2i> tiles;
-        for (int i = 0; i < film.width; i += tileSize) {
-            for (int j = 0; j < film.height; j += tileSize) {
+        for (int i = 0; i < int(film.width); i += tileSize) {
+            for (int j = 0; j < int(film.height); j += tileSize) {
                 tiles.push_back({Vec2i(i, j), min(Vec2i(film.width, film.height), Vec2i(i + tileSize, j + tileSize))});
             }
         }
 
-        std::mutex _reporterMutex;
-        ProgressReporter reporter(tiles.size(), [=, &_reporterMutex](size_t cur, size_t total) {
-            std::unique_lock<std::mutex> lock(_reporterMutex, std::try_to_lock);
-            if (lock.owns_lock()) {
-                PrintProgressBar(double(cur) / total);
+        std::unique_ptr<AdaptiveSampling> adaptive;
+        if (config.adaptiveSampling) {
+            adaptive = std::make_unique<AdaptiveSampling>(settings.filmDimension, config.spp, config.errorThreshold,
+                                                          config.samplesPerRound);
+            while (cont() && adaptive->nextRound(film)) {
+                auto &blocks = adaptive->activeBlocks();
+                ParallelFor(0, blocks.size(), [&](int64_t i, uint64_t threadIdx) {
+                    renderTile(adaptive->block(blocks[i]), adaptive->firstSample(blocks[i]),
+                               adaptive->samplesThisRound(), threadIdx);
+                });
+                settings.reportProgress(adaptive->progress(), adaptive->progress() * config.spp);
+                PrintProgressBar(adaptive->progress());
             }
-        });
-        ParallelFor(0, tiles.size(), [=, &tiles, &film, &reporter](int64_t i, uint64_t) {
-            auto sampler = settings.sampler->clone();
-            auto &tile = tiles[i];
-            for (int y = tile.pMin.y(); cont() && y < tile.pMax.y(); y++) {
-                for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
-                    sampler->startPixel(Point2i(x, y), Point2i(film.width, film.height));
-                    for (int s = 0; s < spp && cont(); s++) {
-                        CameraSample sample;
-                        sampler->startNextSample();
-                        settings.camera->generateRay(sampler->next2D(), sampler->next2D(), Point2i(x, y),
-                                                     Point2i(film.width, film.height), sample);
-                        film.addSample(sample.pFilm, Li(*sampler, sample.ray), 1);
-                    }
+        } else if (config.progressive) {
+            schedule.resume(checkpoint.resume(film));
+            if (checkpoint.enabled()) {
+                schedule.setMaxPassTime(checkpoint.getInterval());
+            }
+            for (int samples; cont() && (samples = schedule.nextPass()) > 0;) {
+                if (schedule.samplesDone() > 0 && tx.connected()) {
+                    tx.send(std::make_shared<Film>(film));
+                }
+                ParallelFor(0, tiles.size(), [&](int64_t i, uint64_t threadIdx) {
+                    renderTile(tiles[i], schedule.samplesDone(), samples, threadIdx);
+                });
+                if (!cont()) {
+                    break;
                 }
+                schedule.endPass();
+                checkpoint.update(film, schedule.samplesDone());
+                settings.reportProgress(schedule.progress(), schedule.samplesDone());
+                PrintProgressBar(schedule.progress());
             }
-            reporter.update();
-        });
+            if (cont()) {
+                checkpoint.update(film, schedule.samplesDone(), {}, true);
+            }
+        } else {
+            std::mutex _reporterMutex;
+            ProgressReporter reporter(tiles.size(), [=, &_reporterMutex, &settings](size_t cur, size_t total) {
+                settings.reportProgress(double(cur + 1) / total, double(config.spp) * (cur + 1) / total);
+                std::unique_lock<std::mutex> lock(_reporterMutex, std::try_to_lock);
+                if (lock.owns_lock()) {
+                    PrintProgressBar(double(cur) / total);
+                }
+            });
+            ParallelFor(0, tiles.size(), [&](int64_t i, uint64_t threadIdx) {
+                renderTile(tiles[i], 0, config.spp, threadIdx);
+                reporter.update();
+            });
+        }
         if (!cont()) {
             return {};
         }
         auto duration = profiler.elapsed<double>();
         log::log("Rendering done in {}secs, traced {} rays, {} M rays/sec, non-zero paths: {:.4f}%\n", duration.count(), scene->getRayCounter(),
                  scene->getRayCounter() / duration.count() / 1e6f, nonZeroPath.ratio() *100);
+        if (config.progressive) {
+            schedule.report();
+        }
+        if (adaptive) {
+            adaptive->report(film, duration.count());
+            if (!config.sppMapFile.empty()) {
+                AdaptiveSampling::WriteSppMap(film, config.sppMapFile);
+            }
+        }
+        if (config.reorderRays && statistics.rays > 0) {
+            log::log("Batched tracing: {} rays, {:.3f} M rays/sec, LLC misses/ray: {}\n", statistics.rays,
+                     statistics.rays / (statistics.nanoseconds * 1e-9) / 1e6,
+                     statistics.cacheMisses > 0 ? fmt::format("{:.2f}", double(statistics.cacheMisses) / statistics.rays)
+                                                : std::string("n/a"));
+        }
+        if (statistics.primaryRays > 0) {
+            log::log("Primary rays: {}, {:.3f} M rays/sec per thread\n", statistics.primaryRays,
+                     statistics.primaryRays / (statistics.primaryNanoseconds * 1e-9) / 1e6);
+        }
         tx.send(std::shared_ptr<Film>(filmPtr));
-        if (denoise) {
+        if (config.denoise) {
 //            auto denoiser = std::dynamic_pointer_cast<Denoiser>(CreateObject("OIDNDenoiser"));
 //            RGBAImage image(ivec2(0));
 //            denoiser->denoise(film, image);
@@ -222,7 +398,24 @@ namespace miyuki::core {
     Task<RenderOutput>
     core::PathTracer::createRenderTask(const RenderSettings &settings, const mpsc::Sender<std::shared_ptr<Film>> &tx) {
         return Task<RenderOutput>([=, &tx](const Task<RenderSettings>::ContFunc &func) {
-            return PathTracerRender(enableNEE, denoise, func, spp, minDepth, maxDepth, settings, tx);
+            PathTracerConfig config;
+            config.spp = spp;
+            config.minDepth = minDepth;
+            config.maxDepth = maxDepth;
+            config.denoise = denoise;
+            config.enableNEE = enableNEE;
+            config.reorderRays = reorderRays;
+            config.deferShadowRays = deferShadowRays;
+            config.cachePrimaryHits = cachePrimaryHits;
+            config.primaryHitJitters = primaryHitJitters;
+            config.primaryPackets = primaryPackets;
+            config.adaptiveSampling = adaptiveSampling;
+            config.errorThreshold = errorThreshold;
+            config.samplesPerRound = samplesPerRound;
+            config.sppMapFile = sppMapFile;
+            config.progressive = progressive;
+            config.timeBudget = timeBudget;
+            return PathTracerRender(config, func, settings, tx);
         });
     }
 
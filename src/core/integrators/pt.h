@@ -36,10 +36,32 @@ namespace miyuki::core {
         int maxDepth = 5;
         bool denoise = false;
         bool enableNEE = true;
+        // advances all paths of a tile together and traces their bounce rays sorted for coherence
+        bool reorderRays = false;
+        // queues NEE shadow rays and tests them in batches, adding only visible contributions
+        bool deferShadowRays = false;
+        // traces camera rays once for a fixed set of jitters per pixel and reuses the hits
+        bool cachePrimaryHits = false;
+        int primaryHitJitters = 8;
+        // with reorderRays, generates and traces camera rays as packets of 8 neighbouring pixels
+        bool primaryPackets = false;
+        // samples in rounds, only blocks whose relative error is above errorThreshold get more,
+        // within a budget of spp per pixel on average
+        bool adaptiveSampling = false;
+        float errorThreshold = 0.01f;
+        int samplesPerRound = 4;
+        // written after an adaptive render if set
+        std::string sppMapFile;
+        // renders in passes of doubling spp and sends the film after each one
+        bool progressive = false;
+        // wall-clock seconds for the whole render, 0 for none; implies progressive
+        float timeBudget = 0;
     public:
         MYK_DECL_CLASS(PathTracer, "PathTracer", interface = "Integrator");
 
-        MYK_SER(spp, minDepth, maxDepth, denoise, enableNEE)
+        MYK_SER(spp, minDepth, maxDepth, denoise, enableNEE, reorderRays, deferShadowRays, cachePrimaryHits,
+                primaryHitJitters, primaryPackets, adaptiveSampling, errorThreshold, samplesPerRound, sppMapFile,
+                progressive, timeBudget)
 
 
         Task<RenderOutput>
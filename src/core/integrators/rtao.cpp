@@ -21,6 +21,10 @@
 // SOFTWARE.
 
 #include "rtao.h"
+#include "primary-hit-cache.h"
+#include "camera-packets.h"
+#include "progressive.h"
+#include "checkpoint.h"
 #include <miyuki.renderer/camera.h>
 #include <miyuki.foundation/film.h>
 #include <miyuki.foundation/log.hpp>
@@ -31,62 +35,160 @@
 #include <miyuki.renderer/scene.h>
 
 namespace miyuki::core {
-    RenderOutput RTAO::render(const miyuki::Task<void>::ContFunc &cont, const RenderSettings &settings,
+    RenderOutput RTAO::render(const miyuki::Task<RenderOutput>::ContFunc &cont, const RenderSettings &settings,
                               const mpsc::Sender<std::shared_ptr<Film>> &tx) {
         auto *scene = settings.scene.get();
         scene->resetRayCounter();
         Profiler profiler;
+        ProgressiveSchedule schedule(spp, timeBudget);
+        RenderCheckpoint checkpoint(settings, "RTAO");
+        const bool progressiveMode = progressive || timeBudget > 0 || checkpoint.enabled();
         auto filmPtr = std::make_shared<Film>(settings.filmDimension);
         auto &film = *filmPtr;
-        log::log("Integrator: RTAO, samples: {}\n", spp);
-        ParallelFor(0, film.height, [=, &film](int64_t j, uint64_t) {
-            auto sampler = settings.sampler->clone();
-            for (int i = 0; i < film.width && cont(); i++) {
+        log::log("Integrator: RTAO, samples: {}, primary hit cache: {}, primary packets: {}, progressive: {}\n", spp,
+                 cachePrimaryHits, primaryPackets, progressiveMode);
+        std::shared_ptr<PrimaryHitCache> primaryHits;
+        if (cachePrimaryHits) {
+            primaryHits = CreatePrimaryHitCache(settings, primaryHitJitters, cont);
+        }
+        const bool packets = primaryPackets && !primaryHits;
+        // 8 per worker thread, one for each lane of a packet
+        std::vector<std::vector<std::shared_ptr<Sampler>>> laneSamplers(packets ? GetCoreNumber() : 0);
+        for (auto &samplers : laneSamplers) {
+            for (int l = 0; l < 8; l++) {
+                samplers.emplace_back(settings.sampler->clone());
+            }
+        }
+        std::atomic<uint64_t> primaryRays = 0, primaryNanoseconds = 0;
+        auto occlusion = [=](Sampler &sampler, Intersection &isct) {
+            auto wo = isct.worldToLocal(isct.wo);
+            auto w = CosineHemisphereSampling(sampler.next2D());
+            if (wo.y() * w.y() < 0) {
+                w = -1.0f * w;
+            }
+            w = isct.localToWorld(w);
+            auto ray = isct.spawnRay(w);
+            ray.tMax = occludeDistance;
+            isct = Intersection();
+            if (!scene->intersect(ray, isct) || isct.distance >= occludeDistance) {
+                return Spectrum(1);
+            }
+            return Spectrum(0);
+        };
+        // samples [firstSample, firstSample + nSamples) of row j, 8 pixels at a time
+        auto renderRowPackets = [=, &film, &laneSamplers, &primaryRays, &primaryNanoseconds](
+                int64_t j, uint64_t threadIdx, int firstSample, int nSamples) {
+            auto filmDimension = Point2i(film.width, film.height);
+            auto &samplers = laneSamplers[threadIdx];
+            for (int i0 = 0; i0 < int(film.width) && cont(); i0 += 8) {
+                const size_t n = std::min<int>(8, int(film.width) - i0);
+                Point2i pixels[8];
+                for (size_t l = 0; l < n; l++) {
+                    pixels[l] = Point2i(i0 + int(l), int(j));
+                    samplers[l]->startPixel(pixels[l], filmDimension);
+                    samplers[l]->startSample(firstSample);
+                }
+                for (int s = firstSample; s < firstSample + nSamples && cont(); s++) {
+                    CameraSample samples[8];
+                    Ray8 packet;
+                    Intersection hits[8];
+                    for (size_t l = 0; l < n; l++) {
+                        samplers[l]->startNextSample();
+                    }
+                    GenerateCameraPackets(*settings.camera, filmDimension, pixels, samplers.data(), n, samples,
+                                          &packet);
+                    Profiler primary;
+                    IntersectCameraPackets(*scene, &packet, n, hits);
+                    primaryNanoseconds += uint64_t(primary.elapsed<double>().count() * 1e9);
+                    primaryRays += n;
+                    for (size_t l = 0; l < n; l++) {
+                        film.addSample(samples[l].pFilm,
+                                       hits[l].hit() ? occlusion(*samplers[l], hits[l]) : Spectrum(0), 1);
+                    }
+                }
+            }
+        };
+        // samples [firstSample, firstSample + nSamples) of every pixel
+        // rows are too thin to publish one by one, the whole film is published after the pass
+        auto renderPass = [=, &film](int firstSample, int nSamples) {
+            ParallelFor(0, film.height, [=, &film](int64_t j, uint64_t threadIdx) {
+                if (packets) {
+                    renderRowPackets(j, threadIdx, firstSample, nSamples);
+                    return;
+                }
+                auto sampler = settings.sampler->clone();
+                for (int i = 0; i < int(film.width) && cont(); i++) {
 
-                sampler->startPixel(Point2i(i, j), Point2i(film.width, film.height));
-                for (int s = 0; s < spp && cont(); s++) {
-                    CameraSample sample;
-                    sampler->startNextSample();
-                    settings.camera->generateRay(sampler->next2D(), sampler->next2D(), Point2i(i, j),
-                                                 Point2i(film.width, film.height), sample);
-                    //  film.addSample(sample.pFilm,sample.ray.d, 1);
-                    // log::log("{} {} {}\n",sample.ray.o.x(),sample.ray.o.y(),sample.ray.o.z());
-                    Intersection isct;
-                    if (scene->intersect(sample.ray, isct)) {
+                    sampler->startPixel(Point2i(i, j), Point2i(film.width, film.height));
+                    sampler->startSample(firstSample);
+                    for (int s = firstSample; s < firstSample + nSamples && cont(); s++) {
+                        CameraSample sample;
+                        sampler->startNextSample();
+                        Intersection isct;
+                        bool hit;
+                        if (primaryHits) {
+                            hit = primaryHits->lookup(*sampler, Point2i(i, j), s, sample, isct);
+                        } else {
+                            settings.camera->generateRay(sampler->next2D(), sampler->next2D(), Point2i(i, j),
+                                                         Point2i(film.width, film.height), sample);
+                            //  film.addSample(sample.pFilm,sample.ray.d, 1);
+                            // log::log("{} {} {}\n",sample.ray.o.x(),sample.ray.o.y(),sample.ray.o.z());
+                            hit = scene->intersect(sample.ray, isct);
+                        }
+                        if (hit) {
 //                        auto tex = isct.shape->texCoordAt(isct.uv);
 //                        film.addSample(sample.pFilm, isct.Ng, 1);
-                        auto wo = isct.worldToLocal(isct.wo);
-                        auto w = CosineHemisphereSampling(sampler->next2D());
-                        if (wo.y() * w.y() < 0) {
-                            w = -1.0f * w;
-                        }
-                        w = isct.localToWorld(w);
-                        auto ray = isct.spawnRay(w);
-                        ray.tMax = occludeDistance;
-                        isct = Intersection();
-                        if (!scene->intersect(ray, isct) || isct.distance >= occludeDistance) {
-                            film.addSample(sample.pFilm, Spectrum(1), 1);
+                            film.addSample(sample.pFilm, occlusion(*sampler, isct), 1);
                         } else {
                             film.addSample(sample.pFilm, Spectrum(0), 1);
                         }
-                    } else {
-                        film.addSample(sample.pFilm, Spectrum(0), 1);
                     }
                 }
+            });
+            settings.publishTile(film, Bounds2i{Vec2i(0, 0), Vec2i(film.width, film.height)});
+        };
+        if (progressiveMode) {
+            schedule.resume(checkpoint.resume(film));
+            if (checkpoint.enabled()) {
+                schedule.setMaxPassTime(checkpoint.getInterval());
             }
-        });
+            for (int samples; cont() && (samples = schedule.nextPass()) > 0;) {
+                if (schedule.samplesDone() > 0 && tx.connected()) {
+                    tx.send(std::make_shared<Film>(film));
+                }
+                renderPass(schedule.samplesDone(), samples);
+                if (!cont()) {
+                    break;
+                }
+                schedule.endPass();
+                checkpoint.update(film, schedule.samplesDone());
+                settings.reportProgress(schedule.progress(), schedule.samplesDone());
+            }
+            if (cont()) {
+                checkpoint.update(film, schedule.samplesDone(), {}, true);
+            }
+        } else {
+            renderPass(0, spp);
+        }
         if (!cont()) {
             return {};
         }
         auto duration = profiler.elapsed<double>();
         log::log("Rendering done in {}secs, traced {} rays, {} M rays/sec\n", duration.count(), scene->getRayCounter(),
                  scene->getRayCounter() / duration.count() / 1e6f);
+        if (packets) {
+            log::log("Primary rays: {}, {:.3f} M rays/sec per thread\n", primaryRays,
+                     primaryRays / (primaryNanoseconds * 1e-9) / 1e6);
+        }
+        if (progressiveMode) {
+            schedule.report();
+        }
         tx.send(std::shared_ptr<Film>(filmPtr));
         return RenderOutput{filmPtr};
     }
 
     Task<RenderOutput> RTAO::createRenderTask(const RenderSettings &settings,const  mpsc::Sender<std::shared_ptr<Film>>& tx) {
-        return Task<RenderOutput>([=](const Task<void>::ContFunc &cont) {
+        return Task<RenderOutput>([=](const Task<RenderOutput>::ContFunc &cont) {
             return render(cont, settings, tx);
         });
     }
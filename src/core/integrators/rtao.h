@@ -30,14 +30,23 @@ namespace miyuki::core {
     class RTAO final : public Integrator {
         int spp;
         float occludeDistance = 100000;
+        // traces camera rays once for a fixed set of jitters per pixel and reuses the hits
+        bool cachePrimaryHits = false;
+        int primaryHitJitters = 8;
+        // generates and traces camera rays as packets of 8 neighbouring pixels
+        bool primaryPackets = false;
+        // renders in passes of doubling spp and sends the film after each one
+        bool progressive = false;
+        // wall-clock seconds for the whole render, 0 for none; implies progressive
+        float timeBudget = 0;
 
         RenderOutput render(
-                const Task<void>::ContFunc &, const RenderSettings &settings,const mpsc::Sender<std::shared_ptr<Film>>& tx);
+                const Task<RenderOutput>::ContFunc &, const RenderSettings &settings,const mpsc::Sender<std::shared_ptr<Film>>& tx);
 
     public:
         MYK_DECL_CLASS(RTAO, "RTAO", interface = "Integrator");
 
-        MYK_SER(spp, occludeDistance)
+        MYK_SER(spp, occludeDistance, cachePrimaryHits, primaryHitJitters, primaryPackets, progressive, timeBudget)
 
         virtual Task<RenderOutput> createRenderTask(const RenderSettings &settings,const mpsc::Sender<std::shared_ptr<Film>>& tx) override;
     };
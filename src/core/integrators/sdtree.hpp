@@ -32,9 +32,20 @@
 #include <miyuki.foundation/rng.h>
 #include <miyuki.renderer/sampler.h>
 #include <stack>
+#include <iostream>
 
 
 namespace miyuki::core {
+    template<class T>
+    void SaveTreeField(std::ostream &out, const T &v) {
+        out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+    }
+
+    template<class T>
+    void LoadTreeField(std::istream &in, T &v) {
+        in.read(reinterpret_cast<char *>(&v), sizeof(T));
+    }
+
     class QTreeNode {
     public:
 
@@ -191,6 +202,22 @@ namespace miyuki::core {
                 c->deposit((p - offset(idx)) * 2.0f, e, nodes);
             }
         }
+
+        void save(std::ostream &out) const {
+            for (int i = 0; i < 4; i++) {
+                SaveTreeField(out, _sum[i].value());
+            }
+            SaveTreeField(out, _children);
+        }
+
+        void load(std::istream &in) {
+            for (int i = 0; i < 4; i++) {
+                Float v;
+                LoadTreeField(in, v);
+                _sum[i].set(v);
+            }
+            LoadTreeField(in, _children);
+        }
     };
 
     static Vec3f canonicalToDir(const Point2f &p) {
@@ -329,6 +356,29 @@ namespace miyuki::core {
             sum.add(e);
             nodes[0].deposit(p, e, nodes);
         }
+
+        void save(std::ostream &out) const {
+            SaveTreeField(out, sum.value());
+            SaveTreeField(out, weight.value());
+            SaveTreeField(out, uint64_t(nodes.size()));
+            for (auto &i : nodes) {
+                i.save(out);
+            }
+        }
+
+        void load(std::istream &in) {
+            Float v;
+            LoadTreeField(in, v);
+            sum.set(v);
+            LoadTreeField(in, v);
+            weight.set(v);
+            uint64_t n = 0;
+            LoadTreeField(in, n);
+            nodes.resize(n);
+            for (auto &i : nodes) {
+                i.load(in);
+            }
+        }
     };
 
     class DTreeWrapper {
@@ -367,6 +417,18 @@ namespace miyuki::core {
             building.refine(sampling, 0.01);
 
         }
+
+        void save(std::ostream &out) const {
+            SaveTreeField(out, valid);
+            building.save(out);
+            sampling.save(out);
+        }
+
+        void load(std::istream &in) {
+            LoadTreeField(in, valid);
+            building.load(in);
+            sampling.load(in);
+        }
     };
 
     class STreeNode {
@@ -460,6 +522,24 @@ namespace miyuki::core {
                 }
             }
         }
+
+        void save(std::ostream &out) const {
+            SaveTreeField(out, int(nSample));
+            SaveTreeField(out, _children);
+            SaveTreeField(out, axis);
+            SaveTreeField(out, _isLeaf);
+            dTree.save(out);
+        }
+
+        void load(std::istream &in) {
+            int n = 0;
+            LoadTreeField(in, n);
+            nSample = n;
+            LoadTreeField(in, _children);
+            LoadTreeField(in, axis);
+            LoadTreeField(in, _isLeaf);
+            dTree.load(in);
+        }
     };
 
     class STree {
@@ -534,6 +614,25 @@ namespace miyuki::core {
                 i.nSample = 0;
             }
         }
+
+        // binary, for checkpoints of the same build
+        void save(std::ostream &out) const {
+            SaveTreeField(out, box);
+            SaveTreeField(out, uint64_t(nodes.size()));
+            for (auto &i : nodes) {
+                i.save(out);
+            }
+        }
+
+        void load(std::istream &in) {
+            LoadTreeField(in, box);
+            uint64_t n = 0;
+            LoadTreeField(in, n);
+            nodes.resize(n);
+            for (auto &i : nodes) {
+                i.load(in);
+            }
+        }
     };
 }
 #endif //MIYUKIRENDERER_SDTREE_HPP
@@ -0,0 +1,418 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "wavefront-pt.h"
+#include "pt-kernel.h"
+#include "camera-packets.h"
+#include <miyuki.renderer/camera.h>
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/parallel.h>
+#include <miyuki.foundation/profiler.h>
+#include <miyuki.renderer/sampler.h>
+#include <miyuki.renderer/scene.h>
+#include <miyuki.renderer/lightdistribution.h>
+#include <miyuki.renderer/progressreporter.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace miyuki::core {
+
+    // Rays of the current bounce, rays[i] extends path[i]
+    struct RayQueue {
+        std::vector<Ray> rays;
+        std::vector<uint32_t> path;
+
+        void clear() {
+            rays.clear();
+            path.clear();
+        }
+
+        void push(const Ray &ray, uint32_t p) {
+            rays.emplace_back(ray);
+            path.emplace_back(p);
+        }
+
+        [[nodiscard]] size_t size() const { return rays.size(); }
+    };
+
+    // Light samples whose contribution is added only if their shadow ray is unoccluded
+    struct ShadowRayQueue {
+        std::vector<Ray> rays;
+        std::vector<uint32_t> path;
+        std::vector<Spectrum> contribution;
+        std::vector<uint8_t> occluded;
+
+        void clear() {
+            rays.clear();
+            path.clear();
+            contribution.clear();
+        }
+
+        void push(const Ray &ray, uint32_t p, const Spectrum &c) {
+            rays.emplace_back(ray);
+            path.emplace_back(p);
+            contribution.emplace_back(c);
+        }
+
+        [[nodiscard]] size_t size() const { return rays.size(); }
+    };
+
+    // Time spent in each stage, summed over workers
+    struct StageTimes {
+        std::atomic<uint64_t> camera = 0, intersect = 0, shade = 0, occlusion = 0, accumulate = 0;
+        // camera rays, intersect covers the bounce rays
+        std::atomic<uint64_t> primary = 0, primaryRays = 0;
+    };
+
+    struct WavefrontConfig {
+        int spp = 16;
+        int minDepth = 3;
+        int maxDepth = 5;
+        bool enableNEE = true;
+        bool sortMaterials = true;
+        bool primaryPackets = true;
+        int tileSize = 64;
+    };
+
+    template<class F>
+    static void TimeStage(std::atomic<uint64_t> &nanoseconds, F &&f) {
+        Profiler profiler;
+        f();
+        nanoseconds += uint64_t(profiler.elapsed<double>().count() * 1e9);
+    }
+
+    // Owns the queues of one worker thread, reused from tile to tile
+    class WavefrontWorker {
+        const RenderSettings &settings;
+        const PathTracerKernel &kernel;
+        Scene *scene;
+        bool sortMaterials, primaryPackets;
+        StageTimes &times;
+        std::vector<Point2i> pixels;
+        std::vector<std::shared_ptr<Sampler>> samplers;
+        // indexed by the path's pixel within the tile, rays and hits live in the queues
+        std::vector<PathState> paths;
+        std::vector<Point2f> pFilm;
+        RayQueue rays, nextRays;
+        std::vector<Intersection> hits;
+        ShadowRayQueue shadowRays;
+        // shading stage scratch, order[j] is the hit whose BSDF inputs sit in slot j
+        std::vector<uint32_t> order;
+        std::vector<int32_t> slots;
+        std::vector<Ray8> packets;
+        std::vector<CameraSample> cameraSamples;
+        std::vector<uint64_t> keys;
+        std::vector<ShadingPoint> shadingPoints;
+        std::vector<BSDFSample> bsdfSamples;
+        std::vector<Point2f> bsdfU;
+        std::unordered_map<const Material *, uint64_t> materialKeys;
+
+        void generateCameraRays(const Point2i &filmDimension) {
+            rays.clear();
+            if (primaryPackets) {
+                generateCameraPackets(filmDimension);
+                return;
+            }
+            for (uint32_t i = 0; i < pixels.size(); i++) {
+                auto &sampler = *samplers[i];
+                CameraSample sample;
+                sampler.startNextSample();
+                settings.camera->generateRay(sampler.next2D(), sampler.next2D(), pixels[i], filmDimension, sample);
+                paths[i] = PathState();
+                pFilm[i] = sample.pFilm;
+                rays.push(sample.ray, i);
+            }
+        }
+
+        // 8 horizontally neighbouring pixels per packet
+        void generateCameraPackets(const Point2i &filmDimension) {
+            const uint32_t n = pixels.size();
+            packets.resize((n + 7) / 8);
+            cameraSamples.resize(n);
+            for (uint32_t i = 0; i < n; i++) {
+                samplers[i]->startNextSample();
+            }
+            GenerateCameraPackets(*settings.camera, filmDimension, pixels.data(), samplers.data(), n,
+                                  cameraSamples.data(), packets.data());
+            for (uint32_t i = 0; i < n; i++) {
+                paths[i] = PathState();
+                pFilm[i] = cameraSamples[i].pFilm;
+                rays.push(cameraSamples[i].ray, i);
+            }
+        }
+
+        void intersect() {
+            hits.assign(rays.size(), Intersection());
+            scene->intersect(rays.rays.data(), hits.data(), rays.size());
+        }
+
+        // camera rays through the accelerator's packet path
+        void intersectPackets() {
+            hits.resize(rays.size());
+            IntersectCameraPackets(*scene, packets.data(), rays.size(), hits.data());
+        }
+
+        // emission and the inputs of BSDF sampling; false if the path ends here
+        bool beginVertex(uint32_t i, size_t slot) {
+            auto p = rays.path[i];
+            auto &intersection = hits[i];
+            if (!kernel.beginVertex(paths[p], rays.rays[i], intersection, shadingPoints[slot])) {
+                return false;
+            }
+            bsdfSamples[slot] = BSDFSample();
+            bsdfSamples[slot].wo = intersection.worldToLocal(normalize(-1.0f * rays.rays[i].d));
+            bsdfU[slot] = samplers[p]->next2D();
+            return true;
+        }
+
+        // light sampling and the continuation ray, after the BSDF was sampled
+        void endVertex(uint32_t i, size_t slot) {
+            auto p = rays.path[i];
+            auto &state = paths[p];
+            auto &sampler = *samplers[p];
+            auto &intersection = hits[i];
+            auto &bsdfSample = bsdfSamples[slot];
+            if (!kernel.acceptSample(state, bsdfSample)) {
+                return;
+            }
+            Ray shadowRay;
+            Spectrum contribution;
+            if (kernel.sampleLight(state, intersection, shadingPoints[slot], bsdfSample.wo, sampler, shadowRay,
+                                   contribution)) {
+                shadowRays.push(shadowRay, p, contribution);
+            }
+            Ray next;
+            if (!kernel.continuePath(state, intersection, bsdfSample, sampler, next)) {
+                return;
+            }
+            state.prevIntersection = intersection;
+            nextRays.push(next, p);
+        }
+
+        // Groups the hits in `order` by BSDF type, then by material
+        void sortByMaterial() {
+            keys.resize(order.size());
+            for (size_t j = 0; j < order.size(); j++) {
+                auto material = hits[order[j]].material;
+                auto it = materialKeys.find(material);
+                if (it == materialKeys.end()) {
+                    uint64_t key = uint64_t(material->bsdf->getBSDFType()) << 24u | materialKeys.size();
+                    it = materialKeys.emplace(material, key).first;
+                }
+                keys[j] = it->second << 32u | order[j];
+            }
+            std::sort(keys.begin(), keys.end());
+            for (size_t j = 0; j < order.size(); j++) {
+                order[j] = keys[j] & 0xffffffffu;
+            }
+        }
+
+        // emission, BSDF sampling, light sampling and the continuation ray of every hit
+        void shade() {
+            nextRays.clear();
+            shadowRays.clear();
+            order.clear();
+            for (uint32_t i = 0; i < rays.size(); i++) {
+                if (!hits[i].hit()) {
+                    auto &state = paths[rays.path[i]];
+                    state.Li += state.beta * kernel.backgroundLi(rays.rays[i]);
+                } else if (hits[i].material && hits[i].material->bsdf) {
+                    order.emplace_back(i);
+                }
+            }
+            if (sortMaterials) {
+                sortByMaterial();
+            }
+            shadingPoints.resize(order.size());
+            bsdfSamples.resize(order.size());
+            bsdfU.resize(order.size());
+            size_t nAlive = 0;
+            for (auto i : order) {
+                if (beginVertex(i, nAlive)) {
+                    order[nAlive++] = i;
+                }
+            }
+            order.resize(nAlive);
+            // runs sharing a BSDF are sampled 8 at a time
+            for (size_t begin = 0; begin < order.size();) {
+                auto bsdf = hits[order[begin]].material->bsdf.get();
+                size_t end = begin + 1;
+                while (end < order.size() && hits[order[end]].material->bsdf.get() == bsdf) {
+                    end++;
+                }
+                size_t j = begin;
+                for (; j + 8 <= end; j += 8) {
+                    bsdf->sample8(&bsdfU[j], &shadingPoints[j], &bsdfSamples[j]);
+                }
+                for (; j < end; j++) {
+                    bsdf->sample(bsdfU[j], shadingPoints[j], bsdfSamples[j]);
+                }
+                begin = end;
+            }
+            // back to ray order, which keeps the shadow and bounce rays as coherent as their parents
+            slots.assign(rays.size(), -1);
+            for (size_t j = 0; j < order.size(); j++) {
+                slots[order[j]] = int32_t(j);
+            }
+            for (uint32_t i = 0; i < rays.size(); i++) {
+                if (slots[i] >= 0) {
+                    endVertex(i, size_t(slots[i]));
+                }
+            }
+        }
+
+        void testOcclusion() {
+            shadowRays.occluded.resize(shadowRays.size());
+            scene->occlude(shadowRays.rays.data(), shadowRays.occluded.data(), shadowRays.size());
+        }
+
+        void accumulate() {
+            for (size_t i = 0; i < shadowRays.size(); i++) {
+                if (!shadowRays.occluded[i]) {
+                    paths[shadowRays.path[i]].Li += shadowRays.contribution[i];
+                }
+            }
+        }
+
+        void splat(Film &film) {
+            for (size_t i = 0; i < pixels.size(); i++) {
+                film.addSample(pFilm[i], kernel.finish(paths[i]), 1);
+            }
+        }
+
+    public:
+        WavefrontWorker(const RenderSettings &settings, const PathTracerKernel &kernel,
+                        const WavefrontConfig &config, StageTimes &times)
+                : settings(settings), kernel(kernel), scene(settings.scene.get()),
+                  sortMaterials(config.sortMaterials), primaryPackets(config.primaryPackets), times(times) {}
+
+        void render(const Bounds2i &tile, int spp, Film &film, const Task<RenderSettings>::ContFunc &cont) {
+            auto filmDimension = Point2i(film.width, film.height);
+            pixels.clear();
+            for (int y = tile.pMin.y(); y < tile.pMax.y(); y++) {
+                for (int x = tile.pMin.x(); x < tile.pMax.x(); x++) {
+                    pixels.emplace_back(x, y);
+                }
+            }
+            if (samplers.size() < pixels.size()) {
+                samplers.resize(pixels.size());
+            }
+            for (size_t i = 0; i < pixels.size(); i++) {
+                if (!samplers[i]) {
+                    samplers[i] = settings.sampler->clone();
+                }
+                samplers[i]->startPixel(pixels[i], filmDimension);
+            }
+            paths.resize(pixels.size());
+            pFilm.resize(pixels.size());
+            for (int s = 0; s < spp && cont(); s++) {
+                TimeStage(times.camera, [&] { generateCameraRays(filmDimension); });
+                TimeStage(times.primary, [&] { primaryPackets ? intersectPackets() : intersect(); });
+                times.primaryRays += rays.size();
+                while (rays.size() > 0) {
+                    TimeStage(times.shade, [&] { shade(); });
+                    TimeStage(times.occlusion, [&] { testOcclusion(); });
+                    TimeStage(times.accumulate, [&] { accumulate(); });
+                    std::swap(rays, nextRays);
+                    if (rays.size() > 0) {
+                        TimeStage(times.intersect, [&] { intersect(); });
+                    }
+                }
+                TimeStage(times.accumulate, [&] { splat(film); });
+            }
+        }
+    };
+
+    static RenderOutput WavefrontPathTracerRender(const WavefrontConfig &config,
+                                                  const Task<RenderSettings>::ContFunc &cont,
+                                                  const RenderSettings &settings,
+                                                  const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+        const int tileSize = std::max(1, config.tileSize);
+        RatioCounter<size_t> nonZeroPath;
+        PathTracerKernel kernel(settings, config.enableNEE, config.minDepth, config.maxDepth, nonZeroPath);
+        auto *scene = settings.scene.get();
+        scene->resetRayCounter();
+        Profiler profiler;
+        auto filmPtr = std::make_shared<Film>(settings.filmDimension);
+        auto &film = *filmPtr;
+        log::log("Integrator: Wavefront Path Tracer, samples: {}, queue size: {}, material sorting: {}, "
+                 "primary packets: {}\n", config.spp, tileSize * tileSize, config.sortMaterials, config.primaryPackets);
+
+        std::vector<Bounds2i> tiles;
+        for (int i = 0; i < int(film.width); i += tileSize) {
+            for (int j = 0; j < int(film.height); j += tileSize) {
+                tiles.push_back({Vec2i(i, j), min(Vec2i(film.width, film.height), Vec2i(i + tileSize, j + tileSize))});
+            }
+        }
+
+        StageTimes times;
+        std::vector<std::unique_ptr<WavefrontWorker>> workers(GetCoreNumber());
+        std::mutex _reporterMutex;
+        ProgressReporter reporter(tiles.size(), [=, &_reporterMutex, &settings](size_t cur, size_t total) {
+            settings.reportProgress(double(cur + 1) / total, double(config.spp) * (cur + 1) / total);
+            std::unique_lock<std::mutex> lock(_reporterMutex, std::try_to_lock);
+            if (lock.owns_lock()) {
+                PrintProgressBar(double(cur) / total);
+            }
+        });
+        ParallelFor(0, tiles.size(), [&](int64_t i, uint64_t threadIdx) {
+            auto &worker = workers[threadIdx];
+            if (!worker) {
+                worker = std::make_unique<WavefrontWorker>(settings, kernel, config, times);
+            }
+            worker->render(tiles[i], config.spp, film, cont);
+            settings.publishTile(film, tiles[i]);
+            reporter.update();
+        });
+        if (!cont()) {
+            return {};
+        }
+        auto duration = profiler.elapsed<double>();
+        log::log("Rendering done in {}secs, traced {} rays, {} M rays/sec, non-zero paths: {:.4f}%\n",
+                 duration.count(), scene->getRayCounter(), scene->getRayCounter() / duration.count() / 1e6f,
+                 nonZeroPath.ratio() * 100);
+        log::log("Stage time (thread-secs): camera {:.3f}, intersect {:.3f}, shade {:.3f}, occlusion {:.3f}, "
+                 "accumulate {:.3f}\n", times.camera * 1e-9, times.intersect * 1e-9, times.shade * 1e-9,
+                 times.occlusion * 1e-9, times.accumulate * 1e-9);
+        log::log("Primary rays: {}, {:.3f} M rays/sec per thread\n", times.primaryRays,
+                 times.primaryRays / (times.primary * 1e-9) / 1e6);
+        tx.send(std::shared_ptr<Film>(filmPtr));
+        return RenderOutput{filmPtr};
+    }
+
+    Task<RenderOutput>
+    WavefrontPathTracer::createRenderTask(const RenderSettings &settings,
+                                          const mpsc::Sender<std::shared_ptr<Film>> &tx) {
+        return Task<RenderOutput>([=, &tx](const Task<RenderSettings>::ContFunc &func) {
+            WavefrontConfig config;
+            config.spp = spp;
+            config.minDepth = minDepth;
+            config.maxDepth = maxDepth;
+            config.enableNEE = enableNEE;
+            config.sortMaterials = sortMaterials;
+            config.primaryPackets = primaryPackets;
+            config.tileSize = tileSize;
+            return WavefrontPathTracerRender(config, func, settings, tx);
+        });
+    }
+}
@@ -26,6 +26,7 @@
 namespace miyuki::core {
     void AreaLight::setTriangle(MeshTriangle *shape) {
         this->triangle = shape;
+        mesh = shape->mesh;
         emission = triangle->getMaterial()->emission;
         emissionStrength = triangle->getMaterial()->emissionStrength;
     }
@@ -27,8 +27,11 @@
 #include <miyuki.renderer/shader.h>
 
 namespace miyuki::core {
+    class Mesh;
+
     class AreaLight final: public Light {
         MeshTriangle *triangle = nullptr;
+        const Mesh *mesh = nullptr;
         std::shared_ptr<Shader> emission, emissionStrength;
     public:
         MYK_DECL_CLASS(AreaLight, "AreaLight", interface = "Light")
@@ -43,6 +46,9 @@ namespace miyuki::core {
         void sampleLe(const Point2f &u1, const Point2f &u2, LightRaySample &sample) override;
 
         void setTriangle(MeshTriangle *shape);
+
+        // the triangle's mesh, valid even after the mesh's triangles were rebuilt
+        [[nodiscard]] const Mesh *getMesh() const { return mesh; }
     };
 }
 #endif //MIYUKIRENDERER_AREALIGHT_H
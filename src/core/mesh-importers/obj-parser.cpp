@@ -0,0 +1,264 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "obj-parser.h"
+#include <miyuki.foundation/parallel.h>
+#include <miyuki.foundation/log.hpp>
+#include <charconv>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace miyuki::core {
+    namespace {
+        struct ObjError : std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+
+        inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        inline const char *SkipSpace(const char *p, const char *end) {
+            while (p < end && IsSpace(*p))
+                p++;
+            return p;
+        }
+
+        inline const char *TokenEnd(const char *p, const char *end) {
+            while (p < end && !IsSpace(*p))
+                p++;
+            return p;
+        }
+
+        inline std::string_view Token(const char *&p, const char *end) {
+            p = SkipSpace(p, end);
+            auto begin = p;
+            p = TokenEnd(p, end);
+            return std::string_view(begin, p - begin);
+        }
+
+        // the rest of the line without surrounding whitespace, for names that may contain spaces
+        inline std::string Rest(const char *p, const char *end) {
+            p = SkipSpace(p, end);
+            while (end > p && IsSpace(end[-1]))
+                end--;
+            return std::string(p, end);
+        }
+
+        template<class T>
+        const char *Parse(const char *p, const char *end, T &value) {
+            p = SkipSpace(p, end);
+            if (p < end && *p == '+')
+                p++;
+            auto [ptr, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc()) {
+                throw ObjError("expected a number");
+            }
+            return ptr;
+        }
+
+        // one v/vt/vn corner of a face, 0 for a missing index
+        struct Corner {
+            int position = 0, texCoord = 0, normal = 0;
+        };
+
+        const char *ParseCorner(const char *p, const char *end, Corner &corner) {
+            p = Parse(p, end, corner.position);
+            if (p < end && *p == '/') {
+                p++;
+                if (p < end && *p != '/')
+                    p = Parse(p, end, corner.texCoord);
+                if (p < end && *p == '/') {
+                    p++;
+                    p = Parse(p, end, corner.normal);
+                }
+            }
+            if (p < end && !IsSpace(*p)) {
+                throw ObjError("malformed face");
+            }
+            return p;
+        }
+
+        // calls f(keyword, rest of line, line end) for each line in [begin, end)
+        template<class F>
+        void ForEachLine(const char *begin, const char *end, F &&f) {
+            for (auto p = begin; p < end;) {
+                auto eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+                if (!eol)
+                    eol = end;
+                auto q = p;
+                auto keyword = Token(q, eol);
+                if (!keyword.empty() && keyword[0] != '#')
+                    f(keyword, q, eol);
+                p = eol + 1;
+            }
+        }
+
+        size_t LineOf(const char *begin, const char *p) {
+            return 1 + std::count(begin, p, '\n');
+        }
+    } // namespace
+
+    ObjParser::ObjParser(const fs::path &path, size_t chunkSize) : file(path.string()) {
+        auto begin = static_cast<const char *>(file.data());
+        auto end = begin + file.size();
+        for (auto p = begin; p < end;) {
+            Chunk chunk;
+            chunk.begin = p;
+            auto q = p + std::min<size_t>(chunkSize, end - p);
+            auto eol = q < end ? static_cast<const char *>(std::memchr(q, '\n', end - q)) : nullptr;
+            chunk.end = eol ? eol + 1 : end;
+            p = chunk.end;
+            chunks.emplace_back(std::move(chunk));
+        }
+
+        ParallelFor(0, chunks.size(), [&](int64_t i, size_t) {
+            auto &chunk = chunks[i];
+            ForEachLine(chunk.begin, chunk.end, [&](std::string_view keyword, const char *p, const char *eol) {
+                if (keyword == "v") {
+                    chunk.positions++;
+                } else if (keyword == "vn") {
+                    chunk.normals++;
+                } else if (keyword == "vt") {
+                    chunk.texCoords++;
+                } else if (keyword == "f") {
+                    size_t corners = 0;
+                    while (!Token(p, eol).empty())
+                        corners++;
+                    if (corners >= 3)
+                        chunk.triangles += corners - 2;
+                } else if (keyword == "usemtl") {
+                    chunk.materials.emplace_back(Rest(p, eol));
+                } else if (keyword == "mtllib") {
+                    chunk.libraries.emplace_back(Rest(p, eol));
+                }
+            });
+        });
+
+        std::unordered_map<std::string, uint16_t> materialIds;
+        uint16_t material = -1;
+        for (auto &chunk : chunks) {
+            chunk.firstPosition = positions;
+            chunk.firstNormal = normals;
+            chunk.firstTexCoord = texCoords;
+            chunk.firstTriangle = triangles;
+            chunk.initialMaterial = material;
+            positions += chunk.positions;
+            normals += chunk.normals;
+            texCoords += chunk.texCoords;
+            triangles += chunk.triangles;
+            for (auto &name : chunk.materials) {
+                auto it = materialIds.find(name);
+                if (it == materialIds.end()) {
+                    it = materialIds.emplace(name, materialNames.size()).first;
+                    materialNames.emplace_back(name);
+                }
+                material = it->second;
+            }
+            for (auto &lib : chunk.libraries) {
+                if (std::find(materialLibraries.begin(), materialLibraries.end(), lib) == materialLibraries.end())
+                    materialLibraries.emplace_back(lib);
+            }
+        }
+        if (materialNames.size() >= uint16_t(-1)) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{}: too many materials", path.string()));
+        }
+    }
+
+    void ObjParser::parse(Point3f *position, Normal3f *normal, Point2f *texCoord, VertexIndices *indices,
+                          uint16_t *materials) {
+        std::unordered_map<std::string, uint16_t> materialIds;
+        for (size_t i = 0; i < materialNames.size(); i++) {
+            materialIds[materialNames[i]] = i;
+        }
+        auto fileBegin = static_cast<const char *>(file.data());
+        std::mutex mutex;
+        std::string error;
+        ParallelFor(0, chunks.size(), [&](int64_t i, size_t) {
+            auto &chunk = chunks[i];
+            size_t nPositions = 0, nNormals = 0, nTexCoords = 0, nTriangles = 0;
+            uint16_t material = chunk.initialMaterial;
+            std::vector<Corner> corners;
+            // OBJ indices start at 1, negative ones count back from the last element so far
+            auto resolve = [](int index, size_t count, size_t total) -> int {
+                if (index == 0)
+                    return -1;
+                int64_t i = index > 0 ? int64_t(index) - 1 : int64_t(count) + index;
+                if (i < 0 || i >= int64_t(total)) {
+                    throw ObjError(fmt::format("index {} out of range", index));
+                }
+                return int(i);
+            };
+            const char *line = chunk.begin;
+            try {
+                ForEachLine(chunk.begin, chunk.end, [&](std::string_view keyword, const char *p, const char *eol) {
+                    line = p;
+                    if (keyword == "v") {
+                        Point3f v;
+                        p = Parse(Parse(Parse(p, eol, v[0]), eol, v[1]), eol, v[2]);
+                        position[chunk.firstPosition + nPositions++] = v;
+                    } else if (keyword == "vn") {
+                        Normal3f n;
+                        p = Parse(Parse(Parse(p, eol, n[0]), eol, n[1]), eol, n[2]);
+                        normal[chunk.firstNormal + nNormals++] = n;
+                    } else if (keyword == "vt") {
+                        Point2f t;
+                        p = Parse(Parse(p, eol, t[0]), eol, t[1]);
+                        texCoord[chunk.firstTexCoord + nTexCoords++] = t;
+                    } else if (keyword == "f") {
+                        corners.clear();
+                        while (SkipSpace(p, eol) < eol) {
+                            Corner c;
+                            p = ParseCorner(SkipSpace(p, eol), eol, c);
+                            if (c.position == 0) {
+                                throw ObjError("face without position index");
+                            }
+                            c.position = resolve(c.position, chunk.firstPosition + nPositions, positions);
+                            c.texCoord = resolve(c.texCoord, chunk.firstTexCoord + nTexCoords, texCoords);
+                            c.normal = resolve(c.normal, chunk.firstNormal + nNormals, normals);
+                            corners.emplace_back(c);
+                        }
+                        for (size_t k = 1; k + 1 < corners.size(); k++) {
+                            auto idx = chunk.firstTriangle + nTriangles++;
+                            auto &out = indices[idx];
+                            for (int j = 0; j < 3; j++) {
+                                auto &c = corners[j == 0 ? 0 : k + j - 1];
+                                out.position[j] = c.position;
+                                out.texCoord[j] = c.texCoord;
+                                out.normal[j] = c.normal;
+                            }
+                            materials[idx] = material;
+                        }
+                    } else if (keyword == "usemtl") {
+                        material = materialIds.at(Rest(p, eol));
+                    }
+                });
+            } catch (std::exception &e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error.empty())
+                    error = fmt::format("line {}: {}", LineOf(fileBegin, line), e.what());
+            }
+        });
+        if (!error.empty()) {
+            MIYUKI_THROW(std::runtime_error, error);
+        }
+    }
+} // namespace miyuki::core
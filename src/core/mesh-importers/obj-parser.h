@@ -0,0 +1,65 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef MIYUKIRENDERER_OBJ_PARSER_H
+#define MIYUKIRENDERER_OBJ_PARSER_H
+
+#include <miyuki.renderer/mesh.h>
+#include <miyuki.foundation/mappedfile.h>
+
+namespace miyuki::core {
+    // Geometry of a Wavefront OBJ file, parsed in parallel from a mapping of the file.
+    // The file is cut into chunks at line boundaries; a first pass counts the elements and collects
+    // the usemtl names of each chunk, prefix sums then give every chunk its output offsets and the
+    // material in effect at its start, and a second pass parses the chunks straight into the
+    // destination arrays, resolving relative (negative) indices against those offsets.
+    // Polygons are triangulated as fans, lines, points, groups and smoothing groups are ignored.
+    class ObjParser {
+        struct Chunk {
+            const char *begin = nullptr, *end = nullptr;
+            size_t positions = 0, normals = 0, texCoords = 0, triangles = 0;
+            std::vector<std::string> materials;
+            std::vector<std::string> libraries;
+            // offsets of the chunk's elements in the outputs
+            size_t firstPosition = 0, firstNormal = 0, firstTexCoord = 0, firstTriangle = 0;
+            uint16_t initialMaterial = -1;
+        };
+        MappedFile file;
+        std::vector<Chunk> chunks;
+
+    public:
+        size_t positions = 0, normals = 0, texCoords = 0, triangles = 0;
+        // in order of first use, triangle materials index into it; -1 before any usemtl
+        std::vector<std::string> materialNames;
+        // mtllib files, relative to the OBJ file
+        std::vector<std::string> materialLibraries;
+
+        // counts the elements, throws on I/O errors
+        explicit ObjParser(const fs::path &path, size_t chunkSize = 16u << 20u);
+
+        // outputs must hold positions, normals, texCoords and triangles elements;
+        // throws on malformed lines and out of range indices
+        void parse(Point3f *position, Normal3f *normal, Point2f *texCoord, VertexIndices *indices,
+                   uint16_t *materials);
+    };
+} // namespace miyuki::core
+
+#endif //MIYUKIRENDERER_OBJ_PARSER_H
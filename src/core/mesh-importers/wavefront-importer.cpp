@@ -24,10 +24,13 @@
 #include <miyuki.renderer/graph.h>
 #include <miyuki.foundation/log.hpp>
 #include <miyuki.renderer/mesh.h>
+#include <cstring>
 #include <fstream>
+#include <map>
 #include <optional>
 #include <tiny_obj_loader.h>
 #include <miyuki.renderer/mesh-importer.h>
+#include "obj-parser.h"
 
 #include "../bsdfs/diffusebsdf.h"
 #include "../bsdfs/microfacet.h"
@@ -84,115 +87,54 @@ namespace miyuki::core {
         return material;
     }
 
+    static void LoadMaterials(const fs::path &path, const ObjParser &obj, Mesh &mesh) {
+        auto parent = fs::absolute(path).parent_path();
+        for (auto &lib : obj.materialLibraries) {
+            auto mtl = parent / lib;
+            std::ifstream in(mtl);
+            if (!in) {
+                log::log("cannot open {}\n", mtl.string());
+                continue;
+            }
+            std::map<std::string, int> ids;
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+            tinyobj::LoadMtl(&ids, &materials, &in, &warn, &err);
+            if (!err.empty()) {
+                log::log("{}: {}\n", mtl.string(), err);
+            }
+            for (auto &m : materials) {
+                // texture paths in a .mtl are relative to it
+                if (!m.diffuse_texname.empty())
+                    m.diffuse_texname = (mtl.parent_path() / m.diffuse_texname).string();
+                if (!m.specular_texname.empty())
+                    m.specular_texname = (mtl.parent_path() / m.specular_texname).string();
+                mesh.materials[m.name] = convertFromMTL(m);
+            }
+        }
+    }
+
     MeshImportResult WavefrontImporter::importMesh(const fs::path &path) {
         log::log("Importing {}\n", path.string());
-        fs::path parent_path = fs::absolute(path).parent_path();
-        fs::path file = path.filename();
-        CurrentPathGuard _guard;
-        if (!parent_path.empty())
-            fs::current_path(parent_path);
-
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-
-        std::string warn;
-        std::string err;
-
-        std::string _file = file.string();
         MeshImportResult result;
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, _file.c_str());
-        if (!ret) {
-            log::log("error loading {}\n", path.string());
+        auto mesh = std::make_shared<Mesh>();
+        try {
+            ObjParser obj(path);
+            auto &v = mesh->_vertex_data;
+            v.position.resize(obj.positions);
+            v.normal.resize(obj.normals);
+            v.tex_coord.resize(obj.texCoords);
+            std::vector<VertexIndices> corners(obj.triangles);
+            std::vector<uint16_t> materials(obj.triangles);
+            obj.parse(v.position.data(), v.normal.data(), v.tex_coord.data(), corners.data(), materials.data());
+            mesh->setTriangles(corners.data(), materials.data(), corners.size());
+            mesh->_names = obj.materialNames;
+            LoadMaterials(path, obj, *mesh);
+        } catch (std::exception &e) {
+            log::log("error loading {}: {}\n", path.string(), e.what());
             return result;
         }
-        //log::log("vert: {}\n",attrib.vertices.size());
-        auto mesh = std::make_shared<Mesh>();
         mesh->filename = path.string();
-        mesh->_vertex_data.position.reserve(attrib.vertices.size() / 3);
-        mesh->_vertex_data.normal.reserve(attrib.normals.size() / 3);
-        mesh->_vertex_data.tex_coord.reserve(attrib.texcoords.size() / 2);
-        for (size_t i = 0; i < attrib.vertices.size(); i += 3) {
-            mesh->_vertex_data.position.emplace_back(
-                    Vec3f(attrib.vertices[i + 0], attrib.vertices[i + 1], attrib.vertices[i + 2]));
-        }
-        for (size_t i = 0; i < attrib.normals.size(); i += 3) {
-            mesh->_vertex_data.normal.emplace_back(
-                    Vec3f(attrib.normals[i + 0], attrib.normals[i + 1], attrib.normals[i + 2]));
-        }
-        for (size_t i = 0; i < attrib.texcoords.size(); i += 2) {
-            mesh->_vertex_data.tex_coord.emplace_back(
-                    Point2f(attrib.texcoords[i + 0], attrib.texcoords[i + 1]));
-        }
-
-        for(auto &i:materials){
-            auto mat = convertFromMTL(i);
-            mesh->materials[i.name] = mat;
-        }
-        std::unordered_map<std::string, size_t> name_to_id;
-        std::unordered_map<size_t, std::string> id_to_name;
-//
-//        for (size_t i = 0; i < shapes.size(); i++) {
-//            const auto &name = shapes[i].name;
-//
-//            if(name_to_id.find(name) == name_to_id.end()){
-//                name_to_id[name] = name_to_id.size();
-//                id_to_name[name_to_id[name]] = name;
-//            }
-//
-//        }
-
-
-        // Loop over shapes
-        for (size_t s = 0; s < shapes.size(); s++) {
-            // Loop over faces(polygon)
-            size_t index_offset = 0;
-            for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-                MeshTriangle primitive;
-                VertexIndices indices{};
-                auto mat = materials[shapes[s].mesh.material_ids[f]].name;
-                if (mat.empty()) {
-                    primitive.name_id = -1;
-                } else {
-                    if (name_to_id.find(mat) == name_to_id.end()) {
-                        name_to_id[mat] = name_to_id.size();
-                        id_to_name[name_to_id[mat]] = mat;
-                    }
-                    primitive.name_id = name_to_id.at(mat);
-                }
-                int fv = shapes[s].mesh.num_face_vertices[f];
-                MIYUKI_CHECK(fv == 3);
-                for (size_t v = 0; v < fv; v++) {
-                    // access to vertex
-                    tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                    indices.position[v] = idx.vertex_index;
-                    if (idx.normal_index >= 0) {
-                        MIYUKI_CHECK(3 * idx.normal_index + 2 < attrib.normals.size());
-                        indices.normal[v] = idx.normal_index;
-                    } else {
-                        indices.normal[v] = -1;
-                    }
-                    if (idx.texcoord_index >= 0) {
-                        MIYUKI_CHECK(2 * idx.texcoord_index + 1 < attrib.texcoords.size());
-                        indices.texCoord[v] = idx.texcoord_index;
-                    } else {
-                        indices.texCoord[v] = -1;
-                    }
-                }
-                index_offset += fv;
-
-                // per-face material
-                // shapes[s].mesh.material_ids[f];
-
-                primitive.mesh = mesh.get();
-                primitive.indices = indices;
-                mesh->triangles.push_back(primitive);
-            }
-        }
-
-        for (size_t i = 0; i < name_to_id.size(); i++) {
-            mesh->_names.emplace_back(id_to_name[i]);
-        }
 
         log::log("loaded {} vertices, {} normals, {} tex coords, {} primitives\n", mesh->_vertex_data.position.size(),
                  mesh->_vertex_data.normal.size(), mesh->_vertex_data.tex_coord.size(), mesh->triangles.size());
@@ -200,4 +142,46 @@ namespace miyuki::core {
         result.mesh = mesh;
         return result;
     }
+
+    MeshImportResult WavefrontImporter::convert(const fs::path &path, const fs::path &meshFile) {
+        log::log("Converting {} to {}\n", path.string(), meshFile.string());
+        MeshImportResult result;
+        auto mesh = std::make_shared<Mesh>();
+        try {
+            ObjParser obj(path);
+            std::vector<char> names;
+            for (auto &name : obj.materialNames) {
+                names.insert(names.end(), name.begin(), name.end());
+                names.push_back(0);
+            }
+            MeshFileHeader header;
+            header.nNames = obj.materialNames.size();
+            header.namesSize = names.size();
+            header.nPositions = obj.positions;
+            header.nNormals = obj.normals;
+            header.nTexCoords = obj.texCoords;
+            header.nTriangles = obj.triangles;
+            header.layout();
+
+            MappedFile out(meshFile.string(), MappedFile::Create, header.fileSize);
+            auto data = static_cast<char *>(out.data());
+            std::memcpy(data + header.names, names.data(), names.size());
+            obj.parse(reinterpret_cast<Point3f *>(data + header.positions),
+                      reinterpret_cast<Normal3f *>(data + header.normals),
+                      reinterpret_cast<Point2f *>(data + header.texCoords),
+                      reinterpret_cast<VertexIndices *>(data + header.indices),
+                      reinterpret_cast<uint16_t *>(data + header.materials));
+            header.checksum = MeshFileHeader::Checksum(data + sizeof(header), header.fileSize - sizeof(header));
+            std::memcpy(data, &header, sizeof(header));
+            LoadMaterials(path, obj, *mesh);
+            log::log("wrote {} vertices, {} normals, {} tex coords, {} primitives\n", obj.positions, obj.normals,
+                     obj.texCoords, obj.triangles);
+        } catch (std::exception &e) {
+            log::log("error converting {}: {}\n", path.string(), e.what());
+            return result;
+        }
+        mesh->filename = meshFile.string();
+        result.mesh = mesh;
+        return result;
+    }
 } // namespace miyuki::core
\ No newline at end of file
@@ -29,5 +29,9 @@ namespace miyuki::core {
       public:
         MYK_DECL_CLASS(WavefrontImporter, "WavefrontImporter", interface = "MeshImporter")
         MeshImportResult importMesh(const fs::path &) override;
+
+        // Writes the geometry straight into a version 2 .mesh file, so memory use does not grow with
+        // the model. The returned mesh refers to meshFile and is not loaded.
+        MeshImportResult convert(const fs::path &path, const fs::path &meshFile);
     };
 } // namespace miyuki::core
\ No newline at end of file
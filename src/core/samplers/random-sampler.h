@@ -30,13 +30,19 @@
 namespace miyuki::core {
     class RandomSampler final : public Sampler {
         Rng rng;
+        uint64_t seed = 0;
+        // same as SobolSampler::sampleOffset
+        int sampleOffset = 0;
     public:
         MYK_DECL_CLASS(RandomSampler, "RandomSampler", interface = "Sampler")
 
+        MYK_SER(sampleOffset)
+
         RandomSampler(uint32_t seed = 0) : rng(seed) {}
 
         void startPixel(const Point2i &i, const Point2i &filmDimension) override {
-            rng = Rng(i.x() + i.y() * filmDimension.x());
+            seed = i.x() + i.y() * filmDimension.x();
+            startSample(0);
         }
 
         Float next1D() override {
@@ -44,14 +50,19 @@ namespace miyuki::core {
         }
 
         [[nodiscard]] std::shared_ptr<Sampler> clone() const override {
-            return std::make_shared<RandomSampler>();
+            auto sampler = std::make_shared<RandomSampler>();
+            sampler->sampleOffset = sampleOffset;
+            return sampler;
         }
 
         void startNextSample() override {
 
         }
 
-        void startSample(int) override{}
+        void startSample(int s) override {
+            s += sampleOffset;
+            rng = Rng(s == 0 ? seed : seed ^ (uint64_t(s) * 0x9e3779b97f4a7c15u));
+        }
 
     };
 
@@ -55,7 +55,7 @@ namespace miyuki::core {
     void SobolSampler::startPixel(const Point2i &i, const Point2i &filmDimension) {
         Rng rng(i.x() + i.y() * filmDimension.x());
         rotation = rng.uniformUint32();
-        sample = -1;
+        sample = sampleOffset - 1;
     }
 
     Float SobolSampler::next1D() {
@@ -63,7 +63,9 @@ namespace miyuki::core {
     }
 
     std::shared_ptr<Sampler> SobolSampler::clone() const {
-        return std::make_shared<SobolSampler>();
+        auto sampler = std::make_shared<SobolSampler>();
+        sampler->sampleOffset = sampleOffset;
+        return sampler;
     }
 
     void SobolSampler::startNextSample() {
@@ -32,16 +32,21 @@ namespace miyuki::core {
         int dimension = 0;
         int sample = 0;
         int rotation;
+        // sample s of a pixel is taken from index sampleOffset + s of the sequence, so processes
+        // with offsets k * spp render disjoint parts of the same sequence
+        int sampleOffset = 0;
     public:
         MYK_DECL_CLASS(SobolSampler, "SobolSampler", interface = "Sampler")
 
+        MYK_SER(sampleOffset)
+
         void startPixel(const Point2i &i, const Point2i &filmDimension) override;
 
         Float next1D() override;
 
         void startNextSample() override;
 
-        void startSample(int s)override{sample = s;}
+        void startSample(int s)override{sample = sampleOffset + s - 1;}
         [[nodiscard]] std::shared_ptr<Sampler> clone() const override;
     };
 }
@@ -21,33 +21,103 @@
 // SOFTWARE.
 
 #include <miyuki.renderer/scene.h>
+#include <miyuki.renderer/snapshot.h>
 #include "accelerators/sahbvh.h"
 #include "accelerators/embree-backend.h"
 #include "lights/arealight.h"
 #include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/profiler.h>
+#include <algorithm>
 
 namespace miyuki::core {
-    void Scene::preprocess() {
-#ifdef MYK_USE_EMBREE
-        accelerator = std::make_shared<EmbreeAccelerator>();
-#else
-        accelerator = std::make_shared<BVHAccelerator>();
-#endif
-        auto setLight = [=](MeshTriangle *triangle) {
+    void Scene::preprocessMesh(Mesh &mesh) {
+        auto setLight = [&](MeshTriangle *triangle) {
             auto mat = triangle->getMaterial();
             if (mat && mat->markAsLight && mat->emission && mat->emissionStrength) {
                 auto light = std::make_shared<AreaLight>();
-                triangle->light = light.get();
+                mesh.emissiveTriangles.emplace_back(triangle->primitiveId, light.get());
                 light->setTriangle(triangle);
                 lights.emplace_back(light);
             }
         };
+        mesh.preprocess();
+        mesh.foreach(setLight);
+        std::sort(mesh.emissiveTriangles.begin(), mesh.emissiveTriangles.end(),
+                  [](const std::pair<uint32_t, Light *> &a, const std::pair<uint32_t, Light *> &b) {
+                      return a.first < b.first;
+                  });
+    }
 
+    // only emissive materials get an area light, skip the lookup for the rest
+    static Light *LightOf(const Intersection &isct) {
+        return isct.material && isct.material->markAsLight ? isct.shape->light() : nullptr;
+    }
+
+    void Scene::clearDirtyFlags() {
         for (auto &i : meshes) {
-            i->preprocess();
-            i->foreach(setLight);
+            i->_dirty = false;
+            i->_topologyChanged = false;
         }
+    }
+
+    void Scene::preprocess() {
+        preprocessMeshes();
         accelerator->build(*this);
+        clearDirtyFlags();
+    }
+
+    void Scene::preprocess(SnapshotReader &snapshot) {
+        preprocessMeshes();
+        if (snapshot.read<uint8_t>()) {
+            Profiler profiler;
+            accelerator->loadSnapshot(snapshot, *this);
+            log::log("Accelerator restored in {:.3f}ms\n", profiler.elapsed<double>().count() * 1e3);
+        } else {
+            accelerator->build(*this);
+        }
+        clearDirtyFlags();
+    }
+
+    void Scene::preprocessMeshes() {
+        if (!accelerator) {
+#ifdef MYK_USE_EMBREE
+            accelerator = std::make_shared<EmbreeAccelerator>();
+#else
+            accelerator = std::make_shared<BVHAccelerator>();
+#endif
+        }
+        for (auto &i : meshes) {
+            preprocessMesh(*i);
+        }
+        nPreprocessedMeshes = meshes.size();
+    }
+
+    void Scene::update() {
+        if (!accelerator) {
+            preprocess();
+            return;
+        }
+        Profiler profiler;
+        for (size_t i = 0; i < nPreprocessedMeshes; i++) {
+            auto &mesh = *meshes[i];
+            if (!mesh._topologyChanged)
+                continue;
+            // the old lights point into the mesh's previous triangles
+            lights.erase(std::remove_if(lights.begin(), lights.end(),
+                                        [&](const std::shared_ptr<Light> &light) {
+                                            auto area = std::dynamic_pointer_cast<AreaLight>(light);
+                                            return area && area->getMesh() == &mesh;
+                                        }),
+                         lights.end());
+            preprocessMesh(mesh);
+        }
+        for (size_t i = nPreprocessedMeshes; i < meshes.size(); i++) {
+            preprocessMesh(*meshes[i]);
+        }
+        nPreprocessedMeshes = meshes.size();
+        accelerator->update(*this);
+        clearDirtyFlags();
+        log::log("Scene updated in {:.3f}ms\n", profiler.elapsed<double>().count() * 1e3);
     }
 
     bool Scene::intersect(const miyuki::core::Ray &ray, miyuki::core::Intersection &isct) {
@@ -55,6 +125,7 @@ namespace miyuki::core {
         if (accelerator->intersect(ray, isct)) {
             isct.Ns = isct.shape->normalAt(isct.uv);
             isct.material = isct.shape->getMaterial();
+            isct.light = LightOf(isct);
             isct.wo = -1.0f * ray.d;
             isct.computeLocalFrame();
             return true;
@@ -62,8 +133,47 @@ namespace miyuki::core {
         return false;
     }
 
+    void Scene::intersect(const Ray *rays, Intersection *isct, size_t n) {
+        rayCounter += n;
+        accelerator->intersectStream(rays, isct, n);
+        for (size_t i = 0; i < n; i++) {
+            if (isct[i].hit()) {
+                isct[i].Ns = isct[i].shape->normalAt(isct[i].uv);
+                isct[i].material = isct[i].shape->getMaterial();
+                isct[i].light = LightOf(isct[i]);
+                isct[i].wo = -1.0f * rays[i].d;
+                isct[i].computeLocalFrame();
+            }
+        }
+    }
+
     bool Scene::occlude(const miyuki::core::Ray & ray) {
         rayCounter++;
         return accelerator->occlude(ray);
     }
+
+    void Scene::intersect8(const Ray8 &ray, Intersection *isct) {
+        Intersection8 packet;
+        auto hit = accelerator->intersect8(ray, packet);
+        for (int i = 0; i < 8; i++) {
+            if (ray.tMin[i] > ray.tMax[i]) {
+                isct[i] = Intersection();
+                continue;
+            }
+            rayCounter++;
+            isct[i] = hit[i] ? GetLane(packet, i) : Intersection();
+            if (hit[i]) {
+                isct[i].Ns = isct[i].shape->normalAt(isct[i].uv);
+                isct[i].material = isct[i].shape->getMaterial();
+                isct[i].light = LightOf(isct[i]);
+                isct[i].wo = -1.0f * GetLane(ray, i).d;
+                isct[i].computeLocalFrame();
+            }
+        }
+    }
+
+    void Scene::occlude(const Ray *rays, uint8_t *occluded, size_t n) {
+        rayCounter += n;
+        accelerator->occludeStream(rays, occluded, n);
+    }
 } // namespace miyuki::core
\ No newline at end of file
@@ -47,6 +47,10 @@ namespace miyuki::core {
         [[nodiscard]] Spectrum evaluate(const ShadingPoint &point) const override {
             return miyuki::core::Spectrum(value);
         }
+
+        void evaluate8(const ShadingPoint */*sp*/, Spectrum *out) const override {
+            std::fill(out, out + 8, miyuki::core::Spectrum(value));
+        }
     };
 
     class RGBShader final : public Shader {
@@ -64,6 +68,10 @@ namespace miyuki::core {
         [[nodiscard]] Spectrum evaluate(const ShadingPoint &point) const override {
             return miyuki::core::Spectrum(value);
         }
+
+        void evaluate8(const ShadingPoint */*sp*/, Spectrum *out) const override {
+            std::fill(out, out + 8, miyuki::core::Spectrum(value));
+        }
     };
 
     class MathShaderOperator : public serialize::Serializable {
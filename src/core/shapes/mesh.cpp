@@ -22,6 +22,8 @@
 #include <miyuki.renderer/mesh.h>
 #include <miyuki.foundation/log.hpp>
 #include <fstream>
+#include <limits>
+#include <unordered_map>
 #include <miyuki.renderer/bsdf.h>
 
 
@@ -73,13 +75,15 @@ namespace miyuki::core {
         if (!_loaded) {
             auto ext = fs::path(filename).extension().string();
             if (ext == ".mesh") {
-                if (!loadFromFile(filename)) {
-                    log::log("failed to load {}\n", fs::absolute(fs::path(filename)).string());
+                auto path = ResolvePath(filename);
+                if (!loadFromFile(path.string())) {
+                    log::log("failed to load {}\n", fs::absolute(path).string());
                 }
             } else {
                 throw std::runtime_error("Only .mesh files are supported");
             }
         }
+        buildTriangles();
         _materials.clear();
         for (const auto &name : _names) {
             if (materials.find(name) != materials.end()) {
@@ -107,35 +111,147 @@ namespace miyuki::core {
     }
 
 
-    void Mesh::toBinary(std::vector<char> &buffer) const {
-        writeString(buffer, "BINARY_MESH");
-        write(buffer, _names.size());
-        for (const auto &i:_names) {
-            writeString(buffer, i);
+    uint64_t MeshFileHeader::Checksum(const char *data, size_t size) {
+        uint64_t h = 14695981039346656037ull;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            h = (h ^ word) * 1099511628211ull;
+        }
+        for (; i < size; i++) {
+            h = (h ^ uint8_t(data[i])) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static bool IsMeshV2(const char *data, size_t size) {
+        return size >= sizeof(MeshFileHeader) &&
+               std::memcmp(data, MeshFileHeader::Magic, sizeof(MeshFileHeader::Magic)) == 0;
+    }
+
+    // With file set, data lies in it and the vertex data are mapped rather than copied
+    static void LoadMeshV2(Mesh &mesh, char *data, size_t size, const std::shared_ptr<MappedFile> &file) {
+        MeshFileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if (header.version != MeshFileHeader::Version) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Unsupported .mesh version {}", header.version));
         }
-        write(buffer, _vertex_data.position.size());
-        for (const auto &i: _vertex_data.position) {
-            write(buffer, i);
+        if (header.positionSize != sizeof(Point3f) || header.normalSize != sizeof(Normal3f) ||
+            header.texCoordSize != sizeof(Point2f) || header.indicesSize != sizeof(VertexIndices)) {
+            MIYUKI_THROW(std::runtime_error, ".mesh file is of a build with another vector layout");
         }
-        write(buffer, _vertex_data.normal.size());
-        for (const auto &i: _vertex_data.normal) {
-            write(buffer, i);
+        if (header.fileSize != size) {
+            MIYUKI_THROW(std::runtime_error, "Truncated .mesh file");
         }
-        write(buffer, _vertex_data.tex_coord.size());
-        for (const auto &i: _vertex_data.tex_coord) {
-            write(buffer, i);
+        auto section = [&](uint64_t offset, uint64_t count, size_t elementSize) {
+            if (offset % MeshFileHeader::Alignment != 0 || offset > size || count > (size - offset) / elementSize) {
+                MIYUKI_THROW(std::runtime_error, "Corrupt .mesh file");
+            }
+            return data + offset;
+        };
+        auto names = section(header.names, header.namesSize, 1);
+        auto positions = section(header.positions, header.nPositions, sizeof(Point3f));
+        auto normals = section(header.normals, header.nNormals, sizeof(Normal3f));
+        auto texCoords = section(header.texCoords, header.nTexCoords, sizeof(Point2f));
+        auto indices = section(header.indices, header.nTriangles, sizeof(VertexIndices));
+        auto materials = section(header.materials, header.nTriangles, sizeof(uint16_t));
+#ifndef MYK_RELEASE
+        // reads the whole file, release builds leave the sections to be paged in as they are used
+        if (MeshFileHeader::Checksum(data + sizeof(header), size - sizeof(header)) != header.checksum) {
+            MIYUKI_THROW(std::runtime_error, ".mesh checksum mismatch");
         }
-        write(buffer, triangles.size());
-        for (const auto &i: triangles) {
-            write(buffer, i.indices);
+#endif
+
+        mesh._names.clear();
+        for (const char *p = names, *end = names + header.namesSize; p < end && mesh._names.size() < header.nNames;) {
+            auto length = strnlen(p, end - p);
+            mesh._names.emplace_back(p, length);
+            p += length + 1;
         }
-        write(buffer, triangles.size());
-        for (const auto &i:triangles) {
-            write(buffer, i.name_id);
+        auto &v = mesh._vertex_data;
+        auto load = [&](auto &buffer, char *p, size_t count) {
+            using T = std::remove_reference_t<decltype(buffer[0])>;
+            if (file) {
+                buffer.map(file, reinterpret_cast<T *>(p), count);
+            } else {
+                buffer.assign(reinterpret_cast<T *>(p), reinterpret_cast<T *>(p) + count);
+            }
+        };
+        load(v.position, positions, header.nPositions);
+        load(v.normal, normals, header.nNormals);
+        load(v.tex_coord, texCoords, header.nTexCoords);
+
+        mesh.setTriangles(reinterpret_cast<const VertexIndices *>(indices),
+                          reinterpret_cast<const uint16_t *>(materials), header.nTriangles);
+        log::log("loaded {} vertices, {} normals, {} tex coords, {} primitives{}\n",
+                 v.position.size(), v.normal.size(), v.tex_coord.size(), mesh.triangles.size(),
+                 v.position.mapped() ? " (mapped)" : "");
+    }
+
+    void MeshFileHeader::layout() {
+        std::memcpy(magic, Magic, sizeof(magic));
+        version = Version;
+        positionSize = sizeof(Point3f);
+        normalSize = sizeof(Normal3f);
+        texCoordSize = sizeof(Point2f);
+        indicesSize = sizeof(VertexIndices);
+        size_t offset = sizeof(MeshFileHeader);
+        auto section = [&](size_t bytes) {
+            offset = (offset + Alignment - 1) / Alignment * Alignment;
+            auto begin = offset;
+            offset += bytes;
+            return begin;
+        };
+        names = section(namesSize);
+        positions = section(nPositions * sizeof(Point3f));
+        normals = section(nNormals * sizeof(Normal3f));
+        texCoords = section(nTexCoords * sizeof(Point2f));
+        indices = section(nTriangles * sizeof(VertexIndices));
+        materials = section(nTriangles * sizeof(uint16_t));
+        fileSize = offset;
+    }
+
+    void Mesh::toBinary(std::vector<char> &buffer) const {
+        MeshFileHeader header;
+        header.nNames = _names.size();
+        header.nPositions = _vertex_data.position.size();
+        header.nNormals = _vertex_data.normal.size();
+        header.nTexCoords = _vertex_data.tex_coord.size();
+        header.nTriangles = indices.size();
+        std::string names;
+        for (const auto &i : _names) {
+            names += i;
+            names += '\0';
+        }
+        header.namesSize = names.size();
+        header.layout();
+
+        buffer.assign(header.fileSize, 0);
+        auto data = buffer.data();
+        std::memcpy(data + header.names, names.data(), names.size());
+        std::memcpy(data + header.positions, _vertex_data.position.data(), header.nPositions * sizeof(Point3f));
+        std::memcpy(data + header.normals, _vertex_data.normal.data(), header.nNormals * sizeof(Normal3f));
+        std::memcpy(data + header.texCoords, _vertex_data.tex_coord.data(), header.nTexCoords * sizeof(Point2f));
+        // written welded, so that loading can use the vertex data in place
+        for (size_t i = 0; i < indices.size(); i++) {
+            VertexIndices corners;
+            corners.position = indices[i];
+            corners.normal = header.nNormals ? indices[i] : Point3i(-1);
+            corners.texCoord = header.nTexCoords ? indices[i] : Point3i(-1);
+            std::memcpy(data + header.indices + i * sizeof(VertexIndices), &corners, sizeof(VertexIndices));
         }
+        std::memcpy(data + header.materials, materialIds.data(), header.nTriangles * sizeof(uint16_t));
+        header.checksum = MeshFileHeader::Checksum(data + sizeof(header), buffer.size() - sizeof(header));
+        std::memcpy(data, &header, sizeof(header));
     }
 
     void Mesh::fromBinary(const std::vector<char> &buffer) {
+        if (IsMeshV2(buffer.data(), buffer.size())) {
+            std::vector<char> copy(buffer);
+            LoadMeshV2(*this, copy.data(), copy.size(), nullptr);
+            return;
+        }
         std::string magic;
         auto iter = buffer.begin();
         auto end = buffer.end();
@@ -165,18 +281,19 @@ namespace miyuki::core {
         }
         iter = read(iter, end, size);
 
-        triangles.resize(size);
+        std::vector<VertexIndices> corners(size);
 
-        for (auto &i: triangles) {
-            iter = read(iter, end, i.indices);
+        for (auto &i: corners) {
+            iter = read(iter, end, i);
 
         }
         iter = read(iter, end, size);
-        MIYUKI_CHECK(size == triangles.size());
-        for (auto &i:triangles) {
-            iter = read(iter, end, i.name_id);
-            i.mesh = this;
+        MIYUKI_CHECK(size == corners.size());
+        std::vector<uint16_t> nameIds(size);
+        for (auto &i:nameIds) {
+            iter = read(iter, end, i);
         }
+        setTriangles(corners.data(), nameIds.data(), corners.size());
         log::log("loaded {} vertices, {} normals, {} tex coords, {} primitives\n",
                  _vertex_data.position.size(), _vertex_data.normal.size(), _vertex_data.tex_coord.size(),
                  triangles.size());
@@ -185,20 +302,20 @@ namespace miyuki::core {
 
     bool Mesh::loadFromFile(const std::string &filename) {
         try {
-            std::ifstream in(filename, std::ios::binary | std::ios::in);
-            if (in) {
-                in.seekg(0, std::ios::end);
-                size_t size = in.tellg();
-                in.seekg(0, std::ios::beg);
-                std::vector<char> buffer(size);
-                in.read(buffer.data(), size);
-                fromBinary(buffer);
-                _loaded = true;
-                return true;
-            } else {
+            if (!fs::exists(filename)) {
                 return false;
             }
-        } catch (std::runtime_error &error) {
+            auto file = std::make_shared<MappedFile>(filename, MappedFile::CopyOnWrite);
+            auto data = static_cast<char *>(file->data());
+            if (IsMeshV2(data, file->size())) {
+                LoadMeshV2(*this, data, file->size(), file);
+            } else {
+                fromBinary(std::vector<char>(data, data + file->size()));
+            }
+            _loaded = true;
+            return true;
+        } catch (std::exception &error) {
+            // version 1 files past their end throw std::out_of_range
             log::log("error: {}\n", error.what());
             return false;
         }
@@ -210,6 +327,66 @@ namespace miyuki::core {
         }
     }
 
+    void Mesh::setTriangles(const VertexIndices *corners, const uint16_t *materials, size_t count) {
+        auto &v = _vertex_data;
+        bool hasNormals = !v.normal.empty(), hasTexCoords = !v.tex_coord.empty();
+        bool welded = true;
+        for (size_t i = 0; i < count; i++) {
+            for (int j = 0; j < 3; j++) {
+                auto p = corners[i].position[j], n = corners[i].normal[j], t = corners[i].texCoord[j];
+                if (p < 0 || size_t(p) >= v.position.size() || n < -1 || (n >= 0 && size_t(n) >= v.normal.size()) ||
+                    t < -1 || (t >= 0 && size_t(t) >= v.tex_coord.size())) {
+                    MIYUKI_THROW(std::runtime_error, fmt::format("Triangle {} has a vertex index out of range", i));
+                }
+                welded = welded && (!hasNormals || n == p) && (!hasTexCoords || t == p);
+            }
+        }
+        indices.resize(count);
+        materialIds.assign(materials, materials + count);
+        if (welded) {
+            for (size_t i = 0; i < count; i++) {
+                indices[i] = corners[i].position;
+            }
+        } else {
+            struct CornerHash {
+                size_t operator()(const std::array<int, 3> &c) const {
+                    return size_t(c[0]) * 73856093u ^ size_t(c[1]) * 19349663u ^ size_t(c[2]) * 83492791u;
+                }
+            };
+            std::unordered_map<std::array<int, 3>, int, CornerHash> vertices;
+            VertexData out;
+            out.position.reserve(v.position.size());
+            for (size_t i = 0; i < count; i++) {
+                for (int j = 0; j < 3; j++) {
+                    std::array<int, 3> key{corners[i].position[j], hasNormals ? corners[i].normal[j] : -1,
+                                           hasTexCoords ? corners[i].texCoord[j] : -1};
+                    auto [it, inserted] = vertices.emplace(key, int(out.position.size()));
+                    if (inserted) {
+                        out.position.push_back(v.position[key[0]]);
+                        if (hasNormals)
+                            out.normal.push_back(key[1] >= 0 ? v.normal[key[1]] : Normal3f(0));
+                        if (hasTexCoords)
+                            out.tex_coord.push_back(key[2] >= 0 ? v.tex_coord[key[2]]
+                                                                : Point2f(std::numeric_limits<float>::quiet_NaN()));
+                    }
+                    indices[i][j] = it->second;
+                }
+            }
+            v = std::move(out);
+        }
+        buildTriangles();
+        _topologyChanged = true;
+    }
+
+    void Mesh::buildTriangles() {
+        triangles.resize(indices.size());
+        for (uint32_t i = 0; i < triangles.size(); i++) {
+            triangles[i].mesh = this;
+            triangles[i].primitiveId = i;
+        }
+        emissiveTriangles.clear();
+    }
+
 
 }
 
@@ -0,0 +1,230 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.renderer/snapshot.h>
+#include <miyuki.renderer/graph.h>
+#include <miyuki.renderer/scene.h>
+#include <miyuki.renderer/mesh.h>
+#include <miyuki.foundation/imageloader.h>
+#include <miyuki.foundation/mappedfile.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/profiler.h>
+#include <set>
+
+namespace miyuki::core {
+    static const char SnapshotMagic[8] = "MYKSNAP";
+    static constexpr uint32_t SnapshotVersion = 2;
+
+    static json Geometry(const json &description) {
+        return {{"shapes",      description.value("shapes", json())},
+                {"accelerator", description.value("accelerator", json())}};
+    }
+
+    // calls f with every string in j that names an existing file
+    template<class F>
+    static void ForEachFile(const json &j, F &&f) {
+        if (j.is_string()) {
+            std::error_code ec;
+            auto path = ResolvePath(j.get<std::string>());
+            if (fs::is_regular_file(path, ec)) {
+                f(path);
+            }
+        } else if (j.is_structured()) {
+            for (auto &i : j) {
+                ForEachFile(i, f);
+            }
+        }
+    }
+
+    // calls f with the imagePath of every ImageTextureShader in j
+    template<class F>
+    static void ForEachTexture(const json &j, F &&f) {
+        if (j.is_object() && j.contains("type") && j["type"] == "ImageTextureShader" && j.contains("props") &&
+            j["props"].is_object() && j["props"].contains("imagePath") && j["props"]["imagePath"].is_string()) {
+            f(j["props"]["imagePath"].get<std::string>());
+        }
+        if (j.is_structured()) {
+            for (auto &i : j) {
+                ForEachTexture(i, f);
+            }
+        }
+    }
+
+    static bool ReadHeader(SnapshotReader &in) {
+        char magic[sizeof(SnapshotMagic)];
+        in.read(magic);
+        return std::memcmp(magic, SnapshotMagic, sizeof(magic)) == 0 && in.read<uint32_t>() == SnapshotVersion;
+    }
+
+    std::string SceneKey(const json &description) {
+        auto geometry = Geometry(description);
+        auto key = fs::absolute(ResolvePath(".")).string() + "\n" + geometry.dump();
+        ForEachFile(geometry, [&](const fs::path &path) {
+            key += fmt::format("\n{} {} {}", path.string(), fs::file_size(path),
+                               fs::last_write_time(path).time_since_epoch().count());
+        });
+        return key;
+    }
+
+    void WriteSceneSnapshot(const std::string &filename, const json &description, const Scene &scene) {
+        Profiler profiler;
+        auto path = ResolvePath(filename);
+        auto tmp = path.string() + ".tmp";
+        {
+            SnapshotWriter out(tmp);
+            out.writeBytes(SnapshotMagic, sizeof(SnapshotMagic));
+            out.write(SnapshotVersion);
+            out.write(SceneKey(description));
+            out.write(description.dump());
+
+            out.write(uint64_t(scene.meshes.size()));
+            for (const auto &mesh : scene.meshes) {
+                out.write(uint64_t(mesh->_names.size()));
+                for (const auto &name : mesh->_names) {
+                    out.write(name);
+                }
+                auto &v = mesh->_vertex_data;
+                out.writeArray(v.position.data(), v.position.size());
+                out.writeArray(v.normal.data(), v.normal.size());
+                out.writeArray(v.tex_coord.data(), v.tex_coord.size());
+                out.writeArray(mesh->indices.data(), mesh->indices.size());
+                out.writeArray(mesh->materialIds.data(), mesh->materialIds.size());
+            }
+
+            std::set<std::string> textures;
+            ForEachTexture(Geometry(description), [&](const std::string &texture) {
+                std::error_code ec;
+                if (fs::is_regular_file(ResolvePath(texture), ec)) {
+                    textures.insert(fs::absolute(ResolvePath(texture)).string());
+                }
+            });
+            std::vector<std::pair<std::string, std::shared_ptr<RGBAImage>>> images;
+            for (const auto &texture : textures) {
+                // already decoded by the shaders, so this comes out of the loader's cache
+                if (auto image = ImageLoader::getInstance()->loadRGBAImage(texture)) {
+                    images.emplace_back(texture, image);
+                }
+            }
+            out.write(uint64_t(images.size()));
+            for (const auto &[texture, image] : images) {
+                out.write(texture);
+                out.write(int32_t(image->dimension[0]));
+                out.write(int32_t(image->dimension[1]));
+                out.writeArray(image->data(), size_t(image->dimension[0]) * image->dimension[1]);
+            }
+
+            auto &accelerator = scene.getAccelerator();
+            bool saveAccelerator = accelerator && accelerator->supportsSnapshot();
+            out.write(uint8_t(saveAccelerator));
+            if (saveAccelerator) {
+                accelerator->saveSnapshot(out);
+            }
+            if (!out.good()) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Failed writing {}", tmp));
+            }
+        }
+        fs::rename(tmp, path);
+        log::log("Scene snapshot written to {} in {:.3f}secs, {:.1f}MB\n", path.string(),
+                 profiler.elapsed<double>().count(), fs::file_size(path) / 1e6);
+    }
+
+    std::shared_ptr<Scene> LoadSceneSnapshot(const std::string &filename, const json &description, SceneGraph &graph) {
+        auto path = ResolvePath(filename);
+        std::error_code ec;
+        if (!fs::is_regular_file(path, ec)) {
+            return nullptr;
+        }
+        Profiler profiler;
+        auto file = std::make_shared<MappedFile>(path.string(), MappedFile::CopyOnWrite);
+        SnapshotReader in(file->data(), file->size());
+        // vertex data are used in place
+        auto map = [&](auto &buffer) {
+            using T = std::remove_reference_t<decltype(buffer[0])>;
+            size_t count;
+            auto p = in.view<T>(count);
+            buffer.map(file, const_cast<T *>(p), count);
+        };
+        if (!ReadHeader(in)) {
+            log::log("{} is not a snapshot of this version\n", path.string());
+            return nullptr;
+        }
+        std::string key, stored;
+        in.read(key);
+        if (key != SceneKey(description)) {
+            log::log("Snapshot {} is of other shapes or files, not using it\n", path.string());
+            return nullptr;
+        }
+        in.read(stored);
+
+        auto scene = graph.createScene();
+        if (in.read<uint64_t>() != scene->meshes.size()) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Corrupt snapshot {}", path.string()));
+        }
+        for (auto &mesh : scene->meshes) {
+            mesh->_names.resize(in.read<uint64_t>());
+            for (auto &name : mesh->_names) {
+                in.read(name);
+            }
+            map(mesh->_vertex_data.position);
+            map(mesh->_vertex_data.normal);
+            map(mesh->_vertex_data.tex_coord);
+            map(mesh->indices);
+            map(mesh->materialIds);
+            if (mesh->indices.size() != mesh->materialIds.size()) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Corrupt snapshot {}", path.string()));
+            }
+            mesh->buildTriangles();
+            mesh->_loaded = true;
+        }
+
+        auto nImages = in.read<uint64_t>();
+        for (size_t i = 0; i < nImages; i++) {
+            std::string texture;
+            in.read(texture);
+            auto w = in.read<int32_t>(), h = in.read<int32_t>();
+            size_t count;
+            auto texels = in.view<float4>(count);
+            if (count != size_t(w) * h) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Corrupt snapshot {}", path.string()));
+            }
+            auto image = std::make_shared<RGBAImage>(Vec2i(w, h));
+            std::memcpy(image->data(), texels, count * sizeof(float4));
+            ImageLoader::getInstance()->insert(texture, image);
+        }
+
+        scene->preprocess(in);
+        log::log("Scene restored from snapshot {} in {:.3f}secs\n", path.string(), profiler.elapsed<double>().count());
+        return scene;
+    }
+
+    json ReadSnapshotDescription(const std::string &filename) {
+        MappedFile file(ResolvePath(filename).string());
+        SnapshotReader in(file.data(), file.size());
+        if (!ReadHeader(in)) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{} is not a scene snapshot of this version", filename));
+        }
+        std::string key, description;
+        in.read(key);
+        in.read(description);
+        return json::parse(description);
+    }
+} // namespace miyuki::core
@@ -0,0 +1,133 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <cxxopts.hpp>
+#include <miyuki.foundation/defs.h>
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/mappedfile.h>
+#include <miyuki.foundation/parallel.h>
+#include <miyuki.foundation/profiler.h>
+#include <cstring>
+#include <iostream>
+
+using namespace miyuki;
+using core::FilmDumpHeader;
+
+static FilmDumpHeader ReadHeader(const MappedFile &file, const std::string &filename) {
+    FilmDumpHeader header;
+    if (file.size() >= sizeof(header)) {
+        std::memcpy(&header, file.data(), sizeof(header));
+    }
+    if (!header.valid() || file.size() != sizeof(header) + header.payloadSize()) {
+        MIYUKI_THROW(std::runtime_error, fmt::format("{} is not a film dump", filename));
+    }
+    return header;
+}
+
+// dst[i] (+)= src[i], in chunks spread over all cores
+static void Accumulate(float *dst, const float *src, size_t count, bool first) {
+    const size_t chunkSize = 1u << 16u;
+    ParallelFor(0, (count + chunkSize - 1) / chunkSize, [=](int64_t chunk, uint64_t) {
+        auto begin = chunk * chunkSize, end = std::min(count, begin + chunkSize);
+        if (first) {
+            std::memcpy(dst + begin, src + begin, sizeof(float) * (end - begin));
+        } else {
+            for (auto i = begin; i < end; i++) {
+                dst[i] += src[i];
+            }
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    try {
+        cxxopts::Options options("myk.merge", "miyuki-renderer :: Merges films rendered from disjoint sample ranges");
+        options.add_options()
+                ("o,out", "Output file name, .film writes the merged dump instead of an image",
+                 cxxopts::value<std::string>())
+                ("inputs", "Film dumps to merge", cxxopts::value<std::vector<std::string>>())
+                ("h,help", "Print help and exit.");
+        options.parse_positional({"inputs"});
+        options.positional_help("film...");
+        auto result = options.parse(argc, argv);
+        if (result.count("help") || result.count("inputs") == 0) {
+            std::cout << options.help({""}) << std::endl;
+            return 0;
+        }
+        auto inputs = result["inputs"].as<std::vector<std::string>>();
+        std::string outFile = result.count("out") != 0 ? result["out"].as<std::string>() : "out.png";
+        bool dumpOutput = fs::path(outFile).extension() == ".film";
+
+        Profiler profiler;
+        // inputs are mapped one at a time and summed into the output, itself mapped when it is a dump
+        FilmDumpHeader header;
+        std::unique_ptr<MappedFile> outDump;
+        std::vector<float> buffer;
+        float *sum = nullptr;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            Profiler inputTime;
+            MappedFile file(inputs[i]);
+            auto inputHeader = ReadHeader(file, inputs[i]);
+            if (i == 0) {
+                header = inputHeader;
+                if (dumpOutput) {
+                    outDump = std::make_unique<MappedFile>(outFile, MappedFile::Create,
+                                                           sizeof(header) + header.payloadSize());
+                    std::memcpy(outDump->data(), &header, sizeof(header));
+                    sum = reinterpret_cast<float *>(reinterpret_cast<char *>(outDump->data()) + sizeof(header));
+                } else {
+                    buffer.resize(header.payloadSize() / sizeof(float));
+                    sum = buffer.data();
+                }
+            } else if (!header.compatible(inputHeader)) {
+                MIYUKI_THROW(std::runtime_error,
+                             fmt::format("{} does not match {}: {}x{} planes {:#x} vs {}x{} planes {:#x}", inputs[i],
+                                         inputs[0], inputHeader.width, inputHeader.height, inputHeader.planes,
+                                         header.width, header.height, header.planes));
+            }
+            auto payload = reinterpret_cast<const float *>(reinterpret_cast<const char *>(file.data()) +
+                                                           sizeof(inputHeader));
+            Accumulate(sum, payload, header.payloadSize() / sizeof(float), i == 0);
+            log::log("Merged {} ({:.1f} MB) in {:.3f}secs\n", inputs[i], file.size() / 1e6,
+                     inputTime.elapsed<double>().count());
+        }
+        if (dumpOutput) {
+            outDump.reset();
+            log::log("saved to {}\n", outFile);
+        } else {
+            auto film = core::Film::fromDump(header, sum);
+            double weight = 0;
+            for (size_t i = 0; i < film->width * film->height; i++) {
+                weight += film->weight.data()[i].r();
+            }
+            log::log("{} films, {:.1f} samples per pixel\n", inputs.size(), weight / (film->width * film->height));
+            film->writeImage(outFile);
+        }
+        log::log("Done in {:.3f}secs\n", profiler.elapsed<double>().count());
+        return 0;
+    } catch (std::exception &e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return -1;
+    }
+}
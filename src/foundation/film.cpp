@@ -29,6 +29,10 @@
 #include <stb_image_write.h>
 #include <lodepng.h>
 #include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/mappedfile.h>
+#include <miyuki.foundation/defs.h>
+#include <fstream>
+#include <cstring>
 
 namespace miyuki::core {
     void Film::writeImage(const std::string &filename) {
@@ -47,4 +51,96 @@ namespace miyuki::core {
             log::log("saved to {}\n", filename);
         }
     }
+
+    static const uint32_t DumpPlaneCount = 5;
+
+    template<class F>
+    static auto &DumpPlane(F &film, uint32_t i) {
+        decltype(&film.color) images[] = {&film.color, &film.normal, &film.albedo, &film.weight, &film.secondMoment};
+        return *images[i];
+    }
+
+    static size_t DumpPlaneChannels(uint32_t i) {
+        return 1u << i == FilmDumpHeader::Weight ? 1 : 3;
+    }
+
+    bool FilmDumpHeader::valid() const {
+        return std::equal(magic, magic + sizeof(magic), Magic) && version == Version && planes < (1u << DumpPlaneCount);
+    }
+
+    size_t FilmDumpHeader::channels() const {
+        size_t n = 0;
+        for (uint32_t i = 0; i < DumpPlaneCount; i++) {
+            if (planes & (1u << i)) {
+                n += DumpPlaneChannels(i);
+            }
+        }
+        return n;
+    }
+
+    void Film::writeDump(const std::string &filename, bool variance) const {
+        std::ofstream out(filename, std::ios::binary);
+        writeDump(out, variance);
+        if (!out) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Error writing {}", filename));
+        }
+    }
+
+    void Film::writeDump(std::ostream &out, bool variance) const {
+        FilmDumpHeader header;
+        std::copy(FilmDumpHeader::Magic, FilmDumpHeader::Magic + sizeof(header.magic), header.magic);
+        header.version = FilmDumpHeader::Version;
+        header.width = width;
+        header.height = height;
+        header.planes = FilmDumpHeader::Color | FilmDumpHeader::Normal | FilmDumpHeader::Albedo |
+                        FilmDumpHeader::Weight | (variance ? FilmDumpHeader::SecondMoment : 0u);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        std::vector<float> buffer;
+        for (uint32_t i = 0; i < DumpPlaneCount; i++) {
+            if (!(header.planes & (1u << i))) {
+                continue;
+            }
+            auto &plane = DumpPlane(*this, i);
+            auto channels = DumpPlaneChannels(i);
+            buffer.resize(channels * width * height);
+            for (size_t p = 0; p < width * height; p++) {
+                for (size_t c = 0; c < channels; c++) {
+                    buffer[p * channels + c] = plane.data()[p][c];
+                }
+            }
+            out.write(reinterpret_cast<const char *>(buffer.data()), sizeof(float) * buffer.size());
+        }
+    }
+
+    std::shared_ptr<Film> Film::fromDump(const FilmDumpHeader &header, const float *payload) {
+        auto film = std::make_shared<Film>(Vec2i(header.width, header.height));
+        auto pixels = size_t(header.width) * header.height;
+        for (uint32_t i = 0; i < DumpPlaneCount; i++) {
+            if (!(header.planes & (1u << i))) {
+                continue;
+            }
+            auto &plane = DumpPlane(*film, i);
+            auto channels = DumpPlaneChannels(i);
+            for (size_t p = 0; p < pixels; p++) {
+                for (size_t c = 0; c < channels; c++) {
+                    plane.data()[p][c] = payload[p * channels + c];
+                }
+            }
+            payload += channels * pixels;
+        }
+        return film;
+    }
+
+    std::shared_ptr<Film> Film::readDump(const std::string &filename) {
+        MappedFile file(filename);
+        FilmDumpHeader header;
+        if (file.size() >= sizeof(header)) {
+            std::memcpy(&header, file.data(), sizeof(header));
+        }
+        if (!header.valid() || file.size() != sizeof(header) + header.payloadSize()) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{} is not a film dump", filename));
+        }
+        return fromDump(header, reinterpret_cast<const float *>(
+                reinterpret_cast<const char *>(file.data()) + sizeof(header)));
+    }
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.foundation/filmsnapshot.h>
+#include <stb_image_write.h>
+#include <lodepng.h>
+#include <chrono>
+
+namespace miyuki::core {
+    std::vector<float3> FilmSnapshot::resolve() const {
+        std::vector<float3> pixels(width * height, float3(0));
+        for (auto &tile : tiles) {
+            if (!tile) {
+                continue;
+            }
+            auto &b = tile->bounds;
+            auto tileWidth = b.pMax.x() - b.pMin.x();
+            for (int y = b.pMin.y(); y < b.pMax.y(); y++) {
+                for (int x = b.pMin.x(); x < b.pMax.x(); x++) {
+                    auto i = (y - b.pMin.y()) * tileWidth + (x - b.pMin.x());
+                    auto w = tile->weight[i];
+                    pixels[y * width + x] = w == 0 ? float3(0) : tile->color[i] / w;
+                }
+            }
+        }
+        return pixels;
+    }
+
+    std::vector<unsigned char> FilmSnapshot::toRGBA8() const {
+        auto pixels = resolve();
+        std::vector<unsigned char> buffer;
+        buffer.reserve(pixels.size() * 4);
+        for (auto &p : pixels) {
+            buffer.emplace_back(Film::toInt(p[0]));
+            buffer.emplace_back(Film::toInt(p[1]));
+            buffer.emplace_back(Film::toInt(p[2]));
+            buffer.emplace_back(255);
+        }
+        return buffer;
+    }
+
+    std::vector<unsigned char> FilmSnapshot::encodePNG() const {
+        std::vector<unsigned char> png;
+        lodepng::encode(png, toRGBA8(), (uint32_t) width, (uint32_t) height);
+        return png;
+    }
+
+    std::vector<unsigned char> FilmSnapshot::encodeJPEG(int quality) const {
+        std::vector<unsigned char> jpeg;
+        auto write = [](void *context, void *data, int size) {
+            auto out = static_cast<std::vector<unsigned char> *>(context);
+            out->insert(out->end(), (unsigned char *) data, (unsigned char *) data + size);
+        };
+        stbi_write_jpg_to_func(write, &jpeg, (int) width, (int) height, 4, toRGBA8().data(), quality);
+        return jpeg;
+    }
+
+    void FilmPublisher::update(const Film &film, const Bounds2i &bounds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (film.width != width || film.height != height) {
+            width = film.width;
+            height = film.height;
+            tilesX = (width + FilmSnapshot::TileSize - 1) / FilmSnapshot::TileSize;
+            auto tilesY = (height + FilmSnapshot::TileSize - 1) / FilmSnapshot::TileSize;
+            tiles.assign(tilesX * tilesY, nullptr);
+        }
+        const int size = FilmSnapshot::TileSize;
+        for (int ty = bounds.pMin.y() / size; ty * size < bounds.pMax.y(); ty++) {
+            for (int tx = bounds.pMin.x() / size; tx * size < bounds.pMax.x(); tx++) {
+                auto &tile = tiles[ty * tilesX + tx];
+                if (tile && tile.use_count() > 1) {
+                    // snapshots taken so far keep the old tile
+                    tile = std::make_shared<FilmSnapshot::Tile>(*tile);
+                } else if (!tile) {
+                    tile = std::make_shared<FilmSnapshot::Tile>();
+                    tile->bounds = Bounds2i{Vec2i(tx * size, ty * size),
+                                            min(Vec2i(width, height), Vec2i((tx + 1) * size, (ty + 1) * size))};
+                    auto extent = tile->bounds.pMax - tile->bounds.pMin;
+                    tile->color.resize(extent.x() * extent.y(), float3(0));
+                    tile->weight.resize(extent.x() * extent.y(), 0);
+                }
+                auto region = tile->bounds.intersectionOf(bounds);
+                auto tileWidth = tile->bounds.pMax.x() - tile->bounds.pMin.x();
+                for (int y = region.pMin.y(); y < region.pMax.y(); y++) {
+                    for (int x = region.pMin.x(); x < region.pMax.x(); x++) {
+                        auto i = (y - tile->bounds.pMin.y()) * tileWidth + (x - tile->bounds.pMin.x());
+                        tile->color[i] = film.color(x, y);
+                        tile->weight[i] = film.weight(x, y).r();
+                    }
+                }
+            }
+        }
+        version++;
+        cv.notify_all();
+    }
+
+    void FilmPublisher::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        width = height = tilesX = 0;
+        tiles.clear();
+        tiles.shrink_to_fit();
+    }
+
+    std::shared_ptr<const FilmSnapshot> FilmPublisher::snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tiles.empty()) {
+            return nullptr;
+        }
+        auto snapshot = std::make_shared<FilmSnapshot>();
+        snapshot->width = width;
+        snapshot->height = height;
+        snapshot->version = version;
+        snapshot->tiles.assign(tiles.begin(), tiles.end());
+        return snapshot;
+    }
+
+    std::shared_ptr<const FilmSnapshot> FilmPublisher::waitNewer(uint64_t after, double timeout) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::duration<double>(timeout), [&]() { return version > after; });
+        }
+        return snapshot();
+    }
+} // namespace miyuki::core
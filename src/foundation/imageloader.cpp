@@ -38,7 +38,8 @@ namespace miyuki {
     public:
         std::unordered_map<std::string, ImageRecord> cached;
 
-        std::shared_ptr<RGBAImage> loadRGBAImage(const fs::path &path) {
+        std::shared_ptr<RGBAImage> loadRGBAImage(const fs::path &relativePath) {
+            auto path = ResolvePath(relativePath);
             auto iter = cached.find(fs::absolute(path).string());
             auto last = fs::last_write_time(path);
 
@@ -89,12 +90,21 @@ namespace miyuki {
                 return iter->second.image;
             }
         }
+
+        void insert(const fs::path &relativePath, const std::shared_ptr<RGBAImage> &image) {
+            auto path = ResolvePath(relativePath);
+            cached[fs::absolute(path).string()] = ImageRecord{image, fs::last_write_time(path)};
+        }
     };
 
     ImageLoader::ImageLoader() : impl(new Impl()) {}
 
     std::shared_ptr<RGBAImage> ImageLoader::loadRGBAImage(const fs::path &path) { return impl->loadRGBAImage(path); }
 
+    void ImageLoader::insert(const fs::path &path, const std::shared_ptr<RGBAImage> &image) {
+        impl->insert(path, image);
+    }
+
     static ImageLoader instance;
 
     ImageLoader *ImageLoader::getInstance() {
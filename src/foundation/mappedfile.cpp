@@ -0,0 +1,130 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.foundation/mappedfile.h>
+#include <miyuki.foundation/defs.h>
+#include <fmt/format.h>
+#include <stdexcept>
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+namespace miyuki {
+#ifdef _WIN32
+
+    MappedFile::MappedFile(const std::string &filename, Mode mode, size_t size) {
+        bool create = mode == Create;
+        file = CreateFileA(filename.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                           FILE_SHARE_READ, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            file = nullptr;
+            MIYUKI_THROW(std::runtime_error, fmt::format("Cannot open {}", filename));
+        }
+        if (create) {
+            length = size;
+        } else {
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            length = fileSize.QuadPart;
+        }
+        if (length == 0) {
+            return;
+        }
+        bool copy = mode == CopyOnWrite;
+        mapping = CreateFileMappingA(file, nullptr, create ? PAGE_READWRITE : copy ? PAGE_WRITECOPY : PAGE_READONLY,
+                                     DWORD(uint64_t(length) >> 32u), DWORD(length & 0xffffffffu), nullptr);
+        ptr = mapping ? MapViewOfFile(mapping, create ? FILE_MAP_WRITE : copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0,
+                                      length) : nullptr;
+        if (!ptr) {
+            close();
+            MIYUKI_THROW(std::runtime_error, fmt::format("Cannot map {}", filename));
+        }
+    }
+
+    void MappedFile::close() {
+        if (ptr) {
+            UnmapViewOfFile(ptr);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file) {
+            CloseHandle(file);
+        }
+        ptr = mapping = file = nullptr;
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::string &filename, Mode mode, size_t size) {
+        bool create = mode == Create;
+        fd = create ? open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Cannot open {}", filename));
+        }
+        if (create) {
+            if (ftruncate(fd, size) != 0) {
+                close();
+                MIYUKI_THROW(std::runtime_error, fmt::format("Cannot resize {} to {} bytes", filename, size));
+            }
+            length = size;
+        } else {
+            struct stat st{};
+            fstat(fd, &st);
+            length = st.st_size;
+        }
+        if (length == 0) {
+            return;
+        }
+        ptr = mode == CopyOnWrite ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                                  : mmap(nullptr, length, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            ptr = nullptr;
+            close();
+            MIYUKI_THROW(std::runtime_error, fmt::format("Cannot map {}", filename));
+        }
+    }
+
+    void MappedFile::close() {
+        if (ptr) {
+            munmap(ptr, length);
+            ptr = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+#endif
+}
@@ -33,13 +33,12 @@
 namespace miyuki {
     class ParallelForContext {
         std::vector<std::thread> workers;
-        std::mutex taskMutex, mainMutex;
+        std::mutex taskMutex;
         std::condition_variable mainWaiting, taskWaiting;
         std::atomic<bool> shutdown;
         std::deque<std::pair<int64_t, int64_t>> queue;
         std::atomic<uint32_t> activeWorkers;
         WorkFunc workFunc;
-        std::atomic<bool> isMainWaiting;
       public:
         ParallelForContext() noexcept : workers(GetCoreNumber()), shutdown(false), activeWorkers(0) {
             for (int i = 0; i < workers.size(); i++) {
@@ -62,12 +61,8 @@ namespace miyuki {
                             }
                             lock.lock();
                             activeWorkers--;
-                            if(queue.empty() && activeWorkers == 0){
-                                {
-                                    std::unique_lock<std::mutex> lock1(mainMutex);
-                                    if(isMainWaiting)
-                                        mainWaiting.notify_one();
-                                }
+                            if (queue.empty() && activeWorkers == 0) {
+                                mainWaiting.notify_one();
                             }
                         }
                     }
@@ -88,24 +83,19 @@ namespace miyuki {
         }
 
         void parallelFor(int64_t begin, int64_t end, WorkFunc func, size_t workSize) {
-            {
-                std::unique_lock<std::mutex> lock(taskMutex);
-                workFunc = std::move(func);
-                while (begin < end) {
-                    auto lo = begin;
-                    auto hi = std::min<size_t>(end, begin + workSize);
-                    queue.emplace_back(lo, hi);
-                    begin += workSize;
-                }
-
-                taskWaiting.notify_all();
-                isMainWaiting = true;
-            }
-            {
-                std::unique_lock<std::mutex> lock(mainMutex);
-                mainWaiting.wait(lock);
-                isMainWaiting = false;
+            std::unique_lock<std::mutex> lock(taskMutex);
+            workFunc = std::move(func);
+            while (begin < end) {
+                auto lo = begin;
+                auto hi = std::min<size_t>(end, begin + workSize);
+                queue.emplace_back(lo, hi);
+                begin += workSize;
             }
+
+            taskWaiting.notify_all();
+            // the predicate is checked under taskMutex, so a batch finishing before we
+            // get here cannot be missed
+            mainWaiting.wait(lock, [this]() { return queue.empty() && activeWorkers == 0; });
         }
     };
 
@@ -116,6 +106,52 @@ namespace miyuki {
         parallelForContext.parallelFor(begin, end, std::move(func), workSize);
     }
 
+    void ParallelRadixSort(std::vector<uint64_t> &keys, int lowBit, int highBit) {
+        constexpr int digitBits = 8;
+        constexpr size_t nDigits = 1u << digitBits;
+        constexpr size_t minChunkSize = 1u << 14u;
+        const size_t n = keys.size();
+        const size_t nChunks = std::clamp<size_t>(n / minChunkSize, 1, GetCoreNumber() * 4);
+        const size_t chunkSize = (n + nChunks - 1) / nChunks;
+        std::vector<uint64_t> buffer(n);
+        std::vector<size_t> offsets(nChunks * nDigits);
+        for (int shift = lowBit; shift < highBit; shift += digitBits) {
+            auto mask = (uint64_t(1) << std::min(digitBits, highBit - shift)) - 1;
+            auto forEachChunk = [&](const std::function<void(size_t, size_t, size_t)> &f) {
+                if (nChunks == 1) {
+                    f(0, 0, n);
+                } else {
+                    ParallelFor(0, nChunks, [&](int64_t chunk, size_t) {
+                        f(chunk, chunk * chunkSize, std::min(n, (chunk + 1) * chunkSize));
+                    });
+                }
+            };
+            std::fill(offsets.begin(), offsets.end(), 0);
+            forEachChunk([&](size_t chunk, size_t begin, size_t end) {
+                auto histogram = &offsets[chunk * nDigits];
+                for (auto i = begin; i < end; i++) {
+                    histogram[(keys[i] >> shift) & mask]++;
+                }
+            });
+            // digit-major exclusive scan keeps equal digits in chunk order, hence stable
+            size_t sum = 0;
+            for (size_t digit = 0; digit < nDigits; digit++) {
+                for (size_t chunk = 0; chunk < nChunks; chunk++) {
+                    auto count = offsets[chunk * nDigits + digit];
+                    offsets[chunk * nDigits + digit] = sum;
+                    sum += count;
+                }
+            }
+            forEachChunk([&](size_t chunk, size_t begin, size_t end) {
+                auto offset = &offsets[chunk * nDigits];
+                for (auto i = begin; i < end; i++) {
+                    buffer[offset[(keys[i] >> shift) & mask]++] = keys[i];
+                }
+            });
+            std::swap(keys, buffer);
+        }
+    }
+
     size_t GetCoreNumber() { return CoreNumber; }
 
     void SetCoreNumber(size_t N) { CoreNumber = N; }
@@ -0,0 +1,76 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.foundation/perfcounter.h>
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+#endif
+
+namespace miyuki {
+#ifdef __linux__
+
+    CacheMissCounter::CacheMissCounter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    CacheMissCounter::~CacheMissCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    uint64_t CacheMissCounter::read() const {
+        uint64_t count = 0;
+        if (fd < 0 || ::read(fd, &count, sizeof(count)) != sizeof(count)) {
+            return 0;
+        }
+        return count;
+    }
+
+#else
+
+    CacheMissCounter::CacheMissCounter() {}
+
+    CacheMissCounter::~CacheMissCounter() {}
+
+    uint64_t CacheMissCounter::read() const { return 0; }
+
+#endif
+}
@@ -35,7 +35,9 @@ int main(int argc, char **argv) {
         return 0;
     }
     auto importer = std::make_shared<core::WavefrontImporter>();
-    auto result = importer->importMesh(argv[1]);
+    // next to the scene, which refers to it by a relative path
+    auto outFile = fs::path(argv[1]).stem().string().append(".mesh");
+    auto result = importer->convert(argv[1], fs::absolute(argv[2]).parent_path() / outFile);
     if (!result.mesh) {
         std::cerr << "error importing " << argv[1] << std::endl;
     } else {
@@ -54,8 +56,7 @@ int main(int argc, char **argv) {
             graph = serialize::fromJson<core::SceneGraph>(*ctx, j);
         }
 
-        auto outFile = fs::path(argv[1]).stem().string().append(".mesh");
-        result.mesh->writeToFile(outFile);
+        result.mesh->filename = outFile;
         graph.shapes.push_back(result.mesh);
         std::ofstream out(sceneFile);
         out << serialize::toJson(*ctx, graph).dump(2) << std::endl;
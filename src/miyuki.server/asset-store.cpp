@@ -0,0 +1,105 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "asset-store.h"
+#include "sha256.h"
+#include <miyuki.foundation/log.hpp>
+#include <cstring>
+#include <fstream>
+#include <regex>
+
+namespace miyuki::server {
+    AssetStore::AssetStore(const fs::path &root) : root(fs::absolute(root)) {
+        fs::create_directories(this->root / "objects");
+        fs::create_directories(this->root / "tmp");
+        fs::create_directories(workdir());
+    }
+
+    bool AssetStore::validName(const std::string &name) {
+        static const std::regex pattern("[0-9a-f]{64}(\\.[A-Za-z0-9]+)?");
+        return std::regex_match(name, pattern);
+    }
+
+    fs::path AssetStore::path(const std::string &name) const {
+        return root / "objects" / name.substr(0, 2) / name;
+    }
+
+    bool AssetStore::contains(const std::string &name) const {
+        return validName(name) && fs::exists(path(name));
+    }
+
+    void AssetStore::store(const std::string &name, const Reader &reader) {
+        if (!validName(name)) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("{} is not a valid asset name", name));
+        }
+        auto tmp = root / "tmp" / fmt::format("{}.{}", name, uploads++);
+        Sha256 sha;
+        size_t size = 0;
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            auto ok = reader([&](const char *data, size_t length) {
+                sha.update(data, length);
+                out.write(data, length);
+                size += length;
+                return bool(out);
+            });
+            if (!ok || !out) {
+                out.close();
+                fs::remove(tmp);
+                MIYUKI_THROW(std::runtime_error, fmt::format("failed to receive {}", name));
+            }
+        }
+        auto hash = sha.finish();
+        if (hash != name.substr(0, 64)) {
+            fs::remove(tmp);
+            MIYUKI_THROW(std::runtime_error, fmt::format("content of {} hashes to {}", name, hash));
+        }
+        auto target = path(name);
+        fs::create_directories(target.parent_path());
+        // the same content may have been uploaded meanwhile, either copy will do
+        fs::rename(tmp, target);
+        log::log("Stored asset {}, {} bytes\n", name, size);
+    }
+
+    std::vector<std::string> AssetStore::resolve(json &j) const {
+        std::vector<std::string> missing;
+        std::function<void(json &)> visit = [&](json &value) {
+            if (value.is_string()) {
+                auto &s = value.get_ref<std::string &>();
+                if (s.rfind(Scheme, 0) == 0) {
+                    auto name = s.substr(std::strlen(Scheme));
+                    if (contains(name)) {
+                        s = path(name).string();
+                    } else {
+                        missing.push_back(name);
+                    }
+                }
+            } else if (value.is_structured()) {
+                for (auto &i : value) {
+                    visit(i);
+                }
+            }
+        };
+        visit(j);
+        return missing;
+    }
+} // namespace miyuki::server
@@ -0,0 +1,67 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_ASSET_STORE_H
+#define MIYUKIRENDERER_ASSET_STORE_H
+
+#include <miyuki.foundation/math.hpp>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace miyuki::server {
+    // Files uploaded by clients, stored once under the SHA-256 of their content. An asset is named
+    // "<sha256><extension>", e.g. "9f86...0a08.mesh", since loaders go by the extension, and scene
+    // files refer to it as "asset:<name>".
+    class AssetStore {
+        fs::path root;
+        std::atomic<uint64_t> uploads = 0;
+
+    public:
+        using Receiver = std::function<bool(const char *, size_t)>;
+        // calls the receiver with every chunk of the content
+        using Reader = std::function<bool(const Receiver &)>;
+
+        static constexpr const char *Scheme = "asset:";
+
+        explicit AssetStore(const fs::path &root);
+
+        static bool validName(const std::string &name);
+
+        [[nodiscard]] fs::path path(const std::string &name) const;
+
+        [[nodiscard]] bool contains(const std::string &name) const;
+
+        // streams the content to a temporary file while hashing it, the asset appears once the
+        // hash is checked; throws if it does not match the name
+        void store(const std::string &name, const Reader &reader);
+
+        // replaces every "asset:<name>" string in j by the path of the asset, returns the missing ones
+        std::vector<std::string> resolve(json &j) const;
+
+        // where jobs submitted without a working directory run
+        [[nodiscard]] fs::path workdir() const { return root / "work"; }
+    };
+} // namespace miyuki::server
+
+#endif //MIYUKIRENDERER_ASSET_STORE_H
@@ -0,0 +1,218 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "coordinator.h"
+#include "film-codec.h"
+#include <httplib.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/profiler.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace miyuki::server {
+    namespace {
+        struct WorkUnit {
+            int firstSample = 0;
+            int samples = 0;
+            bool done = false;
+            // workers rendering it right now, more than one when a slow unit is rendered again
+            int running = 0;
+            double startTime = 0;
+        };
+
+        class RenderJob {
+            // copies, worker threads stuck on a straggler may outlive Coordinator::render()
+            const CoordinatorConfig config;
+            const json scene;
+            const std::string workdir;
+            const std::string previewFile;
+            Profiler profiler;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<WorkUnit> units;
+            size_t remaining;
+            size_t activeWorkers;
+            double unitSeconds = 0;
+            size_t unitsTimed = 0;
+            double lastPreview = 0;
+            core::FilmDumpHeader header;
+            std::vector<float> film;
+
+            [[nodiscard]] double now() const { return profiler.elapsed<double>().count(); }
+
+            // a unit nobody renders, or a straggler to render again; -1 when there is nothing left
+            int nextUnit(std::unique_lock<std::mutex> &lock) {
+                while (remaining > 0) {
+                    for (size_t i = 0; i < units.size(); i++) {
+                        if (!units[i].done && units[i].running == 0) {
+                            return i;
+                        }
+                    }
+                    if (unitsTimed > 0) {
+                        auto average = unitSeconds / unitsTimed;
+                        for (size_t i = 0; i < units.size(); i++) {
+                            if (!units[i].done && units[i].running == 1 &&
+                                now() - units[i].startTime > config.slowFactor * average) {
+                                log::log("Unit {} is slow, rendering it again\n", i);
+                                return i;
+                            }
+                        }
+                    }
+                    cv.wait_for(lock, std::chrono::seconds(1));
+                }
+                return -1;
+            }
+
+            void accumulate(int unit, const std::string &data, const WorkerAddress &worker) {
+                core::FilmDumpHeader unitHeader;
+                std::vector<float> payload;
+                DecodeFilm(data, unitHeader, payload);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (units[unit].done) {
+                    log::log("Unit {} from {}:{} arrived late, discarded\n", unit, worker.host, worker.port);
+                    return;
+                }
+                if (film.empty()) {
+                    header = unitHeader;
+                    film = std::move(payload);
+                } else if (!header.compatible(unitHeader)) {
+                    MIYUKI_THROW(std::runtime_error, "Workers returned films of different layouts");
+                } else {
+                    for (size_t i = 0; i < film.size(); i++) {
+                        film[i] += payload[i];
+                    }
+                }
+                units[unit].done = true;
+                remaining--;
+                unitSeconds += now() - units[unit].startTime;
+                unitsTimed++;
+                log::log("Unit {} ({} spp) from {}:{} in {:.3f}secs, {}/{} units done\n", unit, units[unit].samples,
+                         worker.host, worker.port, now() - units[unit].startTime, units.size() - remaining,
+                         units.size());
+                if (!previewFile.empty() && remaining > 0 && now() - lastPreview > config.previewInterval) {
+                    core::Film::fromDump(header, film.data())->writeImage(previewFile);
+                    lastPreview = now();
+                }
+                cv.notify_all();
+            }
+
+        public:
+            RenderJob(const CoordinatorConfig &config, const json &scene, const std::string &workdir, int spp,
+                      const std::string &previewFile)
+                    : config(config), scene(scene), workdir(workdir), previewFile(previewFile),
+                      activeWorkers(config.workers.size()) {
+                int baseOffset = 0;
+                if (scene.contains("sampler") && scene["sampler"].contains("props") &&
+                    scene["sampler"]["props"].is_object() && scene["sampler"]["props"].contains("sampleOffset")) {
+                    baseOffset = scene["sampler"]["props"]["sampleOffset"].get<int>();
+                }
+                for (int first = 0; first < spp; first += config.samplesPerUnit) {
+                    WorkUnit unit;
+                    unit.firstSample = baseOffset + first;
+                    unit.samples = std::min(config.samplesPerUnit, spp - first);
+                    units.push_back(unit);
+                }
+                remaining = units.size();
+            }
+
+            void runWorker(const WorkerAddress &worker) {
+                httplib::Client client(worker.host.c_str(), worker.port);
+                client.set_timeout_sec(5);
+                client.set_read_timeout(config.timeout, 0);
+                int failures = 0;
+                std::unique_lock<std::mutex> lock(mutex);
+                int unit;
+                while ((unit = nextUnit(lock)) >= 0) {
+                    units[unit].running++;
+                    units[unit].startTime = now();
+                    json request = {{"workdir", workdir},
+                                    {"scene",   scene},
+                                    {"samples", {units[unit].firstSample, units[unit].samples}}};
+                    lock.unlock();
+                    auto response = client.Post("/render/tile", request.dump(), "application/json");
+                    std::string error;
+                    if (!response) {
+                        error = "no response";
+                    } else if (response->status != 200) {
+                        error = fmt::format("status {}: {}", response->status, response->body);
+                    } else {
+                        try {
+                            accumulate(unit, response->body, worker);
+                        } catch (std::exception &e) {
+                            error = e.what();
+                        }
+                    }
+                    lock.lock();
+                    units[unit].running--;
+                    cv.notify_all();
+                    if (error.empty()) {
+                        failures = 0;
+                        continue;
+                    }
+                    log::log("Worker {}:{} failed unit {}: {}\n", worker.host, worker.port, unit, error);
+                    if (++failures >= config.maxFailures) {
+                        log::log("Dropping worker {}:{}\n", worker.host, worker.port);
+                        break;
+                    }
+                    lock.unlock();
+                    std::this_thread::sleep_for(std::chrono::seconds(failures));
+                    lock.lock();
+                }
+                if (--activeWorkers == 0 && remaining > 0) {
+                    // nobody left to pick up the remaining units
+                    remaining = 0;
+                    cv.notify_all();
+                }
+            }
+
+            // until every unit is done or no worker is left, stragglers are not waited for
+            void wait() {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [=]() { return remaining == 0; });
+            }
+
+            std::shared_ptr<core::Film> result() {
+                std::lock_guard<std::mutex> lock(mutex);
+                bool complete = std::all_of(units.begin(), units.end(), [](const WorkUnit &u) { return u.done; });
+                if (!complete) {
+                    MIYUKI_THROW(std::runtime_error, "All workers failed, frame is incomplete");
+                }
+                log::log("Assembled {} units in {:.3f}secs\n", units.size(), now());
+                return core::Film::fromDump(header, film.data());
+            }
+        };
+    } // namespace
+
+    std::shared_ptr<core::Film>
+    Coordinator::render(const json &scene, const std::string &workdir, int spp, const std::string &previewFile) {
+        if (config.workers.empty()) {
+            MIYUKI_THROW(std::runtime_error, "No workers");
+        }
+        auto job = std::make_shared<RenderJob>(config, scene, workdir, spp, previewFile);
+        for (auto &worker : config.workers) {
+            std::thread([job, worker]() { job->runWorker(worker); }).detach();
+        }
+        job->wait();
+        return job->result();
+    }
+} // namespace miyuki::server
@@ -0,0 +1,67 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_COORDINATOR_H
+#define MIYUKIRENDERER_COORDINATOR_H
+
+#include <miyuki.foundation/film.h>
+#include <miyuki.serialize/serialize.hpp>
+#include <string>
+#include <vector>
+
+namespace miyuki::server {
+    struct WorkerAddress {
+        std::string host;
+        int port = 8080;
+    };
+
+    struct CoordinatorConfig {
+        std::vector<WorkerAddress> workers;
+        int samplesPerUnit = 4;
+        // seconds a worker may take for one unit before it is given up on and the unit re-queued
+        int timeout = 600;
+        // once the queue is empty, an idle worker renders again a unit that has been running this many
+        // times longer than the average unit; the first result to arrive counts
+        double slowFactor = 3.0;
+        // a worker is dropped after this many failed units in a row
+        int maxFailures = 3;
+        // seconds between writes of the partially assembled film
+        double previewInterval = 10;
+    };
+
+    // Renders a frame on several render servers. The samples of every pixel are split into units of
+    // samplesPerUnit, a worker renders one unit at a time through /render/tile, and the returned films are
+    // summed as they arrive.
+    class Coordinator {
+        CoordinatorConfig config;
+
+    public:
+        explicit Coordinator(CoordinatorConfig config) : config(std::move(config)) {}
+
+        // workdir is the scene directory relative to the workers' job root, the scene may refer to
+        // uploaded assets as "asset:<name>"; previewFile may be empty
+        std::shared_ptr<core::Film>
+        render(const json &scene, const std::string &workdir, int spp, const std::string &previewFile);
+    };
+} // namespace miyuki::server
+
+#endif //MIYUKIRENDERER_COORDINATOR_H
@@ -0,0 +1,127 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "film-codec.h"
+#include <miyuki.foundation/defs.h>
+#include <fmt/format.h>
+#include <cstring>
+#include <sstream>
+
+#ifdef MYK_USE_ZLIB
+
+#include <zlib.h>
+
+#endif
+
+namespace miyuki::server {
+    using core::FilmDumpHeader;
+
+    enum FilmEncoding : uint32_t {
+        Raw = 0,
+        ShuffledDeflate = 1
+    };
+
+    struct EncodedFilmHeader {
+        FilmDumpHeader dump;
+        uint32_t encoding = Raw;
+        uint32_t reserved = 0;
+    };
+
+    static void Shuffle(const char *src, char *dst, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            for (size_t b = 0; b < sizeof(float); b++) {
+                dst[b * count + i] = src[i * sizeof(float) + b];
+            }
+        }
+    }
+
+    static void Unshuffle(const char *src, char *dst, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            for (size_t b = 0; b < sizeof(float); b++) {
+                dst[i * sizeof(float) + b] = src[b * count + i];
+            }
+        }
+    }
+
+    std::string EncodeFilm(const core::Film &film) {
+        std::ostringstream out;
+        film.writeDump(out);
+        auto dump = out.str();
+        EncodedFilmHeader header;
+        std::memcpy(&header.dump, dump.data(), sizeof(header.dump));
+        auto payload = dump.data() + sizeof(header.dump);
+        auto payloadSize = dump.size() - sizeof(header.dump);
+        std::string encoded(sizeof(header), 0);
+#ifdef MYK_USE_ZLIB
+        header.encoding = ShuffledDeflate;
+        std::string shuffled(payloadSize, 0);
+        Shuffle(payload, shuffled.data(), payloadSize / sizeof(float));
+        auto bound = compressBound(payloadSize);
+        encoded.resize(sizeof(header) + bound);
+        auto size = bound;
+        if (compress2(reinterpret_cast<Bytef *>(encoded.data() + sizeof(header)), &size,
+                      reinterpret_cast<const Bytef *>(shuffled.data()), payloadSize, Z_BEST_SPEED) != Z_OK) {
+            MIYUKI_THROW(std::runtime_error, "Cannot compress film");
+        }
+        encoded.resize(sizeof(header) + size);
+#else
+        encoded.append(payload, payloadSize);
+#endif
+        std::memcpy(encoded.data(), &header, sizeof(header));
+        return encoded;
+    }
+
+    void DecodeFilm(const std::string &data, FilmDumpHeader &header, std::vector<float> &payload) {
+        EncodedFilmHeader encoded;
+        if (data.size() < sizeof(encoded)) {
+            MIYUKI_THROW(std::runtime_error, "Truncated film");
+        }
+        std::memcpy(&encoded, data.data(), sizeof(encoded));
+        header = encoded.dump;
+        if (!header.valid()) {
+            MIYUKI_THROW(std::runtime_error, "Not a film");
+        }
+        auto body = data.data() + sizeof(encoded);
+        auto bodySize = data.size() - sizeof(encoded);
+        payload.resize(header.payloadSize() / sizeof(float));
+        if (encoded.encoding == Raw) {
+            if (bodySize != header.payloadSize()) {
+                MIYUKI_THROW(std::runtime_error, "Truncated film");
+            }
+            std::memcpy(payload.data(), body, bodySize);
+            return;
+        }
+#ifdef MYK_USE_ZLIB
+        if (encoded.encoding == ShuffledDeflate) {
+            std::string shuffled(header.payloadSize(), 0);
+            uLongf size = shuffled.size();
+            if (uncompress(reinterpret_cast<Bytef *>(shuffled.data()), &size, reinterpret_cast<const Bytef *>(body),
+                           bodySize) != Z_OK || size != shuffled.size()) {
+                MIYUKI_THROW(std::runtime_error, "Corrupted film");
+            }
+            Unshuffle(shuffled.data(), reinterpret_cast<char *>(payload.data()), payload.size());
+            return;
+        }
+#endif
+        MIYUKI_THROW(std::runtime_error, fmt::format("Unsupported film encoding {}", encoded.encoding));
+    }
+} // namespace miyuki::server
@@ -0,0 +1,40 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_FILM_CODEC_H
+#define MIYUKIRENDERER_FILM_CODEC_H
+
+#include <miyuki.foundation/film.h>
+#include <string>
+#include <vector>
+
+namespace miyuki::server {
+    // A film dump for the wire: the dump header, then the payload with the four bytes of every float
+    // split into four planes (sign/exponent bytes of neighbouring texels are mostly equal) and deflated.
+    // Sent uncompressed when built without zlib.
+    std::string EncodeFilm(const core::Film &film);
+
+    // payload as in a .film file, throws on malformed data
+    void DecodeFilm(const std::string &data, core::FilmDumpHeader &header, std::vector<float> &payload);
+} // namespace miyuki::server
+
+#endif //MIYUKIRENDERER_FILM_CODEC_H
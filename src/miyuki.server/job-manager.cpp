@@ -0,0 +1,272 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "job-manager.h"
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/log.hpp>
+#include <algorithm>
+
+namespace miyuki::server {
+    static const char *ToString(JobState state) {
+        switch (state) {
+            case JobState::Queued:
+                return "queued";
+            case JobState::Running:
+                return "running";
+            case JobState::Done:
+                return "done";
+            case JobState::Failed:
+                return "failed";
+            case JobState::Cancelled:
+                return "cancelled";
+        }
+        return "unknown";
+    }
+
+    JobManager::JobManager(std::shared_ptr<serialize::Context> context, SceneCache &sceneCache,
+                           std::mutex &renderMutex, size_t maxQueued, size_t maxFinished)
+            : context(std::move(context)), sceneCache(sceneCache), renderMutex(renderMutex), maxQueued(maxQueued),
+              maxFinished(maxFinished) {
+        runner = std::thread([this]() { run(); });
+    }
+
+    JobManager::~JobManager() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shutdown = true;
+            for (auto &job : queue) {
+                job->state = JobState::Cancelled;
+            }
+            queue.clear();
+            for (auto &[id, job] : jobs) {
+                if (job->task) {
+                    job->task->kill();
+                }
+            }
+        }
+        cv.notify_all();
+        runner.join();
+    }
+
+    std::optional<uint64_t> JobManager::submit(JobRequest request) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= maxQueued) {
+            return std::nullopt;
+        }
+        auto job = std::make_shared<Job>();
+        job->id = nextId++;
+        job->request = std::move(request);
+        if (job->request.out.empty()) {
+            job->request.out = fmt::format("job-{}.png", job->id);
+        }
+        job->progress = std::make_shared<core::RenderProgress>();
+        jobs[job->id] = job;
+        queue.push_back(job);
+        cv.notify_one();
+        return job->id;
+    }
+
+    std::optional<json> JobManager::status(uint64_t id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) {
+            return std::nullopt;
+        }
+        return describe(*it->second);
+    }
+
+    json JobManager::list() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        json list = json::array();
+        for (auto &[id, job] : jobs) {
+            list.push_back(describe(*job));
+        }
+        return list;
+    }
+
+    bool JobManager::cancel(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) {
+            return false;
+        }
+        auto &job = it->second;
+        if (job->state == JobState::Queued) {
+            queue.erase(std::find(queue.begin(), queue.end(), job));
+            job->state = JobState::Cancelled;
+            finished.push_back(id);
+            return true;
+        }
+        if (job->state != JobState::Running) {
+            return false;
+        }
+        // a job still loading its scene is stopped by execute() once the task exists
+        job->state = JobState::Cancelled;
+        stopProgress(*job);
+        if (job->task) {
+            job->task->kill();
+        }
+        return true;
+    }
+
+    std::optional<std::shared_ptr<const core::FilmSnapshot>>
+    JobManager::frame(uint64_t id, uint64_t after, double timeout) {
+        std::shared_ptr<core::RenderProgress> progress;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = jobs.find(id);
+            if (it == jobs.end()) {
+                return std::nullopt;
+            }
+            progress = it->second->progress;
+        }
+        if (timeout > 0) {
+            return progress->frame.waitNewer(after, timeout);
+        }
+        return progress->frame.snapshot();
+    }
+
+    // called with mutex held
+    json JobManager::describe(const Job &job) const {
+        json status;
+        status["id"] = job.id;
+        status["state"] = ToString(job.state);
+        status["out"] = job.request.out;
+        if (!job.error.empty()) {
+            status["error"] = job.error;
+        }
+        if (job.state == JobState::Queued) {
+            status["position"] = std::find_if(queue.begin(), queue.end(), [&](auto &j) { return j->id == job.id; }) -
+                                 queue.begin();
+            return status;
+        }
+        if (job.startTime == 0) {
+            return status;
+        }
+        bool running = job.state == JobState::Running;
+        double fraction = running ? job.progress->fraction.load() : job.fraction;
+        auto elapsed = (job.endTime > 0 ? job.endTime : profiler.elapsed<double>().count()) - job.startTime;
+        // the scene is only read once the task is published, and dropped when the job finishes
+        auto rays = job.task ? job.progress->scene->getRayCounter() : job.rays;
+        status["progress"] = fraction;
+        status["spp"] = running ? job.progress->samplesPerPixel.load() : job.samplesPerPixel;
+        status["elapsed"] = elapsed;
+        status["mraysPerSec"] = elapsed > 0 ? rays / elapsed / 1e6 : 0.0;
+        if (running && fraction > 0) {
+            status["eta"] = elapsed * (1 - fraction) / fraction;
+        }
+        return status;
+    }
+
+    void JobManager::run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this]() { return shutdown || !queue.empty(); });
+            if (shutdown) {
+                return;
+            }
+            auto job = queue.front();
+            queue.pop_front();
+            job->state = JobState::Running;
+            lock.unlock();
+            execute(*job);
+            lock.lock();
+            finished.push_back(job->id);
+            if (finished.size() > framesKept) {
+                auto it = jobs.find(finished[finished.size() - framesKept - 1]);
+                if (it != jobs.end()) {
+                    it->second->progress->frame.clear();
+                }
+            }
+            while (finished.size() > maxFinished) {
+                jobs.erase(finished.front());
+                finished.pop_front();
+            }
+        }
+    }
+
+    // tiles skipped after a kill still count as done to the integrator, so the last values are kept
+    void JobManager::stopProgress(Job &job) {
+        job.fraction = job.progress->fraction;
+        job.samplesPerPixel = job.progress->samplesPerPixel;
+    }
+
+    void JobManager::finish(Job &job, JobState state, const std::string &error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.task = nullptr;
+        if (job.progress->scene) {
+            job.rays = job.progress->scene->getRayCounter();
+            job.progress->scene.reset();
+        }
+        if (job.startTime > 0) {
+            job.endTime = profiler.elapsed<double>().count();
+        }
+        if (job.state == JobState::Cancelled) {
+            return;
+        }
+        job.state = state;
+        job.error = error;
+        stopProgress(job);
+        if (state == JobState::Done) {
+            job.fraction = 1;
+        }
+        log::log("Job {} {}{}\n", job.id, ToString(state), error.empty() ? "" : ": " + error);
+    }
+
+    void JobManager::execute(Job &job) {
+        std::lock_guard<std::mutex> renderLock(renderMutex);
+        // outlives the try block, job.task points to it until finish()
+        Task<core::RenderOutput> task;
+        try {
+            WorkingDirectoryGuard guard(job.request.workdir);
+            auto graph = serialize::fromJson<core::SceneGraph>(*context, job.request.scene);
+            graph.progress = job.progress;
+            // frames are read from the progress' publisher, the channel has no receiver
+            auto tx = mpsc::channel<std::shared_ptr<core::Film>>().tx;
+            task = graph.createRenderTask(context, sceneCache.get(graph, job.request.scene), tx);
+            task.launch();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job.startTime = profiler.elapsed<double>().count();
+                job.task = &task;
+                if (job.state == JobState::Cancelled || shutdown) {
+                    task.kill();
+                }
+            }
+            auto result = task.wait();
+            std::shared_ptr<core::Film> film = result ? result.value().film : nullptr;
+            if (film) {
+                auto out = ResolvePath(job.request.out);
+                if (out.extension() == ".film") {
+                    film->writeDump(out.string());
+                } else {
+                    film->writeImage(out.string());
+                }
+                finish(job, JobState::Done);
+            } else {
+                finish(job, JobState::Failed, "render failed");
+            }
+        } catch (std::exception &e) {
+            finish(job, JobState::Failed, e.what());
+        }
+    }
+} // namespace miyuki::server
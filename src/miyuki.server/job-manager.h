@@ -0,0 +1,122 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_JOB_MANAGER_H
+#define MIYUKIRENDERER_JOB_MANAGER_H
+
+#include <miyuki.foundation/profiler.h>
+#include <miyuki.renderer/graph.h>
+#include "scene-cache.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+namespace miyuki::server {
+    enum class JobState {
+        Queued,
+        Running,
+        Done,
+        Failed,
+        Cancelled
+    };
+
+    struct JobRequest {
+        json scene;
+        // relative paths in the scene and out are resolved against it
+        std::string workdir;
+        // job-<id>.png when empty
+        std::string out;
+    };
+
+    // Renders submitted scenes one after another on a background thread. Jobs are polled and
+    // cancelled by the id submit() returns, finished ones are kept around for a while for their status.
+    class JobManager {
+        struct Job {
+            uint64_t id = 0;
+            JobRequest request;
+            JobState state = JobState::Queued;
+            std::string error;
+            std::shared_ptr<core::RenderProgress> progress;
+            // set while the render task runs
+            Task<core::RenderOutput> *task = nullptr;
+            // progress as of the moment the job stopped running
+            double fraction = 0;
+            double samplesPerPixel = 0;
+            double startTime = 0;
+            double endTime = 0;
+            size_t rays = 0;
+        };
+
+        std::shared_ptr<serialize::Context> context;
+        SceneCache &sceneCache;
+        // held while a job renders, other renders of the process share the thread pool
+        std::mutex &renderMutex;
+        const size_t maxQueued;
+        const size_t maxFinished;
+        // finished jobs whose last frame is kept in memory
+        const size_t framesKept = 8;
+        mutable std::mutex mutex;
+        std::condition_variable cv;
+        std::unordered_map<uint64_t, std::shared_ptr<Job>> jobs;
+        std::deque<std::shared_ptr<Job>> queue;
+        std::deque<uint64_t> finished;
+        uint64_t nextId = 1;
+        bool shutdown = false;
+        Profiler profiler;
+        std::thread runner;
+
+        void run();
+
+        void execute(Job &job);
+
+        void finish(Job &job, JobState state, const std::string &error = {});
+
+        static void stopProgress(Job &job);
+
+        json describe(const Job &job) const;
+
+    public:
+        JobManager(std::shared_ptr<serialize::Context> context, SceneCache &sceneCache, std::mutex &renderMutex,
+                   size_t maxQueued = 16, size_t maxFinished = 256);
+
+        ~JobManager();
+
+        // std::nullopt when the queue is full
+        std::optional<uint64_t> submit(JobRequest request);
+
+        std::optional<json> status(uint64_t id) const;
+
+        json list() const;
+
+        // false when there is no such job or it has already finished
+        bool cancel(uint64_t id);
+
+        // std::nullopt when there is no such job, null when it has no frame (yet). With timeout > 0,
+        // waits up to timeout seconds for a frame newer than version `after`.
+        std::optional<std::shared_ptr<const core::FilmSnapshot>> frame(uint64_t id, uint64_t after, double timeout);
+    };
+} // namespace miyuki::server
+
+#endif //MIYUKIRENDERER_JOB_MANAGER_H
@@ -10,10 +10,20 @@
 
 #include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <httplib.h>
 #include <miyuki.renderer/graph.h>
 #include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/film.h>
+#include <cxxopts.hpp>
+#include <fstream>
+#include <sstream>
+#include <iostream>
 #include "../core/export.h"
+#include "coordinator.h"
+#include "film-codec.h"
+#include "asset-store.h"
+#include "job-manager.h"
 
 #define SERVER_CERT_FILE "./cert.pem"
 #define SERVER_PRIVATE_KEY_FILE "./key.pem"
@@ -72,78 +82,366 @@ namespace miyuki::server {
         return s;
     }
 
+    // false if path is absolute or its .. components lead out of the directory it is relative to
+    static bool IsContainedPath(const std::string &path) {
+        auto p = fs::path(path).lexically_normal();
+        return !p.has_root_path() && (p.empty() || *p.begin() != "..");
+    }
+
     class RenderServer {
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
         SSLServer svr(SERVER_CERT_FILE, SERVER_PRIVATE_KEY_FILE);
 #else
         Server svr;
 #endif
+        std::string host;
         int port;
-        std::optional<core::SceneGraph> graph;
         std::shared_ptr<serialize::Context> context;
+        // one render at a time, they share the thread pool
+        std::mutex renderMutex;
+        SceneCache sceneCache;
+        AssetStore assets;
+        // job workdirs are relative to it, a job can't read or write outside
+        fs::path jobRoot;
+        std::unique_ptr<JobManager> jobs;
+
+        static void SetJson(Response &res, int status, const json &body) {
+            res.status = status;
+            res.set_content(body.dump(), "application/json");
+        }
+
+        // job ids in URLs are \d+, but may not fit in 64 bits
+        static std::optional<uint64_t> ParseJobId(const std::string &s) {
+            try {
+                return std::stoull(s);
+            } catch (std::out_of_range &) {
+                return std::nullopt;
+            }
+        }
+
+        // Portable Float Map, little endian, rows bottom to top
+        static std::string EncodePFM(const core::FilmSnapshot &frame) {
+            auto pixels = frame.resolve();
+            auto header = fmt::format("PF\n{} {}\n-1.0\n", frame.width, frame.height);
+            std::string pfm(header.size() + pixels.size() * 3 * sizeof(float), 0);
+            std::memcpy(&pfm[0], header.data(), header.size());
+            auto out = reinterpret_cast<float *>(&pfm[header.size()]);
+            for (size_t y = 0; y < frame.height; y++) {
+                for (size_t x = 0; x < frame.width; x++) {
+                    auto &p = pixels[(frame.height - 1 - y) * frame.width + x];
+                    *out++ = p[0];
+                    *out++ = p[1];
+                    *out++ = p[2];
+                }
+            }
+            return pfm;
+        }
+
+        // renders samples [first, first + count) of every pixel of the scene
+        std::shared_ptr<core::Film> renderSamples(json scene, const std::string &workdir, int first, int count) {
+            WorkingDirectoryGuard guard(workdir);
+            scene["sampler"]["props"]["sampleOffset"] = first;
+            scene["integrator"]["props"]["spp"] = count;
+            auto tileGraph = serialize::fromJson<core::SceneGraph>(*context, scene);
+            // only the final film is returned, the channel has no receiver
+            auto tx = mpsc::channel<std::shared_ptr<core::Film>>().tx;
+            auto task = tileGraph.createRenderTask(context, sceneCache.get(tileGraph, scene), tx);
+            task.launch();
+            if (auto r = task.wait()) {
+                return r.value().film;
+            }
+            return nullptr;
+        }
+
     public:
-        explicit RenderServer(int port) : port(port) {
+        RenderServer(std::string host, int port, size_t maxQueued, size_t sceneCacheBytes, const fs::path &assetStore,
+                     const std::string &snapshotDir, const std::string &jobRootDir)
+                : host(std::move(host)), port(port), sceneCache(sceneCacheBytes, snapshotDir), assets(assetStore),
+                  jobRoot(fs::absolute(jobRootDir.empty() ? assets.workdir() : fs::path(jobRootDir))) {
             if (!svr.is_valid()) {
                 fprintf(stderr, "server has an error...\n");
                 exit(1);
             }
             context = core::Initialize();
-            svr.Post("/render/start", [=](const Request &req, Response &res, const ContentReader &content_reader) {
-                auto it = req.headers.find("Content-Type");
-                if (it != req.headers.end()) {
-                    auto type = it->second;
-                    if (type == "application/json") {
-                        std::string body;
-                        content_reader([&](const char *data, size_t data_length) {
-                            body.append(data, data_length);
-                            return true;
-                        });
-                        auto data = json::parse(body);
-                        auto path = data.at("workdir").get<std::string>();
-                        res.set_content(body, "text/plain");
-                        fs::current_path(fs::absolute(fs::path(path)));
-                        auto &scene = data.at("scene");
-                        graph = serialize::fromJson<core::SceneGraph>(*context, scene);
-                        graph->render(context, "out.png");
-
+            jobs = std::make_unique<JobManager>(context, sceneCache, renderMutex, maxQueued);
+            // ["<name>", ...] in, {"missing": [names not in the store]} out
+            svr.Post("/assets/missing", [=](const Request &req, Response &res) {
+                json missing = json::array();
+                try {
+                    for (auto &name : json::parse(req.body)) {
+                        if (!assets.contains(name.get<std::string>())) {
+                            missing.push_back(name);
+                        }
                     }
+                } catch (std::exception &e) {
+                    SetJson(res, 400, {{"error", e.what()}});
+                    return;
                 }
+                SetJson(res, 200, {{"missing", missing}});
             });
-            svr.Get("/render/status", [=](const Request &req, Response &res) {
-                auto body = R"({ "status":"stopped" })";
-                res.set_content(body, "application/json");
+            // the body is the content, its SHA-256 has to match the name
+            svr.Put(R"(/assets/([0-9a-f]{64}(?:\.[A-Za-z0-9]+)?))",
+                    [=](const Request &req, Response &res, const ContentReader &content_reader) {
+                        try {
+                            assets.store(req.matches[1], [&](const AssetStore::Receiver &receiver) {
+                                return content_reader(receiver);
+                            });
+                            SetJson(res, 201, {{"name", req.matches[1]}});
+                        } catch (std::exception &e) {
+                            SetJson(res, 400, {{"error", e.what()}});
+                        }
+                    });
+            // {"workdir" (optional, relative to the job root), "scene", "out" (optional, relative to workdir)} in,
+            // {"id"} out, the job runs in the background. "asset:<name>" strings in the scene refer to uploaded
+            // assets.
+            svr.Post("/jobs", [=](const Request &req, Response &res) {
+                JobRequest request;
+                try {
+                    auto data = json::parse(req.body);
+                    request.scene = data.at("scene");
+                    auto workdir = data.contains("workdir") ? data.at("workdir").get<std::string>() : "";
+                    if (data.contains("out")) {
+                        request.out = data.at("out").get<std::string>();
+                    }
+                    if (!IsContainedPath(workdir) || !IsContainedPath(request.out)) {
+                        SetJson(res, 400, {{"error", "workdir and out must be relative paths that don't lead "
+                                                     "out of their directory"}});
+                        return;
+                    }
+                    request.workdir = (jobRoot / workdir).lexically_normal().string();
+                } catch (std::exception &e) {
+                    SetJson(res, 400, {{"error", e.what()}});
+                    return;
+                }
+                auto missing = assets.resolve(request.scene);
+                if (!missing.empty()) {
+                    SetJson(res, 409, {{"error", "missing assets"}, {"missing", missing}});
+                    return;
+                }
+                if (auto id = jobs->submit(std::move(request))) {
+                    SetJson(res, 202, {{"id", id.value()}});
+                } else {
+                    SetJson(res, 503, {{"error", "job queue is full"}});
+                }
             });
-
-            svr.Get("/render/output", [=](const Request &req, Response &res) {
-                auto body = R"({ "status":"stopped" })";
-                res.set_content(body, "application/json");
+            svr.Get("/cache", [=](const Request & /*req*/, Response &res) {
+                SetJson(res, 200, sceneCache.stats());
+            });
+            svr.Get("/jobs", [=](const Request & /*req*/, Response &res) {
+                SetJson(res, 200, jobs->list());
+            });
+            svr.Get(R"(/jobs/(\d+))", [=](const Request &req, Response &res) {
+                auto id = ParseJobId(req.matches[1]);
+                if (auto status = id ? jobs->status(id.value()) : std::nullopt) {
+                    SetJson(res, 200, status.value());
+                } else {
+                    SetJson(res, 404, {{"error", "no such job"}});
+                }
+            });
+            // the image so far; ?format=png|jpeg|pfm, ?after=<X-Frame-Version seen last>&timeout=<secs> to long-poll
+            svr.Get(R"(/jobs/(\d+)/frame)", [=](const Request &req, Response &res) {
+                auto format = req.has_param("format") ? req.get_param_value("format") : "png";
+                if (format != "png" && format != "jpeg" && format != "pfm") {
+                    SetJson(res, 400, {{"error", "format must be png, jpeg or pfm"}});
+                    return;
+                }
+                uint64_t after = 0;
+                double timeout = 0;
+                try {
+                    after = req.has_param("after") ? std::stoull(req.get_param_value("after")) : 0;
+                    timeout = req.has_param("timeout") ? std::stod(req.get_param_value("timeout")) : 0;
+                } catch (std::exception &e) {
+                    SetJson(res, 400, {{"error", e.what()}});
+                    return;
+                }
+                auto id = ParseJobId(req.matches[1]);
+                auto frame = id ? jobs->frame(id.value(), after, std::clamp(timeout, 0.0, 60.0)) : std::nullopt;
+                if (!frame) {
+                    SetJson(res, 404, {{"error", "no such job"}});
+                    return;
+                }
+                auto snapshot = frame.value();
+                if (!snapshot) {
+                    res.status = 204;
+                    res.set_header("X-Frame-Version", "0");
+                    return;
+                }
+                res.set_header("X-Frame-Version", std::to_string(snapshot->version));
+                if (format == "pfm") {
+                    res.set_content(EncodePFM(*snapshot), "image/x-portable-floatmap");
+                } else {
+                    auto image = format == "png" ? snapshot->encodePNG() : snapshot->encodeJPEG();
+                    res.set_content(std::string(image.begin(), image.end()), format == "png" ? "image/png" : "image/jpeg");
+                }
+            });
+            svr.Delete(R"(/jobs/(\d+))", [=](const Request &req, Response &res) {
+                auto id = ParseJobId(req.matches[1]);
+                if (!id) {
+                    SetJson(res, 404, {{"error", "no such job"}});
+                } else if (jobs->cancel(id.value())) {
+                    SetJson(res, 200, jobs->status(id.value()).value());
+                } else if (auto status = jobs->status(id.value())) {
+                    SetJson(res, 409, status.value());
+                } else {
+                    SetJson(res, 404, {{"error", "no such job"}});
+                }
+            });
+            // worker side of Coordinator: {"workdir" (optional, relative to the job root), "scene",
+            // "samples": [first, count]} in, encoded film out. The scene may refer to uploaded assets.
+            svr.Post("/render/tile", [=](const Request &req, Response &res) {
+                try {
+                    auto data = json::parse(req.body);
+                    auto samples = data.at("samples");
+                    auto workdir = data.contains("workdir") ? data.at("workdir").get<std::string>() : "";
+                    if (!IsContainedPath(workdir)) {
+                        SetJson(res, 400, {{"error", "workdir must be a relative path that doesn't lead out of "
+                                                     "the job root"}});
+                        return;
+                    }
+                    json scene = data.at("scene");
+                    auto missing = assets.resolve(scene);
+                    if (!missing.empty()) {
+                        SetJson(res, 409, {{"error", "missing assets"}, {"missing", missing}});
+                        return;
+                    }
+                    std::lock_guard<std::mutex> lock(renderMutex);
+                    auto film = renderSamples(scene, (jobRoot / workdir).lexically_normal().string(),
+                                              samples.at(0).get<int>(), samples.at(1).get<int>());
+                    if (!film) {
+                        MIYUKI_THROW(std::runtime_error, "render failed");
+                    }
+                    res.set_content(EncodeFilm(*film), "application/octet-stream");
+                } catch (std::exception &e) {
+                    res.status = 500;
+                    res.set_content(e.what(), "text/plain");
+                }
             });
 
             svr.Get("/stop",
                     [&](const Request & /*req*/, Response & /*res*/) { svr.stop(); });
 
             svr.set_error_handler([](const Request & /*req*/, Response &res) {
+                if (!res.body.empty()) {
+                    return;
+                }
                 const char *fmt = "<p>Error Status: <span style='color:red;'>%d</span></p>";
                 char buf[BUFSIZ];
                 snprintf(buf, sizeof(buf), fmt, res.status);
                 res.set_content(buf, "text/html");
             });
 
-            svr.set_logger([](const Request &req, const Response &res) {
+            svr.set_logger([](const Request & /*req*/, const Response & /*res*/) {
                 // printf("%s", log(req, res).c_str());
             });
 
         }
 
         void run() {
-            svr.listen("localhost", port);
+            log::log("Listening on {}:{}\n", host, port);
+            svr.listen(host.c_str(), port);
         }
     };
+
+    static std::vector<WorkerAddress> ParseWorkers(const std::string &list) {
+        std::vector<WorkerAddress> workers;
+        std::istringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ',')) {
+            WorkerAddress worker;
+            auto colon = item.rfind(':');
+            worker.host = item.substr(0, colon);
+            if (colon != std::string::npos) {
+                worker.port = std::stoi(item.substr(colon + 1));
+            }
+            workers.push_back(worker);
+        }
+        return workers;
+    }
+
+    static int Coordinate(const cxxopts::ParseResult &result) {
+        CoordinatorConfig config;
+        config.workers = ParseWorkers(result["workers"].as<std::string>());
+        if (result.count("samples-per-unit")) {
+            config.samplesPerUnit = result["samples-per-unit"].as<int>();
+            if (config.samplesPerUnit < 1) {
+                MIYUKI_THROW(std::runtime_error, "--samples-per-unit must be at least 1");
+            }
+        }
+        if (result.count("timeout")) {
+            config.timeout = result["timeout"].as<int>();
+        }
+        auto scenePath = fs::absolute(fs::path(result["coordinate"].as<std::string>()));
+        std::ifstream in(scenePath);
+        std::string str((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        json scene = json::parse(str);
+        int spp = result.count("spp") ? result["spp"].as<int>() : scene.at("integrator").at("props").at("spp").get<int>();
+        std::string outFile = result.count("out") ? result["out"].as<std::string>() : "out.png";
+        std::string previewFile = result.count("preview") ? result["preview"].as<std::string>() : "";
+        // the workers resolve it against their --job-root
+        auto workdir = result.count("workdir") ? result["workdir"].as<std::string>()
+                                               : fs::path(result["coordinate"].as<std::string>()).parent_path().string();
+        if (!IsContainedPath(workdir)) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("The scene directory {} is not relative to the workers' job "
+                                                         "root, pass it as --workdir", workdir));
+        }
+        log::log("Rendering {} spp on {} workers, {} spp per unit\n", spp, config.workers.size(), config.samplesPerUnit);
+        auto film = Coordinator(config).render(scene, fs::path(workdir).lexically_normal().string(), spp, previewFile);
+        if (fs::path(outFile).extension() == ".film") {
+            film->writeDump(outFile);
+        } else {
+            film->writeImage(outFile);
+        }
+        return 0;
+    }
 }
 
 int main(int argc, char **argv) {
-
-    miyuki::server::RenderServer server(8080);
-    server.run();
-    return 0;
+    using namespace miyuki;
+    try {
+        cxxopts::Options options("miyuki.server", "miyuki-renderer :: Render server");
+        options.add_options()
+                ("host", "Address to listen on", cxxopts::value<std::string>())
+                ("p,port", "Port to listen on", cxxopts::value<int>())
+                ("coordinate", "Render this scene file on the --workers instead of serving",
+                 cxxopts::value<std::string>())
+                ("workers", "Comma separated host:port list of render servers", cxxopts::value<std::string>())
+                ("workdir", "Scene directory relative to the workers' --job-root, defaults to the directory of "
+                            "the --coordinate file", cxxopts::value<std::string>())
+                ("spp", "Samples per pixel, defaults to the integrator's", cxxopts::value<int>())
+                ("samples-per-unit", "Samples per pixel a worker renders per request", cxxopts::value<int>())
+                ("timeout", "Seconds before a unit is taken away from an unresponsive worker",
+                 cxxopts::value<int>())
+                ("o,out", "Output image file name, or a .film dump", cxxopts::value<std::string>())
+                ("preview", "Image file the partially assembled frame is written to while coordinating",
+                 cxxopts::value<std::string>())
+                ("queue-size", "Jobs that may wait for their turn before new ones are turned away",
+                 cxxopts::value<int>())
+                ("scene-cache", "Megabytes of built scenes kept between renders", cxxopts::value<int>())
+                ("asset-store", "Directory of uploaded assets", cxxopts::value<std::string>())
+                ("snapshot-dir", "Directory of scene snapshots, restored instead of building a scene again",
+                 cxxopts::value<std::string>())
+                ("job-root", "Directory job workdirs are relative to, defaults to the asset store's work directory",
+                 cxxopts::value<std::string>())
+                ("h,help", "Print help and exit.");
+        auto result = options.parse(argc, argv);
+        if (result.count("help")) {
+            std::cout << options.help({""}) << std::endl;
+            return 0;
+        }
+        if (result.count("coordinate")) {
+            return server::Coordinate(result);
+        }
+        server::RenderServer server(result.count("host") ? result["host"].as<std::string>() : "localhost",
+                                    result.count("port") ? result["port"].as<int>() : 8080,
+                                    result.count("queue-size") ? result["queue-size"].as<int>() : 16,
+                                    size_t(result.count("scene-cache") ? result["scene-cache"].as<int>() : 2048) << 20u,
+                                    result.count("asset-store") ? result["asset-store"].as<std::string>() : "assets",
+                                    result.count("snapshot-dir") ? result["snapshot-dir"].as<std::string>() : "",
+                                    result.count("job-root") ? result["job-root"].as<std::string>() : "");
+        server.run();
+        return 0;
+    } catch (std::exception &e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return -1;
+    }
 }
@@ -0,0 +1,137 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "scene-cache.h"
+#include "sha256.h"
+#include <miyuki.renderer/snapshot.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/profiler.h>
+#include <stb_image.h>
+
+namespace miyuki::server {
+    // calls f with every string in j that names an existing file
+    template<class F>
+    static void ForEachFile(const json &j, F &&f) {
+        if (j.is_string()) {
+            std::error_code ec;
+            auto path = ResolvePath(j.get<std::string>());
+            if (fs::is_regular_file(path, ec)) {
+                f(path);
+            }
+        } else if (j.is_structured()) {
+            for (auto &i : j) {
+                ForEachFile(i, f);
+            }
+        }
+    }
+
+    static size_t MeshBytes(const core::Mesh &mesh) {
+        auto &v = mesh._vertex_data;
+        return v.position.size() * sizeof(v.position[0]) + v.normal.size() * sizeof(v.normal[0]) +
+               v.tex_coord.size() * sizeof(v.tex_coord[0]) + mesh.triangles.size() * sizeof(core::MeshTriangle) +
+               mesh.indices.size() * sizeof(mesh.indices[0]) + mesh.materialIds.size() * sizeof(uint16_t);
+    }
+
+    std::shared_ptr<core::Scene> SceneCache::get(core::SceneGraph &graph, const json &scene) {
+        json geometry = {{"shapes",      scene.value("shapes", json())},
+                         {"accelerator", scene.value("accelerator", json())}};
+        auto key = core::SceneKey(scene);
+        size_t textureBytes = 0;
+        ForEachFile(geometry, [&](const fs::path &path) {
+            int w, h, comp;
+            if (stbi_info(path.string().c_str(), &w, &h, &comp)) {
+                // decoded into an RGBAImage
+                textureBytes += size_t(w) * h * sizeof(float4);
+            }
+        });
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(key);
+            if (it != index.end()) {
+                entries.splice(entries.begin(), entries, it->second);
+                hits++;
+                secondsSaved += it->second->buildSeconds;
+                log::log("Scene cache hit, {:.3f}secs of setup saved\n", it->second->buildSeconds);
+                return it->second->scene;
+            }
+            misses++;
+        }
+        Profiler profiler;
+        std::shared_ptr<core::Scene> built;
+        if (!snapshotDir.empty()) {
+            auto snapshot = (fs::absolute(snapshotDir) / (Sha256::hash(key) + ".myks")).string();
+            built = core::LoadSceneSnapshot(snapshot, scene, graph);
+            if (built) {
+                std::lock_guard<std::mutex> lock(mutex);
+                snapshotsLoaded++;
+            } else {
+                built = graph.buildScene();
+                try {
+                    fs::create_directories(snapshotDir);
+                    core::WriteSceneSnapshot(snapshot, scene, *built);
+                } catch (std::exception &e) {
+                    log::log("Cannot write scene snapshot: {}\n", e.what());
+                }
+            }
+        } else {
+            built = graph.buildScene();
+        }
+        Entry entry;
+        entry.key = key;
+        entry.scene = built;
+        entry.buildSeconds = profiler.elapsed<double>().count();
+        // the accelerator is assumed to take about as much as the meshes
+        for (auto &mesh : built->meshes) {
+            entry.bytes += 2 * MeshBytes(*mesh);
+        }
+        entry.bytes += textureBytes;
+        log::log("Scene cache miss, built in {:.3f}secs, {:.1f}MB\n", entry.buildSeconds, entry.bytes / 1e6);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entry.bytes > budget || index.count(key)) {
+            return built;
+        }
+        while (bytes + entry.bytes > budget) {
+            auto &last = entries.back();
+            bytes -= last.bytes;
+            index.erase(last.key);
+            entries.pop_back();
+            evictions++;
+        }
+        bytes += entry.bytes;
+        entries.push_front(std::move(entry));
+        index[key] = entries.begin();
+        return built;
+    }
+
+    json SceneCache::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {{"hits",              hits},
+                {"misses",            misses},
+                {"evictions",         evictions},
+                {"snapshotsLoaded",   snapshotsLoaded},
+                {"scenes",            entries.size()},
+                {"bytes",             bytes},
+                {"budget",            budget},
+                {"setupSecondsSaved", secondsSaved}};
+    }
+} // namespace miyuki::server
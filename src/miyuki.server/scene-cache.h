@@ -0,0 +1,68 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_SCENE_CACHE_H
+#define MIYUKIRENDERER_SCENE_CACHE_H
+
+#include <miyuki.renderer/graph.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace miyuki::server {
+    // Keeps built scenes (meshes, accelerator, textures) around between renders. A scene is reused
+    // when the shapes and accelerator of the scene file, the working directory and the size and
+    // modification time of every file they name are the same, so a request that only changes the
+    // camera, integrator, sampler or film goes straight to rendering. Scenes that are not in memory
+    // are restored from snapshots in snapshotDir if there are any, and snapshotted after being built.
+    class SceneCache {
+        struct Entry {
+            std::string key;
+            std::shared_ptr<core::Scene> scene;
+            size_t bytes = 0;
+            double buildSeconds = 0;
+        };
+
+        const size_t budget;
+        const std::string snapshotDir;
+        mutable std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        size_t hits = 0, misses = 0, evictions = 0, snapshotsLoaded = 0;
+        double secondsSaved = 0;
+
+    public:
+        // budget in bytes, a scene larger than that is built every time; an empty snapshotDir disables snapshots
+        explicit SceneCache(size_t budget, std::string snapshotDir = "")
+                : budget(budget), snapshotDir(std::move(snapshotDir)) {}
+
+        // the scene of graph, which was deserialized from scene; relative file names are resolved
+        // against the thread's working directory
+        std::shared_ptr<core::Scene> get(core::SceneGraph &graph, const json &scene);
+
+        json stats() const;
+    };
+} // namespace miyuki::server
+
+#endif //MIYUKIRENDERER_SCENE_CACHE_H
@@ -0,0 +1,119 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "sha256.h"
+#include <cstring>
+
+namespace miyuki::server {
+    static const uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    static inline uint32_t Rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    Sha256::Sha256() : state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+                             0x5be0cd19} {}
+
+    void Sha256::compress(const uint8_t *data) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = uint32_t(data[4 * i]) << 24u | uint32_t(data[4 * i + 1]) << 16u |
+                   uint32_t(data[4 * i + 2]) << 8u | uint32_t(data[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            auto s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3u);
+            auto s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10u);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        auto s = state;
+        for (int i = 0; i < 64; i++) {
+            auto S1 = Rotr(s[4], 6) ^ Rotr(s[4], 11) ^ Rotr(s[4], 25);
+            auto ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+            auto t1 = s[7] + S1 + ch + K[i] + w[i];
+            auto S0 = Rotr(s[0], 2) ^ Rotr(s[0], 13) ^ Rotr(s[0], 22);
+            auto maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+            auto t2 = S0 + maj;
+            s[7] = s[6];
+            s[6] = s[5];
+            s[5] = s[4];
+            s[4] = s[3] + t1;
+            s[3] = s[2];
+            s[2] = s[1];
+            s[1] = s[0];
+            s[0] = t1 + t2;
+        }
+        for (int i = 0; i < 8; i++) {
+            state[i] += s[i];
+        }
+    }
+
+    void Sha256::update(const void *data, size_t size) {
+        auto bytes = static_cast<const uint8_t *>(data);
+        length += size;
+        if (blockSize > 0) {
+            auto n = std::min(size, 64 - blockSize);
+            std::memcpy(block + blockSize, bytes, n);
+            blockSize += n;
+            bytes += n;
+            size -= n;
+            if (blockSize < 64) {
+                return;
+            }
+            compress(block);
+            blockSize = 0;
+        }
+        for (; size >= 64; bytes += 64, size -= 64) {
+            compress(bytes);
+        }
+        std::memcpy(block, bytes, size);
+        blockSize = size;
+    }
+
+    std::string Sha256::finish() {
+        auto bits = length * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (blockSize != 56) {
+            update(&pad, 1);
+        }
+        uint8_t size[8];
+        for (int i = 0; i < 8; i++) {
+            size[i] = uint8_t(bits >> (56u - 8u * i));
+        }
+        update(size, 8);
+        static const char *digits = "0123456789abcdef";
+        std::string hex;
+        for (auto word : state) {
+            for (int i = 28; i >= 0; i -= 4) {
+                hex += digits[(word >> uint32_t(i)) & 0xfu];
+            }
+        }
+        return hex;
+    }
+} // namespace miyuki::server
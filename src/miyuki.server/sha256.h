@@ -0,0 +1,56 @@
+// MIT License
+// 
+// Copyright (c) 2019 椎名深雪
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MIYUKIRENDERER_SHA256_H
+#define MIYUKIRENDERER_SHA256_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace miyuki::server {
+    // Incremental SHA-256 (FIPS 180-4)
+    class Sha256 {
+        std::array<uint32_t, 8> state;
+        uint8_t block[64] = {};
+        size_t blockSize = 0;
+        uint64_t length = 0;
+
+        void compress(const uint8_t *data);
+
+    public:
+        Sha256();
+
+        void update(const void *data, size_t size);
+
+        // lower case hex digest, the object must not be updated afterwards
+        std::string finish();
+
+        static std::string hash(const std::string &data) {
+            Sha256 sha;
+            sha.update(data.data(), data.size());
+            return sha.finish();
+        }
+    };
+} // namespace miyuki::server
+
+#endif //MIYUKIRENDERER_SHA256_H
@@ -20,3 +20,362 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <miyuki.renderer/graph.h>
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/filmsnapshot.h>
+#include <miyuki.foundation/log.hpp>
+#include "../core/export.h"
+#include <fstream>
+#include <thread>
+
+namespace py = pybind11;
+
+namespace miyuki::python {
+    using core::Film;
+    using core::FilmSnapshot;
+
+    static const std::shared_ptr<SerializeContext> &GetContext() {
+        static auto context = core::Initialize();
+        return context;
+    }
+
+    // the thread pool runs one render at a time
+    static std::mutex &RenderMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // accepts a JSON string or anything json.dumps takes
+    static json ToJson(const py::handle &object) {
+        if (py::isinstance<py::str>(object)) {
+            return json::parse(object.cast<std::string>());
+        }
+        return json::parse(py::module::import("json").attr("dumps")(object).cast<std::string>());
+    }
+
+    // a (height, width[, channels]) view of a film plane, base keeps the memory alive
+    static py::array PlaneView(const py::object &base, const Film &film, const RGBImage &image, bool rgb) {
+        std::vector<ssize_t> shape = {ssize_t(film.height), ssize_t(film.width)};
+        std::vector<ssize_t> strides = {ssize_t(film.width * sizeof(Vec3f)), ssize_t(sizeof(Vec3f))};
+        if (rgb) {
+            shape.push_back(3);
+            strides.push_back(sizeof(float));
+        }
+        auto data = const_cast<float *>(reinterpret_cast<const float *>(image.data()));
+        return py::array_t<float>(shape, strides, data, base);
+    }
+
+    static py::array ToArray(std::vector<Vec3f> pixels, size_t width, size_t height) {
+        auto owned = new std::vector<Vec3f>(std::move(pixels));
+        py::capsule owner(owned, [](void *p) { delete static_cast<std::vector<Vec3f> *>(p); });
+        return py::array_t<float>({ssize_t(height), ssize_t(width), ssize_t(3)},
+                                  {ssize_t(width * sizeof(Vec3f)), ssize_t(sizeof(Vec3f)), ssize_t(sizeof(float))},
+                                  reinterpret_cast<float *>(owned->data()), owner);
+    }
+
+    static std::vector<Vec3f> Resolve(const Film &film) {
+        std::vector<Vec3f> pixels(film.width * film.height);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            auto w = film.weight.data()[i][0];
+            pixels[i] = w == 0 ? Vec3f(0) : film.color.data()[i] / w;
+        }
+        return pixels;
+    }
+
+    // integrator and camera of one render, converted while the GIL is held
+    struct RenderRequest {
+        json integrator;
+        json camera;
+    };
+
+    class Scene {
+        json scene;
+        fs::path workdir;
+        std::shared_ptr<core::SceneGraph> graph;
+        // built once, shared by every render of this scene
+        std::shared_ptr<core::Scene> built;
+        // meshes were changed since built was last brought up to date
+        bool changed = false;
+
+        // call with RenderMutex held
+        void buildOrUpdate() {
+            WorkingDirectoryGuard guard(workdir);
+            if (!built) {
+                built = graph->buildScene();
+            } else if (changed) {
+                built->update();
+            }
+            changed = false;
+        }
+
+    public:
+        Scene(const py::object &scene, const std::string &workdir)
+                : scene(ToJson(scene)), workdir(workdir.empty() ? fs::current_path() : fs::absolute(workdir)) {
+            graph = serialize::fromJson<std::shared_ptr<core::SceneGraph>>(
+                    *GetContext(), json{{"type", "SceneGraph"}, {"props", this->scene}});
+        }
+
+        static std::shared_ptr<Scene> load(const std::string &filename) {
+            std::ifstream in(filename);
+            if (!in) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Cannot open {}", filename));
+            }
+            std::string str((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            return std::make_shared<Scene>(py::str(str), fs::absolute(filename).parent_path().string());
+        }
+
+        RenderRequest request(std::optional<int> spp, std::optional<float> timeBudget, const py::object &camera) {
+            RenderRequest request{scene.at("integrator"), camera.is_none() ? scene.at("camera") : ToJson(camera)};
+            if (spp) {
+                request.integrator["props"]["spp"] = spp.value();
+            }
+            if (timeBudget) {
+                request.integrator["props"]["timeBudget"] = timeBudget.value();
+            }
+            return request;
+        }
+
+        // meshes, textures and the accelerator; done by the first render otherwise
+        void preprocess() {
+            std::lock_guard<std::mutex> lock(RenderMutex());
+            buildOrUpdate();
+        }
+
+        // refits the accelerator to the meshes changed by setPositions(); done by the next render otherwise
+        void update() { preprocess(); }
+
+        // moves the vertices of mesh `index`, the topology and vertex count stay the same
+        void setPositions(size_t index, const std::vector<Point3f> &positions) {
+            std::lock_guard<std::mutex> lock(RenderMutex());
+            buildOrUpdate();
+            if (index >= built->meshes.size()) {
+                MIYUKI_THROW(std::out_of_range, fmt::format("No mesh {}, the scene has {}", index,
+                                                            built->meshes.size()));
+            }
+            auto &mesh = *built->meshes[index];
+            if (positions.size() != mesh._vertex_data.position.size()) {
+                MIYUKI_THROW(std::runtime_error, fmt::format("Mesh {} has {} vertices, got {}", index,
+                                                             mesh._vertex_data.position.size(), positions.size()));
+            }
+            std::copy(positions.begin(), positions.end(), mesh._vertex_data.position.begin());
+            mesh.markDirty();
+            changed = true;
+        }
+
+        // call with RenderMutex held
+        Task<core::RenderOutput> createTask(const RenderRequest &request,
+                                            const std::shared_ptr<core::RenderProgress> &progress) {
+            buildOrUpdate();
+            WorkingDirectoryGuard guard(workdir);
+            graph->integrator = serialize::fromJson<std::shared_ptr<core::Integrator>>(*GetContext(),
+                                                                                        request.integrator);
+            graph->camera = serialize::fromJson<std::shared_ptr<core::Camera>>(*GetContext(), request.camera);
+            graph->progress = progress;
+            auto[tx, rx] = mpsc::channel<std::shared_ptr<Film>>();
+            auto task = graph->createRenderTask(GetContext(), built, tx);
+            task.launch();
+            return task;
+        }
+
+        std::shared_ptr<Film> render(const RenderRequest &request) {
+            std::lock_guard<std::mutex> lock(RenderMutex());
+            auto task = createTask(request, nullptr);
+            if (auto r = task.wait()) {
+                return r.value().film;
+            }
+            MIYUKI_THROW(std::runtime_error, "render failed");
+        }
+    };
+
+    // Renders in the background, iterating yields a FilmSnapshot whenever new tiles are done, at most
+    // every `interval` seconds. The final film is `film` once the iteration stops.
+    class ProgressiveRender {
+        std::shared_ptr<core::RenderProgress> progress = std::make_shared<core::RenderProgress>();
+        std::mutex mutex;
+        Task<core::RenderOutput> *task = nullptr;
+        bool cancelled = false;
+        std::atomic<bool> done = false;
+        std::string error;
+        std::thread thread;
+        const double interval;
+        uint64_t version = 0;
+
+    public:
+        std::shared_ptr<Film> film;
+
+        ProgressiveRender(std::shared_ptr<Scene> scene, RenderRequest request, double interval)
+                : interval(interval) {
+            thread = std::thread([=]() {
+                try {
+                    std::lock_guard<std::mutex> renderLock(RenderMutex());
+                    auto task = scene->createTask(request, progress);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        this->task = &task;
+                        if (cancelled) {
+                            task.kill();
+                        }
+                    }
+                    auto r = task.wait();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    this->task = nullptr;
+                    if (r) {
+                        film = r.value().film;
+                    } else if (!cancelled) {
+                        error = "render failed";
+                    }
+                } catch (std::exception &e) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    task = nullptr;
+                    error = e.what();
+                }
+                done = true;
+            });
+        }
+
+        ~ProgressiveRender() {
+            cancel();
+            thread.join();
+        }
+
+        void cancel() {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            if (task) {
+                task->kill();
+            }
+        }
+
+        std::shared_ptr<const FilmSnapshot> next() {
+            {
+                py::gil_scoped_release release;
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(interval);
+                while (true) {
+                    bool finished = done;
+                    auto snapshot = progress->frame.snapshot();
+                    if (snapshot && snapshot->version > version &&
+                        (finished || std::chrono::steady_clock::now() >= deadline)) {
+                        version = snapshot->version;
+                        return snapshot;
+                    }
+                    if (finished) {
+                        break;
+                    }
+                    progress->frame.waitNewer(version, 0.05);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error.empty()) {
+                throw std::runtime_error(error);
+            }
+            throw py::stop_iteration();
+        }
+    };
+} // namespace miyuki::python
+
+PYBIND11_MODULE(pymiyuki, m) {
+    using namespace miyuki;
+    using namespace miyuki::python;
+    m.doc() = "miyuki-renderer :: in-process rendering";
+
+    py::class_<Film, std::shared_ptr<Film>>(m, "Film")
+            .def(py::init<size_t, size_t>())
+            .def_readonly("width", &Film::width)
+            .def_readonly("height", &Film::height)
+            // views of the film's own memory: sums over samples, divide by weight for the pixel values
+            .def_property_readonly("color", [](const py::object &self) {
+                auto &film = self.cast<Film &>();
+                return PlaneView(self, film, film.color, true);
+            })
+            .def_property_readonly("normal", [](const py::object &self) {
+                auto &film = self.cast<Film &>();
+                return PlaneView(self, film, film.normal, true);
+            })
+            .def_property_readonly("albedo", [](const py::object &self) {
+                auto &film = self.cast<Film &>();
+                return PlaneView(self, film, film.albedo, true);
+            })
+            .def_property_readonly("second_moment", [](const py::object &self) {
+                auto &film = self.cast<Film &>();
+                return PlaneView(self, film, film.secondMoment, true);
+            })
+            .def_property_readonly("weight", [](const py::object &self) {
+                auto &film = self.cast<Film &>();
+                return PlaneView(self, film, film.weight, false);
+            })
+            .def("image", [](const Film &film) { return ToArray(Resolve(film), film.width, film.height); },
+                 "color / weight, a copy")
+            .def("write", [](Film &film, const std::string &filename) {
+                if (fs::path(filename).extension() == ".film") {
+                    film.writeDump(filename);
+                } else {
+                    film.writeImage(filename);
+                }
+            });
+
+    py::class_<FilmSnapshot, std::shared_ptr<FilmSnapshot>>(m, "FilmSnapshot")
+            .def_readonly("width", &FilmSnapshot::width)
+            .def_readonly("height", &FilmSnapshot::height)
+            .def_readonly("version", &FilmSnapshot::version)
+            .def("image", [](const FilmSnapshot &snapshot) {
+                return ToArray(snapshot.resolve(), snapshot.width, snapshot.height);
+            }, "color / weight, black where nothing was rendered yet");
+
+    py::class_<ProgressiveRender, std::shared_ptr<ProgressiveRender>>(m, "ProgressiveRender")
+            .def("__iter__", [](const py::object &self) { return self; })
+            .def("__next__", [](ProgressiveRender &render) {
+                return std::const_pointer_cast<FilmSnapshot>(render.next());
+            })
+            .def("cancel", &ProgressiveRender::cancel)
+            .def_readonly("film", &ProgressiveRender::film);
+
+    py::class_<Scene, std::shared_ptr<Scene>>(m, "Scene")
+            .def(py::init<const py::object &, const std::string &>(), py::arg("scene"), py::arg("workdir") = "",
+                 "scene is a dict or a JSON string, relative paths in it are resolved against workdir")
+            .def_static("load", &Scene::load, py::arg("filename"))
+            .def("preprocess", &Scene::preprocess, py::call_guard<py::gil_scoped_release>())
+            .def("update", &Scene::update, py::call_guard<py::gil_scoped_release>(),
+                 "refits the accelerator to the meshes moved by set_positions")
+            .def("set_positions", [](Scene &scene, size_t mesh,
+                                     const py::array_t<float, py::array::c_style | py::array::forcecast> &positions) {
+                if (positions.ndim() != 2 || positions.shape(1) != 3) {
+                    MIYUKI_THROW(std::runtime_error, "positions must be an (n, 3) array");
+                }
+                auto p = positions.unchecked<2>();
+                std::vector<Point3f> copy(positions.shape(0));
+                for (ssize_t i = 0; i < positions.shape(0); i++) {
+                    copy[i] = Point3f(p(i, 0), p(i, 1), p(i, 2));
+                }
+                py::gil_scoped_release release;
+                scene.setPositions(mesh, copy);
+            }, py::arg("mesh"), py::arg("positions"),
+                 "moves the vertices of a mesh in place, the next render or update() refits its BVH")
+            .def("render", [](Scene &scene, std::optional<int> spp, std::optional<float> timeBudget,
+                              const py::object &camera) {
+                auto request = scene.request(spp, timeBudget, camera);
+                py::gil_scoped_release release;
+                return scene.render(request);
+            }, py::arg("spp") = py::none(), py::arg("time_budget") = py::none(), py::arg("camera") = py::none())
+            .def("render_cameras", [](Scene &scene, const py::list &cameras, std::optional<int> spp,
+                                      std::optional<float> timeBudget) {
+                std::vector<RenderRequest> requests;
+                for (auto &camera : cameras) {
+                    requests.push_back(scene.request(spp, timeBudget, py::reinterpret_borrow<py::object>(camera)));
+                }
+                py::gil_scoped_release release;
+                std::vector<std::shared_ptr<Film>> films;
+                for (auto &request : requests) {
+                    films.push_back(scene.render(request));
+                }
+                return films;
+            }, py::arg("cameras"), py::arg("spp") = py::none(), py::arg("time_budget") = py::none(),
+                 "renders every camera against the scene built once")
+            .def("render_progressive", [](const std::shared_ptr<Scene> &scene, std::optional<int> spp,
+                                          std::optional<float> timeBudget, const py::object &camera, double interval) {
+                return std::make_shared<ProgressiveRender>(scene, scene->request(spp, timeBudget, camera), interval);
+            }, py::arg("spp") = py::none(), py::arg("time_budget") = py::none(), py::arg("camera") = py::none(),
+                 py::arg("interval") = 1.0);
+}
@@ -28,15 +28,113 @@
 #include <miyuki.foundation/defs.h>
 #include <fstream>
 #include <miyuki.renderer/graph.h>
+#include <miyuki.renderer/snapshot.h>
 #include <miyuki.foundation/log.hpp>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+namespace miyuki {
+    // "out.png" -> "out.0007.png"; a pattern with braces is formatted instead, "frame-{:03}.png" -> "frame-007.png"
+    static std::string FrameFileName(const std::string &pattern, size_t frame) {
+        if (pattern.find('{') != std::string::npos) {
+            return fmt::format(pattern, frame);
+        }
+        fs::path path(pattern);
+        auto name = fmt::format("{}.{:04}{}", path.stem().string(), frame, path.extension().string());
+        return (path.parent_path() / name).string();
+    }
+
+    // numbers are interpolated linearly, arrays and objects element by element, anything else is taken from a
+    static json Interpolate(const json &a, const json &b, double t) {
+        if (a.is_number() && b.is_number()) {
+            return a.get<double>() * (1 - t) + b.get<double>() * t;
+        }
+        if (a.is_array() && b.is_array() && a.size() == b.size()) {
+            json r = json::array();
+            for (size_t i = 0; i < a.size(); i++) {
+                r.push_back(Interpolate(a[i], b[i], t));
+            }
+            return r;
+        }
+        if (a.is_object() && b.is_object()) {
+            json r = a;
+            for (auto it = a.begin(); it != a.end(); it++) {
+                if (b.contains(it.key())) {
+                    r[it.key()] = Interpolate(it.value(), b[it.key()], t);
+                }
+            }
+            return r;
+        }
+        return a;
+    }
+
+    // One camera override per frame. The file is either an array of overrides, or
+    // {"frames": n, "keyframes": [{"frame": i, "camera": override}, ...]} interpolated in between.
+    // An override with a "type" replaces the camera, otherwise it is merged into the camera's props.
+    static std::vector<json> LoadSequence(const fs::path &file) {
+        std::ifstream in(file);
+        if (!in) {
+            MIYUKI_THROW(std::runtime_error, fmt::format("Cannot open {}", file.string()));
+        }
+        json data = json::parse(in);
+        if (data.is_array()) {
+            return data.get<std::vector<json>>();
+        }
+        auto keys = data.at("keyframes").get<std::vector<json>>();
+        if (keys.empty()) {
+            MIYUKI_THROW(std::runtime_error, "sequence has no keyframes");
+        }
+        std::sort(keys.begin(), keys.end(), [](const json &a, const json &b) {
+            return a.at("frame").get<int>() < b.at("frame").get<int>();
+        });
+        int frames = data.value("frames", keys.back().at("frame").get<int>() + 1);
+        std::vector<json> sequence;
+        for (int frame = 0; frame < frames; frame++) {
+            size_t next = 0;
+            while (next < keys.size() && keys[next].at("frame").get<int>() <= frame) {
+                next++;
+            }
+            if (next == 0 || next == keys.size()) {
+                sequence.push_back(keys[next == 0 ? 0 : next - 1].at("camera"));
+                continue;
+            }
+            auto &a = keys[next - 1], &b = keys[next];
+            int fa = a.at("frame").get<int>(), fb = b.at("frame").get<int>();
+            sequence.push_back(Interpolate(a.at("camera"), b.at("camera"), double(frame - fa) / (fb - fa)));
+        }
+        return sequence;
+    }
+
+    static json ApplyCameraOverride(json camera, const json &override) {
+        if (override.contains("type")) {
+            return override;
+        }
+        camera["props"].merge_patch(override);
+        return camera;
+    }
+}
 
 int main(int argc, char **argv) {
     using namespace miyuki;
     try {
         cxxopts::Options options("myk-cli", "miyuki-renderer :: Standalone");
         options.add_options()
-                ("f,file", "Scene file name", cxxopts::value<std::string>())
-                ("o,out", "Output image file name", cxxopts::value<std::string>())
+                ("f,file", "Scene file name, or a scene snapshot", cxxopts::value<std::string>())
+                ("o,out", "Output image file name, a .film file keeps the unnormalized film for myk.merge",
+                 cxxopts::value<std::string>())
+                ("sample-offset", "Index of the first sample, k * spp for the k-th of several processes",
+                 cxxopts::value<int>())
+                ("t,time-budget", "Wall-clock budget in seconds, overrides the integrator's timeBudget",
+                 cxxopts::value<float>())
+                ("checkpoint", "Save the render state to this file at intervals", cxxopts::value<std::string>())
+                ("checkpoint-interval", "Seconds between checkpoints", cxxopts::value<float>())
+                ("r,resume", "Continue from the checkpoint file instead of starting over")
+                ("sequence", "Render one frame per camera override in this JSON file, loading the scene once",
+                 cxxopts::value<std::string>())
+                ("reuse-training", "With --sequence, start each frame's guiding from the previous frame's SDTree")
+                ("snapshot", "Scene snapshot file, used instead of loading and building the scene when it is up to "
+                             "date and written otherwise", cxxopts::value<std::string>())
                 ("h,help", "Print help and exit.");
         auto result = options.parse(argc, argv);
         if (result.count("help")) {
@@ -49,6 +147,7 @@ int main(int argc, char **argv) {
         }
         {
             CurrentPathGuard _guard;
+            auto cwd = fs::current_path();
             fs::path scenePath = fs::absolute(fs::path(sceneFile));
             if (!fs::exists(scenePath)) {
                 MIYUKI_THROW(std::runtime_error, "file doesn't exist");
@@ -59,14 +158,94 @@ int main(int argc, char **argv) {
 
             auto ctx = core::Initialize();
 
-            std::ifstream in(sceneFile);
-            std::string str((std::istreambuf_iterator<char>(in)),
-                            std::istreambuf_iterator<char>());
-            json data = json::parse(str);
+            std::string snapshotFile;
+            json data;
+            if (fs::path(sceneFile).extension() == ".myks") {
+                data = core::ReadSnapshotDescription(sceneFile);
+                snapshotFile = sceneFile;
+            } else {
+                std::ifstream in(sceneFile);
+                std::string str((std::istreambuf_iterator<char>(in)),
+                                std::istreambuf_iterator<char>());
+                data = json::parse(str);
+            }
+            if (result.count("snapshot") != 0) {
+                snapshotFile = (cwd / result["snapshot"].as<std::string>()).string();
+            }
+            if (result.count("time-budget") != 0) {
+                data["integrator"]["props"]["timeBudget"] = result["time-budget"].as<float>();
+            }
+            if (result.count("sample-offset") != 0) {
+                data["sampler"]["props"]["sampleOffset"] = result["sample-offset"].as<int>();
+            }
+            if (result.count("reuse-training") != 0) {
+                if (data["integrator"]["type"] != "GuidedPathTracer") {
+                    MIYUKI_THROW(std::runtime_error, "--reuse-training needs the GuidedPathTracer");
+                }
+                data["integrator"]["props"]["reuseTraining"] = true;
+            }
 
             auto graph = serialize::fromJson<core::SceneGraph>(*ctx,data);
+            if (result.count("checkpoint") != 0) {
+                graph.checkpointFile = (cwd / result["checkpoint"].as<std::string>()).string();
+            }
+            if (result.count("checkpoint-interval") != 0) {
+                graph.checkpointInterval = result["checkpoint-interval"].as<float>();
+            }
+            if (result.count("resume") != 0) {
+                if (graph.checkpointFile.empty()) {
+                    MIYUKI_THROW(std::runtime_error, "--resume needs a checkpoint file");
+                }
+                graph.resume = true;
+            }
+
+            auto buildScene = [&]() {
+                if (snapshotFile.empty()) {
+                    return graph.buildScene();
+                }
+                if (auto scene = core::LoadSceneSnapshot(snapshotFile, data, graph)) {
+                    return scene;
+                }
+                auto scene = graph.buildScene();
+                core::WriteSceneSnapshot(snapshotFile, data, *scene);
+                return scene;
+            };
 
-            graph.render(ctx, outFile);
+            if (result.count("sequence") == 0) {
+                graph.render(ctx, buildScene(), outFile);
+            } else {
+                if (!graph.checkpointFile.empty()) {
+                    MIYUKI_THROW(std::runtime_error, "checkpoints are not supported with --sequence");
+                }
+                auto sequence = LoadSequence(cwd / result["sequence"].as<std::string>());
+                using Clock = std::chrono::steady_clock;
+                auto start = Clock::now();
+                auto scene = buildScene();
+                auto setup = std::chrono::duration<double>(Clock::now() - start).count();
+                log::log("Scene set up in {:.3f}secs, rendering {} frames\n", setup, sequence.size());
+                std::vector<double> times;
+                size_t failed = 0;
+                for (size_t frame = 0; frame < sequence.size(); frame++) {
+                    log::log("Frame {}/{}\n", frame + 1, sequence.size());
+                    graph.camera = serialize::fromJson<std::shared_ptr<core::Camera>>(
+                            *ctx, ApplyCameraOverride(data["camera"], sequence[frame]));
+                    auto frameStart = Clock::now();
+                    if (!graph.render(ctx, scene, FrameFileName(outFile, frame))) {
+                        failed++;
+                    }
+                    times.push_back(std::chrono::duration<double>(Clock::now() - frameStart).count());
+                }
+                log::log("{:>8} {:>10}  {}\n", "frame", "secs", "image");
+                for (size_t frame = 0; frame < times.size(); frame++) {
+                    log::log("{:>8} {:>10.3f}  {}\n", frame, times[frame], FrameFileName(outFile, frame));
+                }
+                double total = std::accumulate(times.begin(), times.end(), 0.0);
+                log::log("setup {:.3f}secs once, {} frames in {:.3f}secs, {:.3f}secs per frame\n", setup,
+                         times.size(), total, times.empty() ? 0.0 : total / times.size());
+                if (failed != 0) {
+                    MIYUKI_THROW(std::runtime_error, fmt::format("{} frames failed", failed));
+                }
+            }
 
         }
         return 0;
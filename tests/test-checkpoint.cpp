@@ -0,0 +1,163 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/rng.h>
+#include "../src/core/integrators/checkpoint.h"
+#include <cstring>
+#include <fstream>
+
+namespace miyuki::core {
+    static bool Check(bool ok, const char *what) {
+        log::log("{}: {}\n", what, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // every plane holds different values, so a plane read into the wrong image shows up
+    std::shared_ptr<Film> createFilm(int width, int height, int samples) {
+        auto film = std::make_shared<Film>(width, height);
+        Rng rng(width * height);
+        for (int s = 0; s < samples; s++) {
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    Film::Sample sample;
+                    sample.color = float3(rng.uniformFloat(), rng.uniformFloat(), 4 * rng.uniformFloat());
+                    sample.normal = float3(rng.uniformFloat(), -1, 0);
+                    sample.albedo = float3(0.5f, rng.uniformFloat(), 0.25f);
+                    film->addSample(Vec2f((x + 0.5f) / width, (y + 0.5f) / height), sample, 1.0f);
+                }
+            }
+        }
+        return film;
+    }
+
+    bool Equal(const Film &a, const Film &b) {
+        if (a.width != b.width || a.height != b.height) {
+            return false;
+        }
+        auto size = sizeof(*a.color.data()) * a.width * a.height;
+        return std::memcmp(a.color.data(), b.color.data(), size) == 0 &&
+               std::memcmp(a.normal.data(), b.normal.data(), size) == 0 &&
+               std::memcmp(a.albedo.data(), b.albedo.data(), size) == 0 &&
+               std::memcmp(a.weight.data(), b.weight.data(), size) == 0 &&
+               std::memcmp(a.secondMoment.data(), b.secondMoment.data(), size) == 0;
+    }
+
+    template<class F>
+    static bool Throws(F &&f) {
+        try {
+            f();
+            return false;
+        } catch (std::exception &) {
+            return true;
+        }
+    }
+
+    static std::vector<char> ReadFile(const fs::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    static void WriteFile(const fs::path &path, const std::vector<char> &buffer) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(buffer.data(), buffer.size());
+    }
+
+    bool testFile(const fs::path &dir) {
+        auto path = (dir / "file.ckpt").string();
+        Checkpoint checkpoint;
+        checkpoint.integrator = "GuidedPathTracer";
+        checkpoint.film = createFilm(13, 7, 3);
+        checkpoint.sampleIndex.resize(13 * 7);
+        for (size_t i = 0; i < checkpoint.sampleIndex.size(); i++) {
+            checkpoint.sampleIndex[i] = i * 3;
+        }
+        checkpoint.state = std::string("tree\0state", 10);
+        WriteCheckpoint(path, checkpoint);
+        bool ok = Check(!fs::exists(path + ".tmp"), "temporary file renamed");
+
+        auto read = ReadCheckpoint(path);
+        ok = Check(read.integrator == checkpoint.integrator && read.state == checkpoint.state &&
+                   read.sampleIndex == checkpoint.sampleIndex && Equal(*read.film, *checkpoint.film),
+                   "round trip, including the second moment") && ok;
+
+        // magic, then version, texel size, width and height
+        auto buffer = ReadFile(path);
+        auto rejects = [&](size_t offset, char delta) {
+            auto copy = buffer;
+            copy[offset] += delta;
+            WriteFile(dir / "bad.ckpt", copy);
+            return Throws([&] { ReadCheckpoint((dir / "bad.ckpt").string()); });
+        };
+        ok = Check(rejects(0, 1), "rejects a wrong magic") && ok;
+        ok = Check(rejects(8, 1), "rejects a wrong version") && ok;
+        ok = Check(rejects(12, 4), "rejects a wrong texel size") && ok;
+        auto truncated = buffer;
+        truncated.pop_back();
+        WriteFile(dir / "bad.ckpt", truncated);
+        ok = Check(Throws([&] { ReadCheckpoint((dir / "bad.ckpt").string()); }), "rejects a truncated file") && ok;
+        return ok;
+    }
+
+    bool testResume(const fs::path &dir) {
+        RenderSettings settings;
+        settings.checkpointFile = (dir / "resume.ckpt").string();
+        settings.checkpointInterval = 0;
+        settings.resume = true;
+        bool ok = true;
+
+        auto film = createFilm(8, 5, 4);
+        Film empty(8, 5);
+        RenderCheckpoint missing(settings, "PathTracer");
+        ok = Check(missing.resume(empty) == 0, "resume without a checkpoint starts over") && ok;
+
+        RenderCheckpoint writer(settings, "PathTracer");
+        writer.update(*film, 4, [] { return std::string("state"); });
+        RenderCheckpoint reader(settings, "PathTracer");
+        Film resumed(8, 5);
+        std::string state;
+        ok = Check(reader.resume(resumed, &state) == 4 && state == "state" && Equal(resumed, *film),
+                   "resume restores the film and state") && ok;
+
+        RenderCheckpoint other(settings, "RTAO");
+        ok = Check(Throws([&] { other.resume(resumed); }), "resume rejects another integrator") && ok;
+        Film larger(9, 5);
+        ok = Check(Throws([&] { reader.resume(larger); }), "resume rejects another film size") && ok;
+
+        settings.resume = false;
+        RenderCheckpoint fresh(settings, "PathTracer");
+        ok = Check(fresh.resume(resumed) == 0, "no resume without settings.resume") && ok;
+        return ok;
+    }
+}
+
+int main() {
+    using namespace miyuki;
+    auto dir = fs::temp_directory_path() / "miyuki-test-checkpoint";
+    fs::create_directories(dir);
+    bool ok = core::testFile(dir);
+    ok = core::testResume(dir) && ok;
+    fs::remove_all(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "../src/miyuki.server/film-codec.h"
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/rng.h>
+#include <cstring>
+#include <sstream>
+
+namespace miyuki::server {
+    static bool Check(bool ok, const char *what) {
+        log::log("{}: {}\n", what, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    std::shared_ptr<core::Film> createFilm(int width, int height, int samples) {
+        auto film = std::make_shared<core::Film>(width, height);
+        core::Rng rng(width * height);
+        for (int s = 0; s < samples; s++) {
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    core::Film::Sample sample;
+                    sample.color = float3(rng.uniformFloat(), rng.uniformFloat(), 4 * rng.uniformFloat());
+                    sample.normal = float3(0, 0, 1);
+                    sample.albedo = float3(0.5f, 0.5f, 0.25f);
+                    film->addSample(Vec2f((x + 0.5f) / width, (y + 0.5f) / height), sample, 1.0f);
+                }
+            }
+        }
+        return film;
+    }
+
+    template<class F>
+    static bool Throws(F &&f) {
+        try {
+            f();
+            return false;
+        } catch (std::exception &) {
+            return true;
+        }
+    }
+
+    static bool Rejects(const std::string &data) {
+        return Throws([&] {
+            core::FilmDumpHeader header;
+            std::vector<float> payload;
+            DecodeFilm(data, header, payload);
+        });
+    }
+
+    bool testCodec() {
+        auto film = createFilm(37, 21, 4);
+        std::ostringstream out;
+        film->writeDump(out);
+        auto dump = out.str();
+        auto encoded = EncodeFilm(*film);
+
+        core::FilmDumpHeader header;
+        std::vector<float> payload;
+        DecodeFilm(encoded, header, payload);
+        bool ok = Check(std::memcmp(&header, dump.data(), sizeof(header)) == 0 &&
+                        (header.planes & core::FilmDumpHeader::SecondMoment), "header, including the second moment");
+        ok = Check(payload.size() * sizeof(float) == dump.size() - sizeof(header) &&
+                   std::memcmp(payload.data(), dump.data() + sizeof(header), dump.size() - sizeof(header)) == 0,
+                   "payload as in the dump") && ok;
+        log::log("{} bytes encoded, {} bytes dumped\n", encoded.size(), dump.size());
+
+        // the encoded header is the dump header, then the encoding and a reserved word
+        auto headerSize = sizeof(header) + 2 * sizeof(uint32_t);
+        ok = Check(Rejects(encoded.substr(0, headerSize - 1)), "rejects a truncated header") && ok;
+        auto version = encoded;
+        version[offsetof(core::FilmDumpHeader, version)]++;
+        ok = Check(Rejects(version), "rejects a wrong version") && ok;
+        auto magic = encoded;
+        magic[0]++;
+        ok = Check(Rejects(magic), "rejects a wrong magic") && ok;
+        auto encoding = encoded;
+        encoding[sizeof(header)] = 7;
+        ok = Check(Rejects(encoding), "rejects an unknown encoding") && ok;
+        ok = Check(Rejects(encoded.substr(0, encoded.size() - 1)), "rejects a truncated payload") && ok;
+        auto width = encoded;
+        width[offsetof(core::FilmDumpHeader, width)]++;
+        ok = Check(Rejects(width), "rejects a payload of another size") && ok;
+
+        // uncompressed, as sent by builds without zlib
+        std::string raw(headerSize, 0);
+        std::memcpy(raw.data(), dump.data(), sizeof(header));
+        raw += dump.substr(sizeof(header));
+        DecodeFilm(raw, header, payload);
+        ok = Check(std::memcmp(payload.data(), dump.data() + sizeof(header), dump.size() - sizeof(header)) == 0,
+                   "uncompressed payload") && ok;
+        ok = Check(Rejects(raw.substr(0, raw.size() - 1)), "rejects a truncated uncompressed payload") && ok;
+        return ok;
+    }
+}
+
+int main() {
+    return miyuki::server::testCodec() ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <miyuki.foundation/film.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/rng.h>
+#include <cstring>
+#include <fstream>
+
+namespace miyuki::core {
+    static bool Check(bool ok, const char *what) {
+        log::log("{}: {}\n", what, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    std::shared_ptr<Film> createFilm(int width, int height, int samples, uint64_t seed) {
+        auto film = std::make_shared<Film>(width, height);
+        Rng rng(seed);
+        for (int s = 0; s < samples; s++) {
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    Film::Sample sample;
+                    sample.color = float3(rng.uniformFloat(), rng.uniformFloat(), 4 * rng.uniformFloat());
+                    sample.normal = float3(rng.uniformFloat(), -1, 0);
+                    sample.albedo = float3(0.5f, rng.uniformFloat(), 0.25f);
+                    film->addSample(Vec2f((x + 0.5f) / width, (y + 0.5f) / height), sample, 1.0f);
+                }
+            }
+        }
+        return film;
+    }
+
+    // dumps hold three channels per texel, or only the first one of the weight
+    static bool Equal(const RGBImage &a, const RGBImage &b, size_t n, int channels = 3) {
+        for (size_t i = 0; i < n; i++) {
+            for (int c = 0; c < channels; c++) {
+                if (a.data()[i][c] != b.data()[i][c]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool Equal(const Film &a, const Film &b, bool variance = true) {
+        auto n = a.width * a.height;
+        return a.width == b.width && a.height == b.height && Equal(a.color, b.color, n) &&
+               Equal(a.normal, b.normal, n) && Equal(a.albedo, b.albedo, n) && Equal(a.weight, b.weight, n, 1) &&
+               (!variance || Equal(a.secondMoment, b.secondMoment, n));
+    }
+
+    static std::vector<char> ReadFile(const fs::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    static void WriteFile(const fs::path &path, const std::vector<char> &buffer) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(buffer.data(), buffer.size());
+    }
+
+    static bool Rejects(const fs::path &path, const std::vector<char> &buffer) {
+        WriteFile(path, buffer);
+        try {
+            Film::readDump(path.string());
+            return false;
+        } catch (std::exception &) {
+            return true;
+        }
+    }
+
+    bool testRoundTrip(const fs::path &dir) {
+        auto film = createFilm(13, 7, 3, 1);
+        auto path = (dir / "film.film").string();
+        film->writeDump(path);
+        auto buffer = ReadFile(path);
+        FilmDumpHeader header;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        bool ok = Check(header.valid() && header.width == 13 && header.height == 7 &&
+                        (header.planes & FilmDumpHeader::SecondMoment) && header.channels() == 13 &&
+                        buffer.size() == sizeof(header) + header.payloadSize(), "header");
+        ok = Check(Equal(*Film::readDump(path), *film), "round trip, including the second moment") && ok;
+
+        film->writeDump(path, false);
+        auto read = Film::readDump(path);
+        auto size = ReadFile(path).size();
+        ok = Check(Equal(*read, *film, false) && read->secondMoment.data()[0][0] == 0 &&
+                   size == buffer.size() - sizeof(float) * 3 * 13 * 7, "round trip without the second moment") && ok;
+
+        auto rejects = [&](size_t offset, char delta) {
+            auto copy = buffer;
+            copy[offset] += delta;
+            return Rejects(dir / "bad.film", copy);
+        };
+        ok = Check(rejects(0, 1), "rejects a wrong magic") && ok;
+        ok = Check(rejects(offsetof(FilmDumpHeader, version), 1), "rejects a wrong version") && ok;
+        ok = Check(rejects(offsetof(FilmDumpHeader, width), 1), "rejects a wrong width") && ok;
+        ok = Check(rejects(offsetof(FilmDumpHeader, planes), 32), "rejects unknown planes") && ok;
+        auto resized = buffer;
+        resized.pop_back();
+        ok = Check(Rejects(dir / "bad.film", resized), "rejects a truncated payload") && ok;
+        resized.resize(sizeof(header) - 1);
+        ok = Check(Rejects(dir / "bad.film", resized), "rejects a truncated header") && ok;
+        resized = buffer;
+        resized.push_back(0);
+        ok = Check(Rejects(dir / "bad.film", resized), "rejects trailing data") && ok;
+        return ok;
+    }
+
+    // one sample per pixel in each film, so adding up the payloads is exact
+    bool testMerge(const fs::path &dir) {
+        auto a = createFilm(9, 4, 1, 2), b = createFilm(9, 4, 1, 3);
+        a->writeDump((dir / "a.film").string());
+        b->writeDump((dir / "b.film").string());
+        auto bufferA = ReadFile(dir / "a.film"), bufferB = ReadFile(dir / "b.film");
+        FilmDumpHeader header;
+        std::memcpy(&header, bufferA.data(), sizeof(header));
+        std::vector<float> payload(header.payloadSize() / sizeof(float));
+        for (size_t i = 0; i < payload.size(); i++) {
+            float x, y;
+            std::memcpy(&x, bufferA.data() + sizeof(header) + i * sizeof(float), sizeof(float));
+            std::memcpy(&y, bufferB.data() + sizeof(header) + i * sizeof(float), sizeof(float));
+            payload[i] = x + y;
+        }
+        auto merged = Film::fromDump(header, payload.data());
+
+        Film expected(9, 4);
+        for (auto film : {a, b}) {
+            auto n = film->width * film->height;
+            for (size_t i = 0; i < n; i++) {
+                expected.color.data()[i] += film->color.data()[i];
+                expected.normal.data()[i] += film->normal.data()[i];
+                expected.albedo.data()[i] += film->albedo.data()[i];
+                expected.weight.data()[i] += film->weight.data()[i];
+                expected.secondMoment.data()[i] += film->secondMoment.data()[i];
+            }
+        }
+        return Check(Equal(*merged, expected), "summed payloads merge the films");
+    }
+}
+
+int main() {
+    using namespace miyuki;
+    auto dir = fs::temp_directory_path() / "miyuki-test-film-dump";
+    fs::create_directories(dir);
+    bool ok = core::testRoundTrip(dir);
+    ok = core::testMerge(dir) && ok;
+    fs::remove_all(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.renderer/scene.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/rng.h>
+#include "../src/core/accelerators/sahbvh.h"
+
+namespace miyuki::core {
+    // small triangles scattered over the unit cube, overlapping each other
+    std::shared_ptr<Mesh> createTriangleSoup(size_t n, Rng &rng) {
+        auto mesh = std::make_shared<Mesh>();
+        mesh->_loaded = true;
+        std::vector<VertexIndices> corners(n);
+        for (size_t i = 0; i < n; i++) {
+            Point3f center(rng.uniformFloat(), rng.uniformFloat(), rng.uniformFloat());
+            for (int j = 0; j < 3; j++) {
+                Vec3f offset(rng.uniformFloat() - 0.5f, rng.uniformFloat() - 0.5f, rng.uniformFloat() - 0.5f);
+                corners[i].position[j] = int(mesh->_vertex_data.position.size());
+                mesh->_vertex_data.position.push_back(center + 0.1f * offset);
+            }
+            corners[i].normal = Point3i(-1);
+            corners[i].texCoord = Point3i(-1);
+        }
+        std::vector<uint16_t> materials(n, 0);
+        mesh->setTriangles(corners.data(), materials.data(), n);
+        return mesh;
+    }
+
+    std::shared_ptr<Scene> createScene(const std::shared_ptr<Mesh> &mesh, const std::string &builder,
+                                       int treeletPasses) {
+        auto scene = std::make_shared<Scene>();
+        scene->meshes.push_back(mesh);
+        auto accel = std::make_shared<BVHAccelerator>();
+        accel->builder = builder;
+        accel->treeletPasses = treeletPasses;
+        scene->setAccelerator(accel);
+        scene->preprocess();
+        return scene;
+    }
+
+    // the closest hits of rays between random points of the cube have to be the same triangles
+    bool testClosestHits(size_t nTriangles, int treeletPasses) {
+        Rng rng(nTriangles);
+        auto mesh = createTriangleSoup(nTriangles, rng);
+        auto sah = createScene(mesh, "sah", 0);
+        auto lbvh = createScene(mesh, "lbvh", treeletPasses);
+        size_t nRays = 100000, mismatches = 0, hits = 0;
+        for (size_t i = 0; i < nRays; i++) {
+            Point3f o(rng.uniformFloat(), rng.uniformFloat(), rng.uniformFloat());
+            Point3f target(rng.uniformFloat(), rng.uniformFloat(), rng.uniformFloat());
+            Ray ray(o, normalize(target - o), RayBias);
+            Intersection a, b;
+            bool hitA = sah->intersect(ray, a), hitB = lbvh->intersect(ray, b);
+            if (hitA != hitB || (hitA && (a.shape->primitiveId != b.shape->primitiveId || a.distance != b.distance))) {
+                mismatches++;
+            }
+            hits += hitA;
+        }
+        log::log("{} triangles, {} treelet passes: {} of {} rays hit, {} differ\n", nTriangles, treeletPasses, hits,
+                 nRays, mismatches);
+        return mismatches == 0;
+    }
+}
+
+int main() {
+    bool ok = true;
+    for (size_t n : {size_t(1), size_t(100), size_t(20000)}) {
+        ok = miyuki::core::testClosestHits(n, 0) && ok;
+        ok = miyuki::core::testClosestHits(n, 2) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.renderer/mesh.h>
+#include <miyuki.foundation/log.hpp>
+#include <cstring>
+#include <fstream>
+
+namespace miyuki::core {
+    static bool Check(bool ok, const char *what) {
+        log::log("{}: {}\n", what, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // a quad and a triangle with normals, tex coords and two materials
+    Mesh createMesh() {
+        Mesh mesh;
+        mesh._names = {"floor", "light"};
+        for (int i = 0; i < 5; i++) {
+            mesh._vertex_data.position.push_back(Point3f(i % 2, i / 2, 0.5f * i));
+            mesh._vertex_data.normal.push_back(Normal3f(0, 0, 1));
+            mesh._vertex_data.tex_coord.push_back(Point2f(0.25f * i, 1.0f - 0.25f * i));
+        }
+        std::vector<VertexIndices> corners = {{Point3i(0, 1, 2), Point3i(0, 1, 2), Point3i(0, 1, 2)},
+                                              {Point3i(1, 3, 2), Point3i(1, 3, 2), Point3i(1, 3, 2)},
+                                              {Point3i(2, 3, 4), Point3i(2, 3, 4), Point3i(2, 3, 4)}};
+        std::vector<uint16_t> materials = {0, 0, 1};
+        mesh.setTriangles(corners.data(), materials.data(), corners.size());
+        return mesh;
+    }
+
+    template<class T>
+    static bool Equal(const MeshBuffer<T> &a, const MeshBuffer<T> &b) {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+    }
+
+    static bool Equal(const Mesh &a, const Mesh &b) {
+        return a._names == b._names && Equal(a._vertex_data.position, b._vertex_data.position) &&
+               Equal(a._vertex_data.normal, b._vertex_data.normal) &&
+               Equal(a._vertex_data.tex_coord, b._vertex_data.tex_coord) && Equal(a.indices, b.indices) &&
+               Equal(a.materialIds, b.materialIds) && a.triangles.size() == b.triangles.size();
+    }
+
+    template<class T>
+    static void Write(std::vector<char> &buffer, const T &v) {
+        auto p = reinterpret_cast<const char *>(&v);
+        buffer.insert(buffer.end(), p, p + sizeof(T));
+    }
+
+    static void WriteString(std::vector<char> &buffer, const std::string &s) {
+        Write(buffer, s.length());
+        buffer.insert(buffer.end(), s.begin(), s.end());
+    }
+
+    // the layout Mesh::fromBinary() reads for files that do not start with MeshFileHeader::Magic
+    std::vector<char> writeVersion1(const Mesh &mesh) {
+        std::vector<char> buffer;
+        WriteString(buffer, "BINARY_MESH");
+        Write(buffer, mesh._names.size());
+        for (auto &name : mesh._names) {
+            WriteString(buffer, name);
+        }
+        auto writeArray = [&](const auto &array) {
+            Write(buffer, array.size());
+            for (auto &i : array) {
+                Write(buffer, i);
+            }
+        };
+        writeArray(mesh._vertex_data.position);
+        writeArray(mesh._vertex_data.normal);
+        writeArray(mesh._vertex_data.tex_coord);
+        std::vector<VertexIndices> corners;
+        for (auto &i : mesh.indices) {
+            corners.push_back({i, i, i});
+        }
+        writeArray(corners);
+        writeArray(mesh.materialIds);
+        return buffer;
+    }
+
+    static void WriteFile(const fs::path &path, const std::vector<char> &buffer) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(buffer.data(), buffer.size());
+    }
+
+    static bool Rejects(const std::vector<char> &buffer) {
+        try {
+            Mesh mesh;
+            mesh.fromBinary(buffer);
+            return false;
+        } catch (std::exception &) {
+            return true;
+        }
+    }
+
+    static bool LoadFails(const fs::path &path, const std::vector<char> &buffer) {
+        WriteFile(path, buffer);
+        Mesh mesh;
+        return !mesh.loadFromFile(path.string());
+    }
+
+    bool testVersion2(const fs::path &dir) {
+        auto mesh = createMesh();
+        std::vector<char> buffer;
+        mesh.toBinary(buffer);
+        MeshFileHeader header;
+        std::memcpy(&header, buffer.data(), sizeof(header));
+        bool ok = true;
+        ok = Check(std::memcmp(header.magic, MeshFileHeader::Magic, sizeof(header.magic)) == 0 &&
+                   header.version == MeshFileHeader::Version && header.fileSize == buffer.size(), "v2 header") && ok;
+        bool aligned = true;
+        for (auto offset : {header.names, header.positions, header.normals, header.texCoords, header.indices,
+                            header.materials}) {
+            aligned = aligned && offset % MeshFileHeader::Alignment == 0 && offset >= sizeof(header);
+        }
+        ok = Check(aligned, "v2 sections aligned") && ok;
+        ok = Check(MeshFileHeader::Checksum(buffer.data() + sizeof(header), buffer.size() - sizeof(header)) ==
+                   header.checksum, "v2 checksum") && ok;
+
+        Mesh copied;
+        copied.fromBinary(buffer);
+        ok = Check(Equal(mesh, copied) && !copied._vertex_data.position.mapped(), "v2 fromBinary") && ok;
+
+        auto path = dir / "v2.mesh";
+        mesh.writeToFile(path.string());
+        Mesh mapped;
+        ok = Check(mapped.loadFromFile(path.string()) && Equal(mesh, mapped) &&
+                   mapped._vertex_data.position.mapped(), "v2 loadFromFile maps the vertex data") && ok;
+
+        auto truncated = buffer;
+        truncated.resize(buffer.size() - 1);
+        ok = Check(Rejects(truncated) && LoadFails(dir / "truncated.mesh", truncated), "v2 truncated") && ok;
+        truncated.resize(sizeof(header) - 1);
+        ok = Check(LoadFails(dir / "truncated.mesh", truncated), "v2 shorter than the header") && ok;
+
+        auto corrupt = [&](auto field, uint64_t value) {
+            auto copy = buffer;
+            auto h = header;
+            h.*field = value;
+            std::memcpy(copy.data(), &h, sizeof(h));
+            return copy;
+        };
+        ok = Check(Rejects(corrupt(&MeshFileHeader::positions, header.positions + 4)), "v2 misaligned section") && ok;
+        ok = Check(Rejects(corrupt(&MeshFileHeader::nTriangles, uint64_t(1) << 60u)), "v2 section past the end") &&
+             ok;
+        ok = Check(Rejects(corrupt(&MeshFileHeader::normals, uint64_t(1) << 62u)), "v2 section offset past the end") &&
+             ok;
+        auto version = buffer;
+        version[offsetof(MeshFileHeader, version)]++;
+        ok = Check(Rejects(version), "v2 unknown version") && ok;
+#ifndef MYK_RELEASE
+        // the checksum is only verified outside release builds
+        auto flipped = buffer;
+        flipped[header.positions] ^= 1;
+        ok = Check(Rejects(flipped) && LoadFails(dir / "corrupt.mesh", flipped), "v2 corrupt section") && ok;
+#endif
+        return ok;
+    }
+
+    bool testVersion1(const fs::path &dir) {
+        auto mesh = createMesh();
+        auto buffer = writeVersion1(mesh);
+        bool ok = true;
+        Mesh copied;
+        copied.fromBinary(buffer);
+        ok = Check(Equal(mesh, copied), "v1 fromBinary") && ok;
+
+        auto path = dir / "v1.mesh";
+        WriteFile(path, buffer);
+        Mesh loaded;
+        ok = Check(loaded.loadFromFile(path.string()) && Equal(mesh, loaded), "v1 loadFromFile") && ok;
+
+        // written again in version 2
+        std::vector<char> converted;
+        loaded.toBinary(converted);
+        Mesh reloaded;
+        reloaded.fromBinary(converted);
+        ok = Check(Equal(mesh, reloaded), "v1 converted to v2") && ok;
+
+        auto truncated = buffer;
+        truncated.resize(buffer.size() - 1);
+        ok = Check(Rejects(truncated) && LoadFails(dir / "truncated.mesh", truncated), "v1 truncated") && ok;
+        return ok;
+    }
+}
+
+int main() {
+    using namespace miyuki;
+    auto dir = fs::temp_directory_path() / "miyuki-test-mesh-file";
+    fs::create_directories(dir);
+    bool ok = core::testVersion2(dir);
+    ok = core::testVersion1(dir) && ok;
+    fs::remove_all(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "../src/core/mesh-importers/obj-parser.h"
+#include <miyuki.foundation/log.hpp>
+#include <fstream>
+
+namespace miyuki::core {
+    static bool Check(bool ok, const char *what) {
+        log::log("{}: {}\n", what, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    static void WriteFile(const fs::path &path, const std::string &text) {
+        std::ofstream out(path, std::ios::binary);
+        out << text;
+    }
+
+    static bool Equal(const Point3i &a, int x, int y, int z) { return a[0] == x && a[1] == y && a[2] == z; }
+
+    struct ParsedObj {
+        std::vector<Point3f> positions;
+        std::vector<Normal3f> normals;
+        std::vector<Point2f> texCoords;
+        std::vector<VertexIndices> indices;
+        std::vector<uint16_t> materials;
+        std::vector<std::string> materialNames;
+    };
+
+    ParsedObj parseObj(const fs::path &path, size_t chunkSize) {
+        ObjParser parser(path, chunkSize);
+        ParsedObj obj;
+        obj.positions.resize(parser.positions);
+        obj.normals.resize(parser.normals);
+        obj.texCoords.resize(parser.texCoords);
+        obj.indices.resize(parser.triangles);
+        obj.materials.resize(parser.triangles);
+        obj.materialNames = parser.materialNames;
+        parser.parse(obj.positions.data(), obj.normals.data(), obj.texCoords.data(), obj.indices.data(),
+                     obj.materials.data());
+        return obj;
+    }
+
+    const char *scene = "mtllib scene.mtl\n"
+                        "v 0 0 0\n"
+                        "v 1 0 0\n"
+                        "v 1 1 0\n"
+                        "v 0 1 0\n"
+                        "v 0.5 1.5 0\n"
+                        "vn 0 0 1\n"
+                        "vt 0.5 0.25\n"
+                        "# before any usemtl\n"
+                        "f 1/1/1 2/1/1 3/1/1\n"
+                        "usemtl red\n"
+                        "f 1//1 2//1 3//1 4//1\n"
+                        "f -5 -4 -3 -2 -1\n"
+                        "usemtl blue\n"
+                        "v 2 0 0\n"
+                        "f -1 1 2\n"
+                        "usemtl red\n"
+                        "f 1 2 3\n";
+
+    bool testScene(const fs::path &path, size_t chunkSize) {
+        auto obj = parseObj(path, chunkSize);
+        auto &f = obj.indices;
+        auto &m = obj.materials;
+        bool ok = true;
+        auto name = fmt::format("chunk size {}", chunkSize);
+        auto check = [&](bool result, const char *what) {
+            ok = Check(result, fmt::format("{}, {}", name, what).c_str()) && ok;
+        };
+        check(obj.positions.size() == 6 && obj.normals.size() == 1 && obj.texCoords.size() == 1 && f.size() == 8 &&
+                  obj.positions[5][0] == 2.0f && obj.texCoords[0][1] == 0.25f,
+              "counts");
+        check(obj.materialNames == std::vector<std::string>{"red", "blue"}, "material names");
+        check(Equal(f[0].position, 0, 1, 2) && Equal(f[0].texCoord, 0, 0, 0) && Equal(f[0].normal, 0, 0, 0) &&
+                  m[0] == uint16_t(-1),
+              "v/vt/vn corners without a material");
+        check(Equal(f[1].position, 0, 1, 2) && Equal(f[2].position, 0, 2, 3) && Equal(f[1].normal, 0, 0, 0) &&
+                  Equal(f[2].normal, 0, 0, 0) && Equal(f[2].texCoord, -1, -1, -1),
+              "v//vn quad");
+        check(Equal(f[3].position, 0, 1, 2) && Equal(f[4].position, 0, 2, 3) && Equal(f[5].position, 0, 3, 4) &&
+                  Equal(f[5].normal, -1, -1, -1),
+              "negative indices in a pentagon fan");
+        check(Equal(f[6].position, 5, 0, 1), "negative index past a later vertex");
+        check(m[1] == 0 && m[5] == 0 && m[6] == 1 && m[7] == 0, "usemtl");
+        return ok;
+    }
+
+    // the parser has to reject text and report its line
+    bool testError(const fs::path &path, const std::string &text, const std::string &expected) {
+        WriteFile(path, text);
+        std::string error;
+        try {
+            parseObj(path, 16);
+        } catch (std::exception &e) {
+            error = e.what();
+        }
+        return Check(error == expected, fmt::format("error \"{}\"", expected).c_str());
+    }
+}
+
+int main() {
+    using namespace miyuki;
+    auto dir = fs::temp_directory_path() / "miyuki-test-obj-parser";
+    fs::create_directories(dir);
+    auto path = dir / "scene.obj";
+    core::WriteFile(path, core::scene);
+    bool ok = true;
+    // 16 bytes split the file at nearly every line, so usemtl state crosses chunks
+    for (size_t chunkSize : {size_t(1), size_t(16), size_t(64), size_t(16) << 20u}) {
+        ok = core::testScene(path, chunkSize) && ok;
+    }
+    auto error = dir / "error.obj";
+    ok = core::testError(error, "v 0 0 0\nv 1 0 0\n\nf 1 2 x\n", "line 4: expected a number") && ok;
+    ok = core::testError(error, "v 0 0 0\nv 1 0 0\nv 0 1 0\n# comment\nf 1 2 -4\n", "line 5: index -4 out of range") &&
+         ok;
+    ok = core::testError(error, "v 0 0 0\r\nv 1 0 0\r\nv 0 1 0\r\nf 1 2 3/\r\nf 1 2 4\r\n",
+                         "line 4: expected a number") &&
+         ok;
+    ok = core::testError(error, "v 0 0 0\nvn 0 0 1\nf 1//1 1//2 1//1\n", "line 3: index 2 out of range") && ok;
+    fs::remove_all(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.foundation/parallel.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/rng.h>
+#include <algorithm>
+
+namespace miyuki {
+    // n keys out of nDistinct values, so most of them repeat when nDistinct is small
+    std::vector<uint64_t> randomKeys(size_t n, uint64_t nDistinct, uint64_t seed) {
+        core::Rng rng(seed);
+        std::vector<uint64_t> keys(n);
+        for (auto &key : keys) {
+            auto value = (uint64_t(rng.uniformUint32()) << 32u | rng.uniformUint32()) % nDistinct;
+            // spread the values over all 64 bits
+            key = value * 0x9E3779B97F4A7C15ull;
+        }
+        return keys;
+    }
+
+    bool testFullSort(size_t n, uint64_t nDistinct) {
+        auto keys = randomKeys(n, nDistinct, n);
+        auto expected = keys;
+        std::sort(expected.begin(), expected.end());
+        ParallelRadixSort(keys, 0, 64);
+        bool ok = keys == expected;
+        log::log("{} keys, {} distinct, bits [0, 64): {}\n", n, nDistinct, ok ? "ok" : "FAILED");
+        return ok;
+    }
+
+    // the bits outside [lowBit, highBit) have to keep their order among equal digits
+    bool testPartialSort(size_t n, uint64_t nDistinct, int lowBit, int highBit) {
+        auto keys = randomKeys(n, nDistinct, n + 1);
+        auto expected = keys;
+        auto mask = (highBit == 64 ? ~uint64_t(0) : (uint64_t(1) << highBit) - 1) & ~((uint64_t(1) << lowBit) - 1);
+        std::stable_sort(expected.begin(), expected.end(),
+                         [=](uint64_t a, uint64_t b) { return (a & mask) < (b & mask); });
+        ParallelRadixSort(keys, lowBit, highBit);
+        bool ok = keys == expected;
+        log::log("{} keys, {} distinct, bits [{}, {}): {}\n", n, nDistinct, lowBit, highBit, ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main() {
+    using namespace miyuki;
+    bool ok = true;
+    for (size_t n : {size_t(0), size_t(1), size_t(1000), size_t(1) << 18u}) {
+        for (uint64_t nDistinct : {uint64_t(3), uint64_t(1000), ~uint64_t(0)}) {
+            ok = testFullSort(n, nDistinct) && ok;
+            ok = testPartialSort(n, nDistinct, 32, 62) && ok;
+            ok = testPartialSort(n, nDistinct, 5, 19) && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+// MIT License
+//
+// Copyright (c) 2019 椎名深雪
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <miyuki.renderer/scene.h>
+#include <miyuki.foundation/log.hpp>
+#include <miyuki.foundation/profiler.h>
+#include <miyuki.foundation/rng.h>
+#include "../src/core/accelerators/sahbvh.h"
+
+namespace miyuki::core {
+    // a height field of n x n vertices over [0, 1]^2
+    std::shared_ptr<Mesh> createGrid(int n, float phase) {
+        auto mesh = std::make_shared<Mesh>();
+        mesh->_loaded = true;
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                float u = float(x) / (n - 1), v = float(y) / (n - 1);
+                mesh->_vertex_data.position.push_back(Point3f(u, v, 0.1f * std::sin(8 * u + phase) * v));
+            }
+        }
+        std::vector<VertexIndices> corners;
+        for (int y = 0; y + 1 < n; y++) {
+            for (int x = 0; x + 1 < n; x++) {
+                int i = y * n + x;
+                VertexIndices a{Point3i(i, i + 1, i + n), Point3i(-1), Point3i(-1)};
+                VertexIndices b{Point3i(i + 1, i + n + 1, i + n), Point3i(-1), Point3i(-1)};
+                corners.push_back(a);
+                corners.push_back(b);
+            }
+        }
+        std::vector<uint16_t> materials(corners.size(), 0);
+        mesh->setTriangles(corners.data(), materials.data(), corners.size());
+        return mesh;
+    }
+
+    std::shared_ptr<Scene> createScene(const std::shared_ptr<Mesh> &mesh) {
+        auto scene = std::make_shared<Scene>();
+        scene->meshes.push_back(mesh);
+        scene->setAccelerator(std::make_shared<BVHAccelerator>());
+        scene->preprocess();
+        return scene;
+    }
+
+    // number of rays whose closest hit differs between the scenes
+    size_t compareHits(Scene &a, Scene &b, size_t nRays) {
+        Rng rng(7);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < nRays; i++) {
+            Point3f o(rng.uniformFloat() * 1.4f - 0.2f, rng.uniformFloat() * 1.4f - 0.2f, 1.0f);
+            Vec3f d(rng.uniformFloat() - 0.5f, rng.uniformFloat() - 0.5f, -1.0f);
+            Ray ray(o, normalize(d), RayBias);
+            Intersection x, y;
+            bool hitA = a.intersect(ray, x), hitB = b.intersect(ray, y);
+            if (hitA != hitB || (hitA && std::abs(x.distance - y.distance) > 1e-5f)) {
+                mismatches++;
+            }
+        }
+        return mismatches;
+    }
+
+    // moves the vertices of a grid built with phase 0 to the given phase
+    void moveGrid(Mesh &mesh, const Mesh &target) {
+        std::copy(target._vertex_data.position.begin(), target._vertex_data.position.end(),
+                  mesh._vertex_data.position.begin());
+        mesh.markDirty();
+    }
+
+    bool testRefit(int n, size_t nRays) {
+        auto mesh = createGrid(n, 0.0f);
+        auto scene = createScene(mesh);
+        auto moved = createGrid(n, 1.5f);
+        moveGrid(*mesh, *moved);
+
+        Profiler refitProfiler;
+        scene->update();
+        auto refit = refitProfiler.elapsed<double>().count();
+
+        Profiler buildProfiler;
+        auto rebuilt = createScene(moved);
+        auto build = buildProfiler.elapsed<double>().count();
+
+        auto mismatches = compareHits(*scene, *rebuilt, nRays);
+        log::log("{} triangles: refit {:.1f}ms, rebuild {:.1f}ms, {} of {} rays differ\n", mesh->triangles.size(),
+                 refit * 1e3, build * 1e3, mismatches, nRays);
+        return mismatches == 0;
+    }
+}
+
+int main() {
+    bool ok = miyuki::core::testRefit(32, 100000);
+    ok = miyuki::core::testRefit(1024, 100000) && ok;
+    return ok ? 0 : 1;
+}